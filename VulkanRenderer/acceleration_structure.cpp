@@ -1,8 +1,8 @@
 #include "stdafx.h"
 #include "acceleration_structure.h"
 
-acceleration_structure::acceleration_structure(vk::PhysicalDevice physical_device,
-    vk::Device device, vk::CommandPool command_pool, vk::Queue queue,
+acceleration_structure::acceleration_structure(vk::Device device, memory_allocator& allocator,
+    vk::CommandBuffer command_buffer,
     const vk::AccelerationStructureGeometryKHR& geometry,
     vk::AccelerationStructureTypeKHR type,
     uint32_t max_primitives,
@@ -20,7 +20,9 @@ acceleration_structure::acceleration_structure(vk::PhysicalDevice physical_devic
         { max_primitives }
     );
 
-    ac_buffer = std::make_unique<buffer>(physical_device, device, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, vk::MemoryPropertyFlagBits::eDeviceLocal, build_sizes.accelerationStructureSize);
+    ac_buffer = std::make_unique<buffer>(device, allocator,
+        vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, vk::MemoryPropertyFlagBits::eDeviceLocal,
+        build_sizes.accelerationStructureSize, memory_category::acceleration_structure);
 
     ac = device.createAccelerationStructureKHRUnique(
         vk::AccelerationStructureCreateInfoKHR()
@@ -30,36 +32,22 @@ acceleration_structure::acceleration_structure(vk::PhysicalDevice physical_devic
     )
         ;
 
-    buffer scratch(physical_device, device, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-        vk::MemoryPropertyFlagBits::eDeviceLocal, build_sizes.buildScratchSize);
-
-    auto command_buffer = std::move(device.allocateCommandBuffersUnique(
-        vk::CommandBufferAllocateInfo()
-        .setCommandPool(command_pool)
-        .setLevel(vk::CommandBufferLevel::ePrimary)
-        .setCommandBufferCount(1)
-    )[0]);
+    scratch = std::make_unique<buffer>(device, allocator,
+        vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, build_sizes.buildScratchSize, memory_category::scratch);
 
     const auto build_range_info = vk::AccelerationStructureBuildRangeInfoKHR()
         .setPrimitiveCount(max_primitives);
 
-    command_buffer->begin(vk::CommandBufferBeginInfo());
-    command_buffer->buildAccelerationStructuresKHR({
+    command_buffer.buildAccelerationStructuresKHR({
         vk::AccelerationStructureBuildGeometryInfoKHR()
         .setFlags(build_flags)
         .setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
         .setDstAccelerationStructure(ac.get())
         .setType(type)
-        .setScratchData(scratch.address)
+        .setScratchData(scratch->address)
         .setGeometries(geometries)
         }, {
             &build_range_info
         });
-    command_buffer->end();
-
-    std::array command_buffers{ command_buffer.get() };
-    queue.submit({
-                     vk::SubmitInfo().setCommandBuffers(command_buffers)
-        }, nullptr);
-    queue.waitIdle();
 }
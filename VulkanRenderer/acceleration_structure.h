@@ -5,8 +5,12 @@ struct acceleration_structure
 {
     std::unique_ptr<buffer> ac_buffer;
     std::unique_ptr<buffer> instance_data;
+    // only used by the build, it can be reset once the command buffer has completed
+    std::unique_ptr<buffer> scratch;
     vk::UniqueAccelerationStructureKHR ac;
 
-    acceleration_structure(vk::PhysicalDevice physical_device, vk::Device device, vk::CommandPool command_pool,
-        vk::Queue queue, const vk::AccelerationStructureGeometryKHR& geometry, vk::AccelerationStructureTypeKHR type, uint32_t max_primitives, std::unique_ptr<buffer> instance_data);
+    // Records the build into command_buffer, which must be submitted before the acceleration structure is used.
+    acceleration_structure(vk::Device device, memory_allocator& allocator, vk::CommandBuffer command_buffer,
+        const vk::AccelerationStructureGeometryKHR& geometry, vk::AccelerationStructureTypeKHR type,
+        uint32_t max_primitives, std::unique_ptr<buffer> instance_data);
 };
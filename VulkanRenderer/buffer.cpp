@@ -21,8 +21,40 @@ uint32_t get_memory_index(vk::PhysicalDevice physical_device, vk::MemoryProperty
     return memory_type_index;
 }
 
-buffer::buffer(vk::PhysicalDevice physical_device, vk::Device device, vk::BufferUsageFlags usage_flags,
-    vk::MemoryPropertyFlags memory_flags, vk::DeviceSize size)
+double measure_map_unmap_time(vk::PhysicalDevice physical_device, vk::Device device, vk::DeviceSize size)
+{
+    const auto ITERATION_COUNT = 1000;
+    const auto memory = device.allocateMemoryUnique(
+        vk::MemoryAllocateInfo()
+        .setAllocationSize(size)
+        .setMemoryTypeIndex(get_memory_index(physical_device, HOST_VISIBLE_AND_COHERENT,
+            vk::MemoryRequirements(size, 1, UINT32_MAX)))
+    );
+    const std::vector<uint8_t> data(size);
+
+    const auto map_start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < ITERATION_COUNT; i++)
+    {
+        auto* ptr = device.mapMemory(memory.get(), 0, size);
+        memcpy(ptr, data.data(), size);
+        device.unmapMemory(memory.get());
+    }
+    const auto map_time = std::chrono::steady_clock::now() - map_start;
+
+    auto* ptr = device.mapMemory(memory.get(), 0, size);
+    const auto copy_start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < ITERATION_COUNT; i++)
+    {
+        memcpy(ptr, data.data(), size);
+    }
+    const auto copy_time = std::chrono::steady_clock::now() - copy_start;
+    device.unmapMemory(memory.get());
+
+    return std::chrono::duration<double, std::micro>(map_time - copy_time).count() / ITERATION_COUNT;
+}
+
+buffer::buffer(vk::Device device, memory_allocator& allocator, vk::BufferUsageFlags usage_flags,
+    vk::MemoryPropertyFlags memory_flags, vk::DeviceSize size, memory_category category)
 {
     this->size = size;
 
@@ -33,22 +65,11 @@ buffer::buffer(vk::PhysicalDevice physical_device, vk::Device device, vk::Buffer
     );
 
     const auto reqs = device.getBufferMemoryRequirements(buf.get());
-    const uint32_t memory_type_index = get_memory_index(physical_device, memory_flags, reqs);
+    memory = allocator.allocate(reqs, memory_flags, true, category);
+    device.bindBufferMemory(buf.get(), memory.memory, memory.offset);
 
     auto shader_device_address = (usage_flags & vk::BufferUsageFlagBits::eShaderDeviceAddress) == vk::BufferUsageFlagBits::eShaderDeviceAddress;
 
-    const auto info = vk::StructureChain<vk::MemoryAllocateInfo, vk::MemoryAllocateFlagsInfo>{
-        vk::MemoryAllocateInfo()
-        .setAllocationSize(reqs.size)
-        .setMemoryTypeIndex(memory_type_index),
-        vk::MemoryAllocateFlagsInfo()
-        .setFlags(shader_device_address ? vk::MemoryAllocateFlagBits::eDeviceAddress : vk::MemoryAllocateFlagBits())
-    };
-
-    memory = device.allocateMemoryUnique(info.get());
-
-    device.bindBufferMemory(buf.get(), memory.get(), 0);
-
     if (shader_device_address) {
         address = device.getBufferAddress(buf.get());
     }
@@ -59,46 +80,6 @@ buffer::buffer(vk::PhysicalDevice physical_device, vk::Device device, vk::Buffer
 
 void buffer::update(vk::Device device, void* data) const
 {
-    auto* ptr = device.mapMemory(memory.get(), 0, VK_WHOLE_SIZE);
-    memcpy(ptr, data, size);
-    device.unmapMemory(memory.get());
-}
-
-std::unique_ptr<buffer> buffer::copy_from_host_to_device_for_vertex_input(
-    vk::PhysicalDevice physical_device, vk::Device device, vk::BufferUsageFlags new_usage_flags,
-    vk::CommandPool command_pool, vk::Queue queue) const
-{
-    auto result = std::make_unique<buffer>(physical_device, device, new_usage_flags,
-        vk::MemoryPropertyFlagBits::eDeviceLocal, size);
-
-    auto command_buffer = device.allocateCommandBuffers(
-        vk::CommandBufferAllocateInfo()
-        .setCommandPool(command_pool)
-        .setLevel(vk::CommandBufferLevel::ePrimary)
-        .setCommandBufferCount(1)
-    )[0];
-
-    command_buffer.begin(vk::CommandBufferBeginInfo());
-    command_buffer.copyBuffer(buf.get(), result->buf.get(), { vk::BufferCopy(0, 0, size) });
-
-    command_buffer.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTransfer,
-        vk::PipelineStageFlagBits::eVertexInput,
-        vk::DependencyFlags(),
-        {},
-        {
-            vk::BufferMemoryBarrier()
-            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-            .setDstAccessMask(vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eVertexAttributeRead)
-            .setBuffer(result->buf.get())
-            .setSize(result->size)
-        },
-        {}
-    );
-
-    command_buffer.end();
-
-    queue.submit({ vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(&command_buffer) }, nullptr);
-
-    return result;
+    memcpy(get_mapped<uint8_t>().data(), data, size);
+    memory.flush(0, size);
 }
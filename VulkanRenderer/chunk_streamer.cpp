@@ -0,0 +1,397 @@
+#include "stdafx.h"
+#include <tuple>
+#include "chunk_streamer.h"
+#include "vertex_packing.h"
+
+static const uint32_t NOT_RESIDENT = UINT32_MAX;
+
+chunk_streamer::chunk_streamer(vk::Device device, memory_allocator& allocator, model_cache cache,
+    vk::IndexType index_type, size_t residency_budget, size_t upload_budget)
+    : device(device)
+    , cache(std::move(cache))
+    , index_type(index_type)
+    , vertex_size(this->cache.vertex_data.size() / this->cache.vertex_count)
+    , index_size(index_type == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t))
+    , update_count(0)
+{
+    const auto chunk_count = this->cache.chunks.size();
+    const auto lod_count = this->cache.lods.size();
+
+    // the meshlets of a chunk cover its triangles in each level without gaps, since meshlets never cross chunks
+    chunk_levels.resize(chunk_count * lod_count, { 0, 0 });
+    for (const auto& m : this->cache.meshlets)
+    {
+        auto& level = chunk_levels[m.chunk * lod_count + m.lod];
+        if (level.index_count == 0)
+        {
+            level.first_index = m.first_index;
+        }
+        assert(level.first_index + level.index_count == m.first_index);
+        level.index_count += m.index_count;
+    }
+
+    // a slot holds the levels of its chunk back to back
+    chunk_index_counts.resize(chunk_count, 0);
+    std::vector<uint32_t> level_slot_offsets(chunk_levels.size());
+    slot_vertex_count = 0;
+    slot_index_count = 0;
+    for (size_t c = 0; c < chunk_count; c++)
+    {
+        for (size_t l = 0; l < lod_count; l++)
+        {
+            level_slot_offsets[c * lod_count + l] = chunk_index_counts[c];
+            chunk_index_counts[c] += chunk_levels[c * lod_count + l].index_count;
+        }
+        slot_vertex_count = std::max(slot_vertex_count, this->cache.chunks[c].vertex_count);
+        slot_index_count = std::max(slot_index_count, chunk_index_counts[c]);
+    }
+    // keeps slots of 16-bit indices 4-byte aligned
+    slot_index_count = (slot_index_count + 1) / 2 * 2;
+
+    meshlets.assign(this->cache.meshlets.begin(), this->cache.meshlets.end());
+    for (auto& m : meshlets)
+    {
+        const auto level = m.chunk * lod_count + m.lod;
+        m.first_index = level_slot_offsets[level] + m.first_index - chunk_levels[level].first_index;
+    }
+
+    const auto slot_size = slot_vertex_count * vertex_size + slot_index_count * index_size;
+    const auto slot_count = std::min(residency_budget / slot_size, chunk_count);
+    if (slot_count == 0)
+    {
+        throw std::runtime_error("The residency budget is smaller than the largest position chunk ("
+            + std::to_string(slot_size / (1024 * 1024) + 1) + " MB)");
+    }
+    slot_chunks.resize(slot_count, NOT_RESIDENT);
+    chunk_slots.resize(chunk_count, NOT_RESIDENT);
+    chunk_wanted_updates.resize(chunk_count, 0);
+
+    // a single chunk may exceed the upload budget, it is then uploaded on its own
+    const auto batch_staging_size = std::max(upload_budget, slot_size);
+    staging_buffer = std::make_unique<buffer>(device, allocator, vk::BufferUsageFlagBits::eTransferSrc,
+        HOST_VISIBLE_AND_COHERENT, batches.size() * batch_staging_size, memory_category::staging);
+    staging_ptr = staging_buffer->get_mapped<uint8_t>().data();
+
+    command_pool = device.createCommandPoolUnique(
+        vk::CommandPoolCreateInfo().setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer));
+    auto command_buffers = device.allocateCommandBuffersUnique(
+        vk::CommandBufferAllocateInfo()
+        .setCommandPool(command_pool.get())
+        .setLevel(vk::CommandBufferLevel::ePrimary)
+        .setCommandBufferCount(static_cast<uint32_t>(batches.size()))
+    );
+    for (size_t i = 0; i < batches.size(); i++)
+    {
+        batches[i].staging_offset = i * batch_staging_size;
+        batches[i].state = batch_state::idle;
+        batches[i].staged_size = 0;
+        batches[i].command_buffer = std::move(command_buffers[i]);
+        batches[i].timeline_value = 0;
+    }
+    current_batch = batches.size() - 1;
+
+    const vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> timeline_info{
+        vk::SemaphoreCreateInfo(),
+        vk::SemaphoreTypeCreateInfo()
+        .setSemaphoreType(vk::SemaphoreType::eTimeline)
+        .setInitialValue(0)
+    };
+    timeline = device.createSemaphoreUnique(timeline_info.get<vk::SemaphoreCreateInfo>());
+    next_timeline_value = 1;
+
+    is_stopping = false;
+    worker = std::thread([this]()
+        {
+            stage_batches();
+        });
+
+    std::printf("Streaming %zu position chunks through %zu slots of %.2lf MB\n", chunk_count, slot_count,
+        slot_size / (1024. * 1024.));
+}
+
+chunk_streamer::~chunk_streamer()
+{
+    {
+        std::lock_guard lock(mutex);
+        is_stopping = true;
+    }
+    staging_requested.notify_one();
+    worker.join();
+
+    const auto last_value = next_timeline_value - 1;
+    device.waitSemaphores(
+        vk::SemaphoreWaitInfo()
+        .setSemaphoreCount(1)
+        .setPSemaphores(&timeline.get())
+        .setPValues(&last_value),
+        UINT64_MAX
+    );
+}
+
+std::span<const position_chunk> chunk_streamer::get_chunks() const
+{
+    return cache.chunks;
+}
+
+const std::vector<lod_level>& chunk_streamer::get_lods() const
+{
+    return cache.lods;
+}
+
+size_t chunk_streamer::get_slot_count() const
+{
+    return slot_chunks.size();
+}
+
+vk::DeviceSize chunk_streamer::get_vertex_buffer_size() const
+{
+    return slot_chunks.size() * slot_vertex_count * vertex_size;
+}
+
+vk::DeviceSize chunk_streamer::get_index_buffer_size() const
+{
+    return slot_chunks.size() * slot_index_count * index_size;
+}
+
+// Orders the chunks by whether their bounding sphere intersects the view frustum and then by their distance to the
+// camera, like the cull shader does for meshlets.
+std::vector<uint32_t> chunk_streamer::prioritize_chunks(const model_uniform_data& camera) const
+{
+    const auto m = glm::transpose(camera.projection * camera.model_view);
+    const std::array planes{ m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[2], m[3] - m[2] };
+    const auto camera_position = glm::vec3(glm::inverse(camera.model_view) * glm::vec4(0.f, 0.f, 0.f, 1.f));
+
+    struct chunk_priority
+    {
+        bool is_outside;
+        float distance;
+        uint32_t chunk;
+    };
+
+    std::vector<chunk_priority> priorities(cache.chunks.size());
+    for (uint32_t c = 0; c < cache.chunks.size(); c++)
+    {
+        // quantized positions are in [-1, 1]^3, so the chunk fits into this sphere
+        const auto& dequantization = cache.chunks[c].dequantization;
+        const auto center = glm::vec3(dequantization);
+        const auto radius = dequantization.w * std::sqrt(3.f);
+
+        auto is_outside = false;
+        for (const auto& plane : planes)
+        {
+            is_outside |= glm::dot(glm::vec3(plane), center) + plane.w < -radius * glm::length(glm::vec3(plane));
+        }
+        priorities[c] = { is_outside, std::max(glm::length(center - camera_position) - radius, 0.f), c };
+    }
+
+    std::sort(priorities.begin(), priorities.end(), [](const chunk_priority& a, const chunk_priority& b)
+        {
+            return std::tie(a.is_outside, a.distance, a.chunk) < std::tie(b.is_outside, b.distance, b.chunk);
+        });
+
+    std::vector<uint32_t> order(priorities.size());
+    std::transform(priorities.begin(), priorities.end(), order.begin(), [](const chunk_priority& p)
+        {
+            return p.chunk;
+        });
+    return order;
+}
+
+void chunk_streamer::stage_batches()
+{
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        staging_requested.wait(lock, [&]()
+            {
+                return is_stopping || batches[current_batch].state == batch_state::staging;
+            });
+        if (is_stopping)
+        {
+            return;
+        }
+
+        // the render thread leaves the batch alone until it is staged
+        auto& batch = batches[current_batch];
+        lock.unlock();
+        for (const auto& staged : batch.chunks)
+        {
+            const auto& chunk = cache.chunks[staged.chunk];
+            memcpy(staging_ptr + staged.vertex_offset, cache.vertex_data.data() + chunk.first_vertex * vertex_size,
+                chunk.vertex_count * vertex_size);
+
+            auto* indices = staging_ptr + staged.index_offset;
+            for (size_t l = 0; l < cache.lods.size(); l++)
+            {
+                const auto& level = chunk_levels[staged.chunk * cache.lods.size() + l];
+                pack_indices(cache.triangles, level.first_index / 3, level.index_count / 3, index_type, indices);
+                indices += level.index_count * index_size;
+            }
+        }
+        lock.lock();
+        batch.state = batch_state::staged;
+    }
+}
+
+bool chunk_streamer::select_chunks(const std::vector<uint32_t>& order, size_t wanted_count, upload_batch& batch)
+{
+    batch.chunks.clear();
+    batch.residency_updates.clear();
+    batch.vertex_copies.clear();
+    batch.index_copies.clear();
+    batch.staged_size = 0;
+    const auto batch_staging_size = staging_buffer->size / batches.size();
+    for (size_t i = 0; i < wanted_count; i++)
+    {
+        const auto c = order[i];
+        if (chunk_slots[c] != NOT_RESIDENT)
+        {
+            continue;
+        }
+
+        const auto& chunk = cache.chunks[c];
+        const auto vertex_data_size = chunk.vertex_count * vertex_size;
+        const auto index_data_size = chunk_index_counts[c] * index_size;
+        if (batch.staged_size > 0 && batch.staged_size + vertex_data_size + index_data_size > batch_staging_size)
+        {
+            break;
+        }
+
+        // a free slot or the one of the least recently wanted chunk, which isn't wanted now since there are at least
+        // as many slots as wanted chunks
+        uint32_t slot = 0;
+        for (uint32_t s = 0; s < slot_chunks.size(); s++)
+        {
+            if (slot_chunks[s] == NOT_RESIDENT)
+            {
+                slot = s;
+                break;
+            }
+            if (chunk_wanted_updates[slot_chunks[s]] < chunk_wanted_updates[slot_chunks[slot]])
+            {
+                slot = s;
+            }
+        }
+
+        // the evicted chunk stays resident until the copies that overwrite its slot are submitted
+        const auto evicted = slot_chunks[slot];
+        if (evicted != NOT_RESIDENT)
+        {
+            assert(chunk_wanted_updates[evicted] < update_count);
+            chunk_slots[evicted] = NOT_RESIDENT;
+            batch.residency_updates.emplace_back(evicted, chunk_residency{ 0, 0, 0, 0 });
+        }
+        slot_chunks[slot] = c;
+        chunk_slots[c] = slot;
+
+        const auto slot_first_vertex = slot * slot_vertex_count;
+        const auto slot_first_index = slot * slot_index_count;
+        // the indices of a chunk are relative to its first vertex, which is the first vertex of its slot
+        batch.residency_updates.emplace_back(c, chunk_residency{ slot_first_index,
+            static_cast<int32_t>(slot_first_vertex), 1, 0 });
+
+        const auto vertex_offset = batch.staging_offset + batch.staged_size;
+        batch.vertex_copies.emplace_back(vertex_offset, slot_first_vertex * vertex_size, vertex_data_size);
+        batch.staged_size += vertex_data_size;
+
+        const auto index_offset = batch.staging_offset + batch.staged_size;
+        batch.index_copies.emplace_back(index_offset, slot_first_index * index_size, index_data_size);
+        batch.staged_size += index_data_size;
+
+        batch.chunks.push_back({ c, vertex_offset, index_offset });
+    }
+    return !batch.chunks.empty();
+}
+
+void chunk_streamer::record_copies(const upload_batch& batch, vk::Buffer vertex_buffer, vk::Buffer index_buffer,
+    vk::Buffer residency_buffer)
+{
+    auto cb = batch.command_buffer.get();
+    cb.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    // frames submitted earlier may still read the evicted slots and the residency of their chunks
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags(), {}, {}, {});
+    for (const auto& [c, residency] : batch.residency_updates)
+    {
+        cb.updateBuffer(residency_buffer, c * sizeof(chunk_residency), sizeof(chunk_residency), &residency);
+    }
+    cb.copyBuffer(staging_buffer->buf.get(), vertex_buffer, batch.vertex_copies);
+    cb.copyBuffer(staging_buffer->buf.get(), index_buffer, batch.index_copies);
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eVertexInput,
+        vk::DependencyFlags(),
+        {
+            vk::MemoryBarrier()
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eIndexRead
+                | vk::AccessFlagBits::eVertexAttributeRead)
+        },
+        {}, {});
+    cb.end();
+}
+
+bool chunk_streamer::update(vk::Queue queue, const model_uniform_data& camera, vk::Buffer vertex_buffer,
+    vk::Buffer index_buffer, vk::Buffer residency_buffer)
+{
+    update_count++;
+    const auto order = prioritize_chunks(camera);
+    const auto wanted_count = std::min(order.size(), slot_chunks.size());
+    for (size_t i = 0; i < wanted_count; i++)
+    {
+        chunk_wanted_updates[order[i]] = update_count;
+    }
+
+    // Only one batch is staged at a time, so batches are submitted in the order their slots were assigned in.
+    batch_state state;
+    {
+        std::lock_guard lock(mutex);
+        state = batches[current_batch].state;
+    }
+    if (state == batch_state::staging)
+    {
+        return true;
+    }
+
+    if (state == batch_state::staged)
+    {
+        auto& batch = batches[current_batch];
+        staging_buffer->memory.flush(batch.staging_offset, batch.staged_size);
+        record_copies(batch, vertex_buffer, index_buffer, residency_buffer);
+
+        batch.timeline_value = next_timeline_value++;
+        const vk::StructureChain<vk::SubmitInfo, vk::TimelineSemaphoreSubmitInfo> submit_info{
+            vk::SubmitInfo()
+            .setCommandBufferCount(1)
+            .setPCommandBuffers(&batch.command_buffer.get())
+            .setSignalSemaphoreCount(1)
+            .setPSignalSemaphores(&timeline.get()),
+            vk::TimelineSemaphoreSubmitInfo()
+            .setSignalSemaphoreValueCount(1)
+            .setPSignalSemaphoreValues(&batch.timeline_value)
+        };
+        queue.submit({ submit_info.get<vk::SubmitInfo>() }, nullptr);
+
+        std::lock_guard lock(mutex);
+        batch.state = batch_state::idle;
+    }
+
+    // the staging memory of the next batch is reused once its previous copies are done, which is polled
+    const auto next_batch = (current_batch + 1) % batches.size();
+    auto& batch = batches[next_batch];
+    if (device.getSemaphoreCounterValue(timeline.get()) < batch.timeline_value)
+    {
+        return true;
+    }
+    if (!select_chunks(order, wanted_count, batch))
+    {
+        return state == batch_state::staged;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        current_batch = next_batch;
+        batch.state = batch_state::staging;
+    }
+    staging_requested.notify_one();
+    return true;
+}
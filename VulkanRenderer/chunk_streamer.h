@@ -0,0 +1,123 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "buffer.h"
+#include "data_types.h"
+#include "meshlet.h"
+#include "model_cache.h"
+#include "position_chunks.h"
+
+// Streams the position chunks of a cached model from disk into a fixed number of equally sized slots of the vertex and
+// index buffers, so models that don't fit into device memory can be rendered. A slot holds all levels of detail of a
+// chunk, and the cull shader finds it through the chunk's residency. Chunks are copied from the cache into staging
+// memory on a worker thread, the render thread only records and submits the copies.
+class chunk_streamer
+{
+    struct index_range
+    {
+        uint32_t first_index;
+        uint32_t index_count;
+    };
+
+    struct staged_chunk
+    {
+        uint32_t chunk;
+        // offsets of the vertices and indices of the chunk in the staging buffer
+        vk::DeviceSize vertex_offset;
+        vk::DeviceSize index_offset;
+    };
+
+    enum class batch_state
+    {
+        // the staging memory of the batch can be reused once the timeline reaches its value
+        idle,
+        // the worker thread copies the chunks of the batch into its staging memory
+        staging,
+        // the copies of the batch can be submitted
+        staged,
+    };
+
+    // The chunks uploaded by one submission, which are staged into one half of the staging buffer while the copies of
+    // the other half may still be running.
+    struct upload_batch
+    {
+        vk::DeviceSize staging_offset;
+        batch_state state;
+        std::vector<staged_chunk> chunks;
+        std::vector<std::pair<uint32_t, chunk_residency>> residency_updates;
+        std::vector<vk::BufferCopy> vertex_copies;
+        std::vector<vk::BufferCopy> index_copies;
+        vk::DeviceSize staged_size;
+        vk::UniqueCommandBuffer command_buffer;
+        // the value the timeline reaches once the copies of the batch are done
+        uint64_t timeline_value;
+    };
+
+    vk::Device device;
+    model_cache cache;
+    vk::IndexType index_type;
+    size_t vertex_size;
+    size_t index_size;
+    // the ranges of every chunk in the index buffer of the cache, one per level of detail
+    std::vector<index_range> chunk_levels;
+    std::vector<uint32_t> chunk_index_counts;
+    std::vector<uint32_t> chunk_slots;
+    // number of the last update that wanted the chunk resident, the least recently wanted chunk is evicted first
+    std::vector<uint64_t> chunk_wanted_updates;
+    std::vector<uint32_t> slot_chunks;
+    uint32_t slot_vertex_count;
+    uint32_t slot_index_count;
+    uint64_t update_count;
+    std::unique_ptr<buffer> staging_buffer;
+    uint8_t* staging_ptr;
+    vk::UniqueCommandPool command_pool;
+    vk::UniqueSemaphore timeline;
+    uint64_t next_timeline_value;
+    std::array<upload_batch, 2> batches;
+    // the batch that was handed to the worker thread last
+    size_t current_batch;
+    // guards the state of the batches and is_stopping, which the worker thread waits for
+    std::mutex mutex;
+    std::condition_variable staging_requested;
+    bool is_stopping;
+    std::thread worker;
+
+    std::vector<uint32_t> prioritize_chunks(const model_uniform_data& camera) const;
+    // Assigns slots to the most wanted chunks that aren't resident, as many as fit into the staging memory of the
+    // batch. Returns false if there are none.
+    bool select_chunks(const std::vector<uint32_t>& order, size_t wanted_count, upload_batch& batch);
+    void record_copies(const upload_batch& batch, vk::Buffer vertex_buffer, vk::Buffer index_buffer,
+        vk::Buffer residency_buffer);
+    // runs on the worker thread
+    void stage_batches();
+
+public:
+    // meshlets whose first index is relative to the slot of their chunk
+    std::vector<meshlet> meshlets;
+
+    chunk_streamer(vk::Device device, memory_allocator& allocator, model_cache cache, vk::IndexType index_type,
+        size_t residency_budget, size_t upload_budget);
+    chunk_streamer(const chunk_streamer&) = delete;
+    chunk_streamer& operator=(const chunk_streamer&) = delete;
+    ~chunk_streamer();
+
+    std::span<const position_chunk> get_chunks() const;
+    const std::vector<lod_level>& get_lods() const;
+    size_t get_slot_count() const;
+    vk::DeviceSize get_vertex_buffer_size() const;
+    vk::DeviceSize get_index_buffer_size() const;
+
+    // Makes the chunks that are visible and closest to the camera resident, evicting the least recently wanted ones.
+    // Submits the copies of the chunks the worker thread has staged since the last update, and hands it the next ones
+    // as long as they fit into the upload budget, so the chunks become resident a few updates after they are wanted.
+    // Never waits for the device or the disk. Commands submitted before wait for the copies to start and commands
+    // submitted after see their results. Returns false if there was nothing left to upload.
+    bool update(vk::Queue queue, const model_uniform_data& camera, vk::Buffer vertex_buffer, vk::Buffer index_buffer,
+        vk::Buffer residency_buffer);
+};
@@ -2,19 +2,53 @@
 #include <glm/fwd.hpp>
 #include <imgui.h>
 
-struct vertex
-{
-    glm::i16vec3 position;
-    glm::i16vec3 normal;
-    glm::u8vec3 color;
-};
-
 struct model_uniform_data
 {
     glm::mat4 projection;
     glm::mat4 model_view;
 };
 
+#define MAX_LOD_COUNT 8 // must be kept in sync with shader
+
+struct cull_push_constants
+{
+    float lod_errors[MAX_LOD_COUNT];
+    // meshlet range of every level of detail
+    uint32_t first_meshlets[MAX_LOD_COUNT];
+    uint32_t meshlet_counts[MAX_LOD_COUNT];
+    uint32_t lod_count;
+    float viewport_height;
+    // append the visible draws through the draw count instead of writing one draw per meshlet
+    uint32_t compact_draws;
+};
+
+struct scene_cull_push_constants
+{
+    float lod_errors[MAX_LOD_COUNT];
+    uint32_t lod_count;
+    float viewport_height;
+    uint32_t first_instance;
+    uint32_t instance_count;
+};
+
+struct scene_push_constants
+{
+    uint32_t instance_count;
+};
+
+struct splat_push_constants
+{
+    uint64_t points;
+    uint32_t point_count;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct splat_resolve_push_constants
+{
+    uint32_t width;
+};
+
 #define MAX_UI_DRAW_COUNT 64 // must be kept in sync with shader
 
 struct ui_uniform_data
@@ -0,0 +1,331 @@
+#include "stdafx.h"
+#include "decompressed_file.h"
+#include "parallel.h"
+
+#include <zlib.h>
+#include <zstd.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// address space reserved for files whose decompressed size isn't known up front
+static const size_t MAX_DECOMPRESSED_SIZE = size_t(1) << 40;
+static const size_t COMMIT_GRANULARITY = size_t(64) << 20;
+// bytes decompressed before they are made available to the parser
+static const size_t OUTPUT_BLOCK_SIZE = size_t(1) << 20;
+
+compression get_compression(const std::string& path)
+{
+    if (path.ends_with(".gz"))
+    {
+        return compression::gzip;
+    }
+    if (path.ends_with(".zst"))
+    {
+        return compression::zstd;
+    }
+    return compression::none;
+}
+
+decompressed_file::decompressed_file(const std::string& path, compression type)
+    : compressed(path)
+    , ptr(nullptr)
+    , capacity(0)
+    , committed(0)
+    , available(0)
+    , is_finished(false)
+    , is_cancelled(false)
+    , wait_time(0)
+    , decompression_time(0.)
+{
+    assert(type != compression::none);
+    thread = std::thread([this, type]
+        {
+            const auto start = std::chrono::steady_clock::now();
+            try
+            {
+                type == compression::gzip ? decompress_gzip() : decompress_zstd();
+            }
+            catch (const std::exception& e)
+            {
+                finish(e.what());
+                return;
+            }
+            decompression_time =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            finish(is_cancelled ? "Decompression was cancelled" : "");
+        });
+}
+
+decompressed_file::~decompressed_file()
+{
+    is_cancelled = true;
+    thread.join();
+    if (ptr)
+    {
+#ifdef _WIN32
+        VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+        munmap(ptr, capacity);
+#endif
+    }
+}
+
+void decompressed_file::reserve(size_t size)
+{
+    capacity = std::max(size, size_t(1));
+#ifdef _WIN32
+    ptr = static_cast<uint8_t*>(VirtualAlloc(nullptr, capacity, MEM_RESERVE, PAGE_NOACCESS));
+#else
+    auto* mapping = mmap(nullptr, capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    ptr = mapping == MAP_FAILED ? nullptr : static_cast<uint8_t*>(mapping);
+#endif
+    if (!ptr)
+    {
+        throw std::runtime_error("Failed to reserve memory for decompression");
+    }
+}
+
+void decompressed_file::commit(size_t size)
+{
+    if (size <= committed)
+    {
+        return;
+    }
+
+    const auto new_committed = std::min(capacity,
+        (size + COMMIT_GRANULARITY - 1) / COMMIT_GRANULARITY * COMMIT_GRANULARITY);
+#ifdef _WIN32
+    const auto is_committed = VirtualAlloc(ptr + committed, new_committed - committed, MEM_COMMIT, PAGE_READWRITE);
+#else
+    const auto is_committed = mprotect(ptr + committed, new_committed - committed, PROT_READ | PROT_WRITE) == 0;
+#endif
+    if (!is_committed)
+    {
+        throw std::runtime_error("Failed to commit memory for decompression");
+    }
+    committed = new_committed;
+}
+
+void decompressed_file::publish(size_t size)
+{
+    {
+        std::lock_guard lock(mutex);
+        available = size;
+    }
+    available_changed.notify_all();
+}
+
+void decompressed_file::finish(const std::string& error)
+{
+    {
+        std::lock_guard lock(mutex);
+        this->error = error;
+        is_finished = true;
+    }
+    available_changed.notify_all();
+}
+
+// Returns the bytes to decompress into next, which must not exceed the size of a file whose size is known.
+static size_t get_output_block_size(size_t size, size_t capacity)
+{
+    const auto block_size = std::min(OUTPUT_BLOCK_SIZE, capacity - size);
+    if (block_size == 0)
+    {
+        throw std::runtime_error("Compressed file is larger than its header states");
+    }
+    return block_size;
+}
+
+void decompressed_file::decompress_gzip()
+{
+    reserve(MAX_DECOMPRESSED_SIZE);
+    const auto input = compressed.data();
+    size_t input_offset = 0;
+    size_t size = 0;
+
+    z_stream stream{};
+    // adding 32 to the window bits detects the gzip header
+    if (inflateInit2(&stream, 15 + 32) != Z_OK)
+    {
+        throw std::runtime_error("Failed to initialize zlib");
+    }
+    std::unique_ptr<z_stream, decltype(&inflateEnd)> stream_guard(&stream, inflateEnd);
+
+    while (!is_cancelled)
+    {
+        if (stream.avail_in == 0)
+        {
+            // zlib counts input bytes in 32 bits
+            const auto input_size = std::min(input.size() - input_offset, size_t(1) << 30);
+            stream.next_in = const_cast<Bytef*>(input.data() + input_offset);
+            stream.avail_in = static_cast<uInt>(input_size);
+            input_offset += input_size;
+        }
+
+        const auto block_size = get_output_block_size(size, capacity);
+        commit(size + block_size);
+        stream.next_out = ptr + size;
+        stream.avail_out = static_cast<uInt>(block_size);
+        const auto result = inflate(&stream, Z_NO_FLUSH);
+        size += block_size - stream.avail_out;
+        publish(size);
+
+        const auto is_input_consumed = stream.avail_in == 0 && input_offset == input.size();
+        if (result == Z_STREAM_END)
+        {
+            if (is_input_consumed)
+            {
+                break;
+            }
+            // parallel compressors write concatenated gzip members
+            inflateReset(&stream);
+        }
+        else if (result == Z_BUF_ERROR && is_input_consumed)
+        {
+            throw std::runtime_error("gzip file is truncated");
+        }
+        else if (result != Z_OK && result != Z_BUF_ERROR)
+        {
+            throw std::runtime_error(std::string("Failed to decompress gzip file: ") + (stream.msg ? stream.msg : ""));
+        }
+    }
+}
+
+struct zstd_frame
+{
+    size_t input_offset;
+    size_t input_size;
+    size_t output_offset;
+    size_t output_size;
+};
+
+void decompressed_file::decompress_zstd()
+{
+    const auto input = compressed.data();
+
+    // the compressor writes the decompressed size of each frame unless it streamed its input
+    std::vector<zstd_frame> frames;
+    size_t input_offset = 0, output_size = 0;
+    auto are_sizes_known = true;
+    while (input_offset < input.size())
+    {
+        const auto* frame = input.data() + input_offset;
+        const auto frame_size = ZSTD_findFrameCompressedSize(frame, input.size() - input_offset);
+        if (ZSTD_isError(frame_size))
+        {
+            throw std::runtime_error(std::string("Invalid zstd file: ") + ZSTD_getErrorName(frame_size));
+        }
+        const auto content_size = ZSTD_getFrameContentSize(frame, frame_size);
+        are_sizes_known &= content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR;
+        const auto frame_output_size = are_sizes_known ? static_cast<size_t>(content_size) : 0;
+        frames.push_back({ input_offset, frame_size, output_size, frame_output_size });
+        input_offset += frame_size;
+        output_size += frame_output_size;
+    }
+
+    if (are_sizes_known && frames.size() > 1)
+    {
+        reserve(output_size);
+        commit(output_size);
+
+        // the frames are handed out about in order, so the decompressed prefix grows while later ones are running
+        std::mutex progress_mutex;
+        std::vector<uint8_t> is_frame_done(frames.size(), 0);
+        size_t done_frame_count = 0;
+        std::string frame_error;
+        parallel_for(frames.size(), 1, [&](size_t first, size_t last)
+            {
+                std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+                for (auto i = first; i < last && !is_cancelled; i++)
+                {
+                    const auto& frame = frames[i];
+                    const auto result = ZSTD_decompressDCtx(context.get(), ptr + frame.output_offset,
+                        frame.output_size, input.data() + frame.input_offset, frame.input_size);
+
+                    std::lock_guard lock(progress_mutex);
+                    if (ZSTD_isError(result) || result != frame.output_size)
+                    {
+                        frame_error = ZSTD_isError(result) ? ZSTD_getErrorName(result)
+                            : "Frame is smaller than its header states";
+                        is_cancelled = true;
+                        return;
+                    }
+                    is_frame_done[i] = 1;
+                    while (done_frame_count < frames.size() && is_frame_done[done_frame_count])
+                    {
+                        done_frame_count++;
+                    }
+                    publish(done_frame_count < frames.size() ? frames[done_frame_count].output_offset : output_size);
+                }
+            });
+
+        if (!frame_error.empty())
+        {
+            throw std::runtime_error("Failed to decompress zstd file: " + frame_error);
+        }
+        return;
+    }
+
+    reserve(are_sizes_known ? output_size : MAX_DECOMPRESSED_SIZE);
+    std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> stream(ZSTD_createDStream(), ZSTD_freeDStream);
+    ZSTD_inBuffer input_buffer{ input.data(), input.size(), 0 };
+    size_t size = 0;
+    // nonzero while a frame is incomplete or its output isn't flushed
+    size_t remaining = 1;
+    while (!is_cancelled && (input_buffer.pos < input_buffer.size || remaining != 0))
+    {
+        const auto block_size = get_output_block_size(size, capacity);
+        commit(size + block_size);
+        ZSTD_outBuffer output_buffer{ ptr + size, block_size, 0 };
+        const auto input_position = input_buffer.pos;
+        remaining = ZSTD_decompressStream(stream.get(), &output_buffer, &input_buffer);
+        if (ZSTD_isError(remaining))
+        {
+            throw std::runtime_error(std::string("Failed to decompress zstd file: ") + ZSTD_getErrorName(remaining));
+        }
+        if (output_buffer.pos == 0 && input_buffer.pos == input_position)
+        {
+            throw std::runtime_error("zstd file is truncated");
+        }
+        size += output_buffer.pos;
+        publish(size);
+    }
+}
+
+std::span<const uint8_t> decompressed_file::wait_for(size_t size) const
+{
+    std::unique_lock lock(mutex);
+    if (available < size && !is_finished)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        available_changed.wait(lock, [&] { return available >= size || is_finished; });
+        wait_time += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+    return std::span<const uint8_t>(ptr, available);
+}
+
+size_t decompressed_file::get_compressed_size() const
+{
+    return compressed.data().size();
+}
+
+double decompressed_file::get_decompression_time() const
+{
+    return decompression_time;
+}
+
+double decompressed_file::get_wait_time() const
+{
+    return wait_time / 1000.;
+}
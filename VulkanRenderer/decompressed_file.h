@@ -0,0 +1,58 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "mapped_file.h"
+
+enum class compression
+{
+    none,
+    gzip,
+    zstd,
+};
+
+// Picks the compression from the extension of the path, .gz or .zst.
+compression get_compression(const std::string& path);
+
+// Decompresses a gzip or zstd file on a background thread. The bytes are written to reserved address space that is
+// committed as it fills, so they stay in place and can be parsed while the rest of the file is decompressed. zstd files
+// with multiple frames whose sizes are known are decompressed a frame per task in parallel.
+class decompressed_file : public file_source
+{
+    mapped_file compressed;
+    uint8_t* ptr;
+    size_t capacity;
+    size_t committed;
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable available_changed;
+    size_t available;
+    bool is_finished;
+    std::string error;
+    std::atomic<bool> is_cancelled;
+    // time parsing spent waiting for bytes, in microseconds
+    mutable std::atomic<int64_t> wait_time;
+    double decompression_time;
+
+    std::thread thread;
+
+    void reserve(size_t size);
+    void commit(size_t size);
+    void publish(size_t size);
+    void finish(const std::string& error);
+    void decompress_gzip();
+    void decompress_zstd();
+
+public:
+    decompressed_file(const std::string& path, compression type);
+    decompressed_file(const decompressed_file&) = delete;
+    decompressed_file& operator=(const decompressed_file&) = delete;
+    ~decompressed_file();
+
+    std::span<const uint8_t> wait_for(size_t size) const override;
+
+    size_t get_compressed_size() const;
+    // Both in milliseconds and only valid once the whole file is available.
+    double get_decompression_time() const;
+    double get_wait_time() const;
+};
@@ -41,22 +41,24 @@ static void record_command_buffer(
 }
 
 frame::frame(
-    vk::PhysicalDevice physical_device,
     vk::Device device,
+    memory_allocator& allocator,
     vk::CommandPool command_pool,
     vk::Extent2D framebuffer_size,
     vk::Image image,
     vk::Format format,
     vk::RenderPass render_pass,
     std::vector<std::unique_ptr<renderer>> renderers)
-    : device(device), dsb(device, std::make_unique<image_with_memory>(physical_device, device, framebuffer_size.width, framebuffer_size.height,
+    : device(device), dsb(device, std::make_unique<image_with_memory>(device, allocator, framebuffer_size.width,
+        framebuffer_size.height,
         vk::Format::eD24UnormS8Uint,
         vk::ImageUsageFlagBits::eDepthStencilAttachment,
         vk::ImageTiling::eOptimal,
         vk::ImageLayout::eUndefined,
         vk::MemoryPropertyFlagBits::eDeviceLocal,
         vk::ImageAspectFlagBits::eDepth |
-        vk::ImageAspectFlagBits::eStencil))
+        vk::ImageAspectFlagBits::eStencil,
+        memory_category::attachment))
     , renderers(std::move(renderers))
 {
     this->image = image;
@@ -29,11 +29,15 @@ static frame_set create_frame_set(
     {
         std::vector<std::unique_ptr<renderer>> renderers;
 
-        renderers.emplace_back(create_model_renderer());
+        // there is no model renderer while the first model is still loading
+        if (auto* created_renderer = create_model_renderer())
+        {
+            renderers.emplace_back(created_renderer);
+        }
 
         renderers.emplace_back(new ui_renderer(
-            context.physical_device,
             context.device,
+            context.allocator,
             context.descriptor_pool.get(),
             framebuffer_size,
             ui_pipeline,
@@ -41,8 +45,8 @@ static frame_set create_frame_set(
         ));
 
         frames.emplace_back(new frame(
-            context.physical_device,
             context.device,
+            context.allocator,
             context.command_pool.get(),
             framebuffer_size,
             image,
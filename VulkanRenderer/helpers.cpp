@@ -6,6 +6,9 @@
 #include "image_with_view.h"
 #include "frame.h"
 #include "model_renderer.h"
+#include "point_cloud_renderer.h"
+#include "scene_renderer.h"
+#include "vulkan_context.h"
 
 vk::UniqueRenderPass create_render_pass(vk::Device device, vk::Format color_format, vk::ImageLayout final_layout)
 {
@@ -56,6 +59,7 @@ vk::UniqueDescriptorPool create_descriptor_pool(vk::Device device)
     std::array sizes{
         vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, max_count_per_type),
         vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, max_count_per_type),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, max_count_per_type),
     };
     return device.createDescriptorPoolUnique(
         vk::DescriptorPoolCreateInfo()
@@ -64,25 +68,48 @@ vk::UniqueDescriptorPool create_descriptor_pool(vk::Device device)
     );
 }
 
+std::string show_open_model_dialog()
+{
+    const std::array<const char*, 3> patterns{ "*.ply", "*.ply.gz", "*.ply.zst" };
+    const auto* path = tinyfd_openFileDialog("Open 3D model", nullptr, static_cast<int>(patterns.size()),
+        patterns.data(), nullptr, 0);
+    return path ? path : "";
+}
+
 void render_to_image(
     vk::PhysicalDevice physical_device,
     vk::Device device,
+    memory_allocator& allocator,
     const std::string& model_path,
+    const scene_description* scene,
+    const model_load_options& load_options,
     const std::string& image_path,
     const glm::vec3& camera_position,
     const glm::vec3& camera_up
 )
 {
-    auto queue = device.getQueue(0, 0);
+    const auto queues = get_device_queues(physical_device, device);
+    const auto queue = queues.graphics.queue;
     auto command_pool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo());
-    auto model = read_model(physical_device, device, command_pool.get(), queue, model_path);
+    std::optional<::scene> scn;
+    std::optional<::model> model;
+    if (scene)
+    {
+        scn.emplace(read_scene(device, allocator, queues, *scene, load_options));
+    }
+    else
+    {
+        model.emplace(read_model(device, allocator, queues, model_path, load_options));
+    }
+    const auto layout = model ? model->layout : scn->meshes.front().layout;
     auto render_pass = create_render_pass(device, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eTransferSrcOptimal);
-    auto pipeline = create_model_pipeline(device, render_pass.get());
+    auto pipeline = create_model_pipeline(device, render_pass.get(), layout);
+    auto cull_pipeline = create_cull_pipeline(device);
     auto descriptor_pool = create_descriptor_pool(device);
 
     auto device_image = image_with_memory(
-        physical_device,
         device,
+        allocator,
         1024,
         768,
         vk::Format::eR8G8B8A8Unorm,
@@ -90,13 +117,43 @@ void render_to_image(
         vk::ImageTiling::eOptimal,
         vk::ImageLayout::eUndefined,
         vk::MemoryPropertyFlagBits::eDeviceLocal,
-        vk::ImageAspectFlagBits::eColor
+        vk::ImageAspectFlagBits::eColor,
+        memory_category::attachment
     );
 
+    std::unique_ptr<::pipeline> splat_pipeline;
+    std::unique_ptr<::pipeline> splat_resolve_pipeline;
+    std::unique_ptr<::pipeline> scene_pipeline;
+    std::unique_ptr<::pipeline> scene_cull_pipeline;
+    std::unique_ptr<::pipeline> scene_draws_pipeline;
     std::vector<std::unique_ptr<renderer>> renderers;
-    renderers.emplace_back(new model_renderer(physical_device, device, descriptor_pool.get(), vk::Extent2D(device_image.width, device_image.height), &pipeline, &model));
-
-    frame frame(physical_device, device, command_pool.get(), vk::Extent2D(device_image.width, device_image.height), device_image.image.get(),
+    if (scn)
+    {
+        scene_pipeline.reset(new ::pipeline(create_scene_pipeline(device, render_pass.get(), layout)));
+        scene_cull_pipeline.reset(new ::pipeline(create_scene_cull_pipeline(device)));
+        scene_draws_pipeline.reset(new ::pipeline(create_scene_draws_pipeline(device)));
+        renderers.emplace_back(new scene_renderer(physical_device, device, allocator,
+            vk::Extent2D(device_image.width, device_image.height), scene_pipeline.get(), scene_cull_pipeline.get(),
+            scene_draws_pipeline.get(), &*scn));
+    }
+    else if (model->is_point_cloud())
+    {
+        if (!is_point_splatting_supported(physical_device))
+        {
+            throw std::runtime_error("Point clouds require 64-bit atomics, which the device doesn't support");
+        }
+        splat_pipeline.reset(new ::pipeline(create_splat_pipeline(device)));
+        splat_resolve_pipeline.reset(new ::pipeline(create_splat_resolve_pipeline(device, render_pass.get())));
+        renderers.emplace_back(new point_cloud_renderer(device, allocator, descriptor_pool.get(),
+            vk::Extent2D(device_image.width, device_image.height), splat_pipeline.get(),
+            splat_resolve_pipeline.get(), &*model));
+    }
+    else
+    {
+        renderers.emplace_back(new model_renderer(physical_device, device, allocator, descriptor_pool.get(), vk::Extent2D(device_image.width, device_image.height), &pipeline, &cull_pipeline, &*model));
+    }
+
+    frame frame(device, allocator, command_pool.get(), vk::Extent2D(device_image.width, device_image.height), device_image.image.get(),
         vk::Format::eR8G8B8A8Unorm, render_pass.get(),
         std::move(renderers));
 
@@ -105,6 +162,10 @@ void render_to_image(
         .001f, 100.f);
     data.model_view = lookAt(camera_position, glm::vec3(0.f, 0.f, 0.f), camera_up);
     frame.update(data);
+    // streams until the chunks the camera needs most are resident
+    while (model && model->update_residency(queue, data))
+    {
+    }
 
     device.resetFences({ frame.rendered_fence.get() });
     queue.submit({
@@ -114,12 +175,13 @@ void render_to_image(
         }, frame.rendered_fence.get());
     device.waitForFences({ frame.rendered_fence.get() }, true, UINT64_MAX);
 
-    auto host_image = device_image.copy_from_device_to_host(physical_device, device, command_pool.get(), queue);
+    auto host_image = device_image.copy_from_device_to_host(device, allocator, command_pool.get(), queue);
     queue.waitIdle();
 
-    auto* ptr = static_cast<uint8_t*>(device.mapMemory(host_image->memory.get(), 0,
-        4 * host_image->width * host_image->height));
+    auto* ptr = static_cast<uint8_t*>(host_image->memory.ptr);
     // TODO fix channels
     lodepng::encode(image_path, ptr, host_image->width, host_image->height);
-    device.unmapMemory(host_image->memory.get());
+
+    allocator.print_statistics();
+    allocator.print_report();
 }
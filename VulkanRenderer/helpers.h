@@ -2,14 +2,23 @@
 
 #include <vector>
 #include <vulkan/vulkan.hpp>
+#include "model.h"
+#include "scene.h"
 
 vk::UniqueRenderPass create_render_pass(vk::Device device, vk::Format color_format, vk::ImageLayout final_layout);
 vk::UniqueDescriptorPool create_descriptor_pool(vk::Device device);
 
+// Returns an empty path if the dialog was cancelled.
+std::string show_open_model_dialog();
+
+// Renders the scene instead of the model at model_path if it isn't null.
 void render_to_image(
     vk::PhysicalDevice physical_device,
     vk::Device device,
+    memory_allocator& allocator,
     const std::string& model_path,
+    const scene_description* scene,
+    const model_load_options& load_options,
     const std::string& image_path,
     const glm::vec3& camera_position,
     const glm::vec3& camera_up
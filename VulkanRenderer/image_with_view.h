@@ -1,18 +1,19 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
+#include "memory_allocator.h"
 
 struct image_with_memory
 {
     uint32_t width;
     uint32_t height;
     vk::Format format;
-    vk::UniqueDeviceMemory memory;
+    memory_allocation memory;
     vk::UniqueImage image;
     vk::ImageSubresourceRange sub_resource_range;
 
     image_with_memory(
-        vk::PhysicalDevice physical_device,
         vk::Device device,
+        memory_allocator& allocator,
         uint32_t width,
         uint32_t height,
         vk::Format format,
@@ -20,11 +21,10 @@ struct image_with_memory
         vk::ImageTiling image_tiling,
         vk::ImageLayout initial_layout,
         vk::MemoryPropertyFlags memory_flags,
-        vk::ImageAspectFlags aspect_flags
+        vk::ImageAspectFlags aspect_flags,
+        memory_category category
     );
-    std::unique_ptr<image_with_memory> copy_from_host_to_device_for_shader_read(
-        vk::PhysicalDevice physical_device, vk::Device device, vk::CommandPool command_pool, vk::Queue queue) const;
-    std::unique_ptr<image_with_memory> copy_from_device_to_host(vk::PhysicalDevice physical_device, vk::Device device,
+    std::unique_ptr<image_with_memory> copy_from_device_to_host(vk::Device device, memory_allocator& allocator,
         vk::CommandPool command_pool, vk::Queue queue) const;
 };
 
@@ -35,11 +35,3 @@ struct image_with_view
 
     image_with_view(vk::Device device, std::unique_ptr<image_with_memory> iwm);
 };
-
-std::unique_ptr<image_with_memory> load_r8g8b8a8_unorm_texture(
-    vk::PhysicalDevice physical_device,
-    vk::Device device,
-    uint32_t width,
-    uint32_t height,
-    const void* data
-);
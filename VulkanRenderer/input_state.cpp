@@ -156,5 +156,4 @@ void input_state::update()
 
     ImGui::NewFrame();
     ImGui::Checkbox("Enable ray tracing", &enable_ray_tracing);
-    ImGui::Render();
 }
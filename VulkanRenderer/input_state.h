@@ -16,5 +16,6 @@ struct input_state
     int height;
 
     input_state(GLFWwindow* window);
+    // Polls events and starts an ImGui frame, which the caller ends with ImGui::Render().
     void update();
 };
@@ -1,6 +1,12 @@
 #include "stdafx.h"
 #include "helpers.h"
+#include "memory_allocator.h"
+#include "model.h"
+#include "ply_conversion.h"
+#include "position_chunks.h"
 #include "render_to_window.h"
+#include "scene.h"
+#include "vertex_packing.h"
 #include "vulkan_context.h"
 
 static VkBool32 debug_report_callback(
@@ -78,12 +84,21 @@ static vk::PhysicalDevice get_physical_device(vk::Instance vulkan)
 
 static vk::UniqueDevice create_device(vk::PhysicalDevice physical_device)
 {
-    auto props = physical_device.getQueueFamilyProperties();
-    assert((props[0].queueFlags & vk::QueueFlagBits::eGraphics) == vk::QueueFlagBits::eGraphics);
+    const auto families = find_queue_families(physical_device);
+    std::cout << "Using queue families " << families.graphics << " for graphics, " << families.transfer
+        << " for transfers and " << families.compute << " for compute" << std::endl;
 
     std::array priorities{ 0.f };
-    auto queueInfo = vk::DeviceQueueCreateInfo()
-        .setQueuePriorities(priorities);
+    std::vector<vk::DeviceQueueCreateInfo> queue_infos;
+    for (const auto family : { families.graphics, families.transfer, families.compute })
+    {
+        if (std::ranges::none_of(queue_infos, [&](const auto& info) { return info.queueFamilyIndex == family; }))
+        {
+            queue_infos.push_back(vk::DeviceQueueCreateInfo()
+                .setQueueFamilyIndex(family)
+                .setQueuePriorities(priorities));
+        }
+    }
 
     std::vector extensionNames{
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
@@ -97,12 +112,24 @@ static vk::UniqueDevice create_device(vk::PhysicalDevice physical_device)
         extensionNames.emplace_back(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
     }
 
+    if (is_memory_budget_supported(physical_device))
+    {
+        extensionNames.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    if (is_draw_indirect_count_supported(physical_device))
+    {
+        extensionNames.emplace_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+
+    const auto point_splatting = is_point_splatting_supported(physical_device);
     auto features = vk::PhysicalDeviceFeatures()
         .setMultiDrawIndirect(true)
         .setDrawIndirectFirstInstance(true)
         .setShaderClipDistance(true)
         .setShaderCullDistance(true)
-        .setShaderInt16(true);
+        .setShaderInt16(true)
+        .setShaderInt64(point_splatting);
 
     vk::StructureChain<
         vk::DeviceCreateInfo,
@@ -110,11 +137,13 @@ static vk::UniqueDevice create_device(vk::PhysicalDevice physical_device)
         vk::PhysicalDevice16BitStorageFeatures,
         vk::PhysicalDeviceFloat16Int8FeaturesKHR,
         vk::PhysicalDeviceBufferDeviceAddressFeatures,
+        vk::PhysicalDeviceShaderAtomicInt64Features,
+        vk::PhysicalDeviceShaderDrawParametersFeatures,
+        vk::PhysicalDeviceTimelineSemaphoreFeatures,
         vk::PhysicalDeviceAccelerationStructureFeaturesKHR,
         vk::PhysicalDeviceRayTracingPipelineFeaturesKHR> device_create_info{
             vk::DeviceCreateInfo()
-            .setQueueCreateInfoCount(1)
-            .setPQueueCreateInfos(&queueInfo)
+            .setQueueCreateInfos(queue_infos)
             .setPEnabledExtensionNames(extensionNames)
             .setPEnabledFeatures(&features),
             vk::PhysicalDevice8BitStorageFeatures()
@@ -125,6 +154,12 @@ static vk::UniqueDevice create_device(vk::PhysicalDevice physical_device)
             .setShaderInt8(true),
             vk::PhysicalDeviceBufferDeviceAddressFeatures()
             .setBufferDeviceAddress(true),
+            vk::PhysicalDeviceShaderAtomicInt64Features()
+            .setShaderBufferInt64Atomics(point_splatting),
+            vk::PhysicalDeviceShaderDrawParametersFeatures()
+            .setShaderDrawParameters(is_scene_rendering_supported(physical_device)),
+            vk::PhysicalDeviceTimelineSemaphoreFeatures()
+            .setTimelineSemaphore(true),
             vk::PhysicalDeviceAccelerationStructureFeaturesKHR()
             .setAccelerationStructure(true),
              vk::PhysicalDeviceRayTracingPipelineFeaturesKHR()
@@ -155,6 +190,33 @@ int main(int argc, char** argv)
                 cxxopts::value<std::vector<float>>(), "x y z")
             ("camera_up", "When using --image, specifies the camera up vector.", cxxopts::value<std::vector<float>>(),
                 "x y z")
+            ("optimize_mesh", "Reorder triangles and vertices for the vertex cache and overdraw when loading the model.")
+            ("cull_backfaces", "Cull clusters of triangles that face away from the camera. Only use this for closed "
+                "meshes, back faces are visible through holes in open ones.")
+            ("generate_lods", "Generate simplified levels of detail and draw the coarsest one whose error is at most "
+                "one pixel on screen.")
+            ("compact_vertices", "Store vertices with octahedral normals and 4-byte aligned attributes.")
+            ("chunk_positions", "Quantize positions relative to spatial chunks of the model for more precision.")
+            ("position_format", "Format of vertex positions: snorm16, float32 for more precision or half for less "
+                "bandwidth.", cxxopts::value<std::string>()->default_value("snorm16"), "format")
+            ("residency_budget", "Stream position chunks from the model cache into this much vertex and index memory, "
+                "for models that don't fit into device memory. Implies --chunk_positions.", cxxopts::value<size_t>(),
+                "MB")
+            ("upload_budget", "When using --residency_budget, the most memory uploaded per frame.",
+                cxxopts::value<size_t>()->default_value("16"), "MB")
+            ("decimate_points", "Thin point clouds to about this many points per cell of a 256^3 grid over the model, "
+                "so dense regions of scans are reduced while sparse ones are kept.", cxxopts::value<uint32_t>(),
+                "count")
+            ("scene", "Scene file to render instead of a single model, with a line per instance: the path of a PLY "
+                "model followed by its position x y z and optionally a scale and a rotation about y in degrees.",
+                cxxopts::value<std::string>(), "path")
+            ("stress_instances", "Render this many copies of the model on a grid, drawn and ray traced as instances "
+                "of the same mesh.", cxxopts::value<uint32_t>(), "count")
+            ("benchmark_conversions", "Measure the conversions of PLY properties to vertex attributes and exit.")
+            ("benchmark_normals", "Measure the generation of vertex normals for meshes without them and exit.")
+            ("test_vertex_packing", "Check that the vectorized vertex packing matches the scalar one and exit.")
+            ("test_position_chunks", "Check that vertices shared by position chunks dequantize to the same position in "
+                "all of them and exit.")
             ("help", "Show help");
 
         cxxopts::ParseResult result = options.parse(argc, argv);
@@ -165,22 +227,71 @@ int main(int argc, char** argv)
             return EXIT_SUCCESS;
         }
 
+        if (result["benchmark_conversions"].count() > 0)
+        {
+            benchmark_ply_conversions();
+            return EXIT_SUCCESS;
+        }
+
+        if (result["benchmark_normals"].count() > 0)
+        {
+            benchmark_normal_generation();
+            return EXIT_SUCCESS;
+        }
+
+        if (result["test_vertex_packing"].count() > 0)
+        {
+            return test_vertex_packing() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (result["test_position_chunks"].count() > 0)
+        {
+            return test_position_chunks() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
         std::string model_path;
+        std::optional<scene_description> scene;
         auto model_path_option = result["model"];
 
-        if (model_path_option.count() == 1)
+        if (result["scene"].count() > 0)
+        {
+            scene = read_scene_description(result["scene"].as<std::string>());
+        }
+        else if (model_path_option.count() == 1)
         {
             model_path = model_path_option.as<std::string>();
         }
         else
         {
-            const auto* pattern = "*.ply";
-            auto* model_path_ptr = tinyfd_openFileDialog("Open 3D model", nullptr, 1, &pattern, nullptr, 0);
-            if (!model_path_ptr)
+            model_path = show_open_model_dialog();
+            if (model_path.empty())
             {
                 return EXIT_FAILURE;
             }
-            model_path = model_path_ptr;
+        }
+
+        if (!scene && result["stress_instances"].count() > 0)
+        {
+            scene = create_stress_scene_description(model_path,
+                std::max(result["stress_instances"].as<uint32_t>(), 1u));
+        }
+
+        model_load_options load_options{};
+        load_options.optimize_mesh = result["optimize_mesh"].count() > 0;
+        load_options.cull_backfaces = result["cull_backfaces"].count() > 0;
+        load_options.generate_lods = result["generate_lods"].count() > 0;
+        load_options.compact_vertices = result["compact_vertices"].count() > 0;
+        load_options.chunk_positions = result["chunk_positions"].count() > 0;
+        load_options.vertex_positions = parse_position_format(result["position_format"].as<std::string>());
+        if (result["residency_budget"].count() > 0)
+        {
+            load_options.residency_budget = result["residency_budget"].as<size_t>() * 1024 * 1024;
+            load_options.upload_budget = result["upload_budget"].as<size_t>() * 1024 * 1024;
+            load_options.chunk_positions = true;
+        }
+        if (result["decimate_points"].count() > 0)
+        {
+            load_options.max_points_per_cell = result["decimate_points"].as<uint32_t>();
         }
 
         vk::DynamicLoader dl;
@@ -194,6 +305,13 @@ int main(int argc, char** argv)
 
         auto device = create_device(physical_device);
         VULKAN_HPP_DEFAULT_DISPATCHER.init(device.get());
+        // destroyed before the device, after all buffers and images
+        memory_allocator allocator(physical_device, device.get());
+
+        if (scene && !is_scene_rendering_supported(physical_device))
+        {
+            throw std::runtime_error("Scenes require shader draw parameters, which the device doesn't support");
+        }
 
         auto image_path_option = result["image"];
         if (image_path_option.count() == 1)
@@ -209,13 +327,14 @@ int main(int argc, char** argv)
                 : glm::vec3(0.f, -1.f, 0.f);
 
             std::cout << "Rendering to image..." << std::endl;
-            render_to_image(physical_device, device.get(), model_path, image_path_option.as<std::string>(),
-                camera_position, camera_up);
+            render_to_image(physical_device, device.get(), allocator, model_path, scene ? &*scene : nullptr, load_options,
+                image_path_option.as<std::string>(), camera_position, camera_up);
         }
         else
         {
             std::cout << "Rendering to window..." << std::endl;
-            render_to_window(instance.get(), physical_device, device.get(), model_path);
+            render_to_window(instance.get(), physical_device, device.get(), allocator, model_path,
+                scene ? &*scene : nullptr, load_options);
         }
 
         return EXIT_SUCCESS;
@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(const std::string& path)
+    : file_handle(nullptr), mapping_handle(nullptr), ptr(nullptr), size(0)
+{
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Failed to determine size of " + path);
+    }
+    size = static_cast<size_t>(file_size.QuadPart);
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_handle)
+    {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Failed to map " + path);
+    }
+
+    ptr = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (!ptr)
+    {
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        throw std::runtime_error("Failed to map " + path);
+    }
+}
+
+mapped_file::~mapped_file()
+{
+    UnmapViewOfFile(ptr);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+}
+
+#else
+
+mapped_file::mapped_file(const std::string& path)
+    : file_handle(nullptr), mapping_handle(nullptr), ptr(nullptr), size(0)
+{
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("Failed to determine size of " + path);
+    }
+    size = static_cast<size_t>(file_stat.st_size);
+
+    auto* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map " + path);
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    ptr = static_cast<const uint8_t*>(mapping);
+}
+
+mapped_file::~mapped_file()
+{
+    munmap(const_cast<uint8_t*>(ptr), size);
+}
+
+#endif
+
+std::span<const uint8_t> mapped_file::wait_for(size_t) const
+{
+    return std::span(ptr, size);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+
+// Contents of a file, which may still be arriving when it is decompressed in the background.
+class file_source
+{
+public:
+    virtual ~file_source() = default;
+
+    // Waits until at least the first size bytes are available or the whole file is, and returns the available bytes.
+    virtual std::span<const uint8_t> wait_for(size_t size) const = 0;
+
+    std::span<const uint8_t> data() const
+    {
+        return wait_for(SIZE_MAX);
+    }
+};
+
+class mapped_file : public file_source
+{
+    void* file_handle;
+    void* mapping_handle;
+    const uint8_t* ptr;
+    size_t size;
+
+public:
+    mapped_file(const std::string& path);
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    ~mapped_file();
+
+    std::span<const uint8_t> wait_for(size_t size) const override;
+};
@@ -0,0 +1,447 @@
+#include "stdafx.h"
+#include "memory_allocator.h"
+#include "buffer.h"
+#include "vulkan_context.h"
+
+// ranges are at least 256 bytes, which is the largest alignment buffers usually need
+static const uint32_t MIN_ORDER = 8;
+
+
+static uint32_t get_order(vk::DeviceSize size)
+{
+    auto order = MIN_ORDER;
+    while ((vk::DeviceSize(1) << order) < size)
+    {
+        order++;
+    }
+    return order;
+}
+
+const char* get_memory_category_name(memory_category category)
+{
+    switch (category)
+    {
+    case memory_category::model:
+        return "model";
+    case memory_category::acceleration_structure:
+        return "acceleration_structure";
+    case memory_category::scratch:
+        return "scratch";
+    case memory_category::attachment:
+        return "attachment";
+    case memory_category::ui:
+        return "ui";
+    case memory_category::staging:
+        return "staging";
+    case memory_category::other:
+        return "other";
+    }
+    throw std::runtime_error("Unknown memory category");
+}
+
+memory_allocation::memory_allocation()
+    : allocator(nullptr), pool(0), block(0), order(0), category(memory_category::other), memory(nullptr), offset(0),
+    size(0), ptr(nullptr)
+{
+}
+
+memory_allocation::memory_allocation(memory_allocation&& other) noexcept
+    : memory_allocation()
+{
+    *this = std::move(other);
+}
+
+memory_allocation& memory_allocation::operator=(memory_allocation&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (allocator)
+        {
+            allocator->free(*this);
+        }
+        allocator = std::exchange(other.allocator, nullptr);
+        pool = other.pool;
+        block = other.block;
+        order = other.order;
+        category = other.category;
+        memory = other.memory;
+        offset = other.offset;
+        size = other.size;
+        ptr = other.ptr;
+    }
+    return *this;
+}
+
+memory_allocation::~memory_allocation()
+{
+    if (allocator)
+    {
+        allocator->free(*this);
+    }
+}
+
+void memory_allocation::flush(vk::DeviceSize offset, vk::DeviceSize size) const
+{
+    assert(allocator && ptr);
+    allocator->flush(*this, offset, size);
+}
+
+memory_allocator::memory_allocator(vk::PhysicalDevice physical_device, vk::Device device, vk::DeviceSize block_size)
+    : physical_device(physical_device)
+    , device(device)
+    , memory_properties(physical_device.getMemoryProperties())
+    , non_coherent_atom_size(physical_device.getProperties().limits.nonCoherentAtomSize)
+    , block_order(get_order(block_size))
+    , pools(2 * memory_properties.memoryTypeCount)
+    , categories{}
+    , is_memory_budget_supported(::is_memory_budget_supported(physical_device))
+{
+}
+
+memory_allocator::~memory_allocator()
+{
+    for (auto& pool : pools)
+    {
+        for (uint32_t i = 0; i < pool.blocks.size(); i++)
+        {
+            if (pool.blocks[i])
+            {
+                free_block(pool, i);
+            }
+        }
+    }
+}
+
+
+std::unique_ptr<memory_allocator::memory_block> memory_allocator::allocate_block(uint32_t memory_type,
+    vk::DeviceSize size, bool is_dedicated)
+{
+    const vk::StructureChain<vk::MemoryAllocateInfo, vk::MemoryAllocateFlagsInfo> info{
+        vk::MemoryAllocateInfo()
+        .setAllocationSize(size)
+        .setMemoryTypeIndex(memory_type),
+        vk::MemoryAllocateFlagsInfo()
+        .setFlags(vk::MemoryAllocateFlagBits::eDeviceAddress)
+    };
+
+    auto block = std::make_unique<memory_block>();
+    block->memory = device.allocateMemory(info.get());
+    block->size = size;
+    block->ptr = nullptr;
+    if (memory_properties.memoryTypes[memory_type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+    {
+        block->ptr = device.mapMemory(block->memory, 0, VK_WHOLE_SIZE);
+    }
+    if (!is_dedicated)
+    {
+        block->free_ranges.resize(block_order - MIN_ORDER + 1);
+        block->free_ranges.back().insert(0);
+    }
+    block->allocation_count = 0;
+    block->requested_size = 0;
+    return block;
+}
+
+void memory_allocator::free_block(memory_pool& pool, uint32_t block)
+{
+    if (pool.blocks[block]->ptr)
+    {
+        device.unmapMemory(pool.blocks[block]->memory);
+    }
+    device.freeMemory(pool.blocks[block]->memory);
+    pool.blocks[block].reset();
+}
+
+vk::DeviceSize memory_allocator::get_allocated_size(const memory_allocation& allocation) const
+{
+    return allocation.order > block_order ? allocation.size : vk::DeviceSize(1) << allocation.order;
+}
+
+bool memory_allocator::is_device_local(const memory_allocation& allocation) const
+{
+    const auto flags = memory_properties.memoryTypes[allocation.pool / 2].propertyFlags;
+    return (flags & vk::MemoryPropertyFlagBits::eDeviceLocal) == vk::MemoryPropertyFlagBits::eDeviceLocal;
+}
+
+memory_allocation memory_allocator::allocate(const vk::MemoryRequirements& requirements,
+    vk::MemoryPropertyFlags memory_flags, bool is_linear, memory_category category)
+{
+    const auto memory_type = get_memory_index(physical_device, memory_flags, requirements);
+    const auto pool_index = 2 * memory_type + (is_linear ? 1 : 0);
+    const auto order = get_order(std::max(requirements.size, requirements.alignment));
+
+    std::lock_guard lock(mutex);
+    auto& pool = pools[pool_index];
+    const auto add_block = [&](std::unique_ptr<memory_block> block)
+    {
+        const auto empty_slot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+        if (empty_slot != pool.blocks.end())
+        {
+            *empty_slot = std::move(block);
+            return static_cast<uint32_t>(empty_slot - pool.blocks.begin());
+        }
+        pool.blocks.push_back(std::move(block));
+        return static_cast<uint32_t>(pool.blocks.size() - 1);
+    };
+
+    memory_allocation allocation;
+    allocation.allocator = this;
+    allocation.pool = pool_index;
+    allocation.order = order;
+    allocation.category = category;
+    allocation.size = requirements.size;
+    allocation.offset = 0;
+    if (order > block_order)
+    {
+        allocation.block = add_block(allocate_block(memory_type, requirements.size, true));
+    }
+    else
+    {
+        // the block with the smallest free range that fits, splitting it leaves the larger ranges intact
+        auto best_block = UINT32_MAX, best_order = UINT32_MAX;
+        for (uint32_t i = 0; i < pool.blocks.size(); i++)
+        {
+            const auto& block = pool.blocks[i];
+            if (!block || block->free_ranges.empty())
+            {
+                continue;
+            }
+            for (auto j = order; j < best_order && j <= block_order; j++)
+            {
+                if (!block->free_ranges[j - MIN_ORDER].empty())
+                {
+                    best_block = i;
+                    best_order = j;
+                    break;
+                }
+            }
+        }
+        if (best_block == UINT32_MAX)
+        {
+            best_block = add_block(allocate_block(memory_type, vk::DeviceSize(1) << block_order, false));
+            best_order = block_order;
+        }
+
+        auto& free_ranges = pool.blocks[best_block]->free_ranges;
+        const auto offset = *free_ranges[best_order - MIN_ORDER].begin();
+        free_ranges[best_order - MIN_ORDER].erase(free_ranges[best_order - MIN_ORDER].begin());
+        // the upper halves of the range are split off until it has the requested order
+        for (auto j = best_order; j > order; j--)
+        {
+            free_ranges[j - 1 - MIN_ORDER].insert(offset + (vk::DeviceSize(1) << (j - 1)));
+        }
+        allocation.block = best_block;
+        allocation.offset = offset;
+    }
+
+    auto& block = *pool.blocks[allocation.block];
+    block.allocation_count++;
+    block.requested_size += requirements.size;
+    auto& statistics = categories[static_cast<size_t>(category)];
+    statistics.allocation_count++;
+    statistics.requested_size += requirements.size;
+    statistics.allocated_size += get_allocated_size(allocation);
+    if (is_device_local(allocation))
+    {
+        statistics.device_local_size += requirements.size;
+    }
+    allocation.memory = block.memory;
+    allocation.ptr = block.ptr ? static_cast<uint8_t*>(block.ptr) + allocation.offset : nullptr;
+    return allocation;
+}
+
+void memory_allocator::free(memory_allocation& allocation)
+{
+    assert(allocation.allocator == this);
+    std::lock_guard lock(mutex);
+    auto& pool = pools[allocation.pool];
+    auto& block = *pool.blocks[allocation.block];
+    block.allocation_count--;
+    block.requested_size -= allocation.size;
+    auto& statistics = categories[static_cast<size_t>(allocation.category)];
+    statistics.allocation_count--;
+    statistics.requested_size -= allocation.size;
+    statistics.allocated_size -= get_allocated_size(allocation);
+    if (is_device_local(allocation))
+    {
+        statistics.device_local_size -= allocation.size;
+    }
+    allocation.allocator = nullptr;
+
+    if (!block.free_ranges.empty())
+    {
+        auto offset = allocation.offset;
+        auto order = allocation.order;
+        for (; order < block_order; order++)
+        {
+            auto& free_ranges = block.free_ranges[order - MIN_ORDER];
+            const auto buddy = free_ranges.find(offset ^ (vk::DeviceSize(1) << order));
+            if (buddy == free_ranges.end())
+            {
+                break;
+            }
+            free_ranges.erase(buddy);
+            offset &= ~(vk::DeviceSize(1) << order);
+        }
+        block.free_ranges[order - MIN_ORDER].insert(offset);
+    }
+
+    if (block.allocation_count > 0)
+    {
+        return;
+    }
+    // one empty block is kept per pool, so a resource that is recreated repeatedly doesn't allocate every time
+    const auto is_other_block_empty = std::ranges::any_of(pool.blocks, [&](const auto& other)
+        {
+            return other && other.get() != &block && !other->free_ranges.empty() && other->allocation_count == 0;
+        });
+    if (block.free_ranges.empty() || is_other_block_empty)
+    {
+        free_block(pool, allocation.block);
+    }
+}
+
+void memory_allocator::flush(const memory_allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size)
+{
+    // an empty range isn't a valid mapped memory range
+    if (size == 0
+        || memory_properties.memoryTypes[allocation.pool / 2].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent)
+    {
+        return;
+    }
+
+    // flushed ranges must be whole atoms, the ranges of the buddy allocator are aligned to at least 256 bytes, which
+    // is the largest atom size, so widening the range to atoms never reaches into another allocation
+    assert(non_coherent_atom_size <= (vk::DeviceSize(1) << MIN_ORDER));
+    const auto begin = (allocation.offset + offset) / non_coherent_atom_size * non_coherent_atom_size;
+    auto end = size == VK_WHOLE_SIZE
+        ? allocation.offset + allocation.size
+        : allocation.offset + offset + size;
+    end = (end + non_coherent_atom_size - 1) / non_coherent_atom_size * non_coherent_atom_size;
+
+    std::lock_guard lock(mutex);
+    const auto& block = *pools[allocation.pool].blocks[allocation.block];
+    device.flushMappedMemoryRanges({
+        vk::MappedMemoryRange()
+        .setMemory(block.memory)
+        .setOffset(begin)
+        .setSize(end >= block.size ? VK_WHOLE_SIZE : end - begin)
+        });
+}
+
+std::vector<memory_pool_statistics> memory_allocator::get_statistics() const
+{
+    std::lock_guard lock(mutex);
+    std::vector<memory_pool_statistics> statistics;
+    for (uint32_t i = 0; i < pools.size(); i++)
+    {
+        memory_pool_statistics pool_statistics{ i / 2, i % 2 == 1 };
+        for (const auto& block : pools[i].blocks)
+        {
+            if (!block)
+            {
+                continue;
+            }
+            pool_statistics.block_count++;
+            pool_statistics.allocation_count += block->allocation_count;
+            pool_statistics.block_size += block->size;
+            pool_statistics.requested_size += block->requested_size;
+            auto free_size = vk::DeviceSize(0);
+            for (uint32_t j = 0; j < block->free_ranges.size(); j++)
+            {
+                const auto range_size = vk::DeviceSize(1) << (j + MIN_ORDER);
+                free_size += block->free_ranges[j].size() * range_size;
+                if (!block->free_ranges[j].empty())
+                {
+                    pool_statistics.largest_free_range = std::max(pool_statistics.largest_free_range, range_size);
+                }
+            }
+            pool_statistics.allocated_size += block->size - free_size;
+        }
+        if (pool_statistics.block_count > 0)
+        {
+            statistics.push_back(pool_statistics);
+        }
+    }
+    return statistics;
+}
+
+void memory_allocator::print_statistics() const
+{
+    for (const auto& s : get_statistics())
+    {
+        const auto free_size = s.block_size - s.allocated_size;
+        const auto fragmentation = free_size > 0 ? 1. - static_cast<double>(s.largest_free_range) / free_size : 0.;
+        const auto waste = s.allocated_size > 0
+            ? 1. - static_cast<double>(s.requested_size) / s.allocated_size
+            : 0.;
+        std::printf("Memory type %u (%s): %u blocks of %.1f MB, %u allocations of %.1f MB, %.1f%% fragmentation, "
+            "%.1f%% waste\n", s.memory_type, s.is_linear ? "linear" : "optimal", s.block_count,
+            s.block_size / (1024. * 1024.), s.allocation_count, s.requested_size / (1024. * 1024.),
+            100. * fragmentation, 100. * waste);
+    }
+}
+
+std::array<memory_category_statistics, MEMORY_CATEGORY_COUNT> memory_allocator::get_category_statistics() const
+{
+    std::lock_guard lock(mutex);
+    return categories;
+}
+
+std::vector<memory_heap_budget> memory_allocator::get_heap_budgets() const
+{
+    std::vector<memory_heap_budget> heaps;
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++)
+    {
+        const auto& heap = memory_properties.memoryHeaps[i];
+        heaps.push_back({ (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal) == vk::MemoryHeapFlagBits::eDeviceLocal,
+            heap.size, 0, heap.size });
+    }
+
+    if (is_memory_budget_supported)
+    {
+        const auto properties = physical_device.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2,
+            vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        const auto& budget = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        for (uint32_t i = 0; i < heaps.size(); i++)
+        {
+            heaps[i].usage = budget.heapUsage[i];
+            heaps[i].budget = budget.heapBudget[i];
+        }
+        return heaps;
+    }
+
+    std::lock_guard lock(mutex);
+    for (uint32_t i = 0; i < pools.size(); i++)
+    {
+        for (const auto& block : pools[i].blocks)
+        {
+            if (block)
+            {
+                heaps[memory_properties.memoryTypes[i / 2].heapIndex].usage += block->size;
+            }
+        }
+    }
+    return heaps;
+}
+
+void memory_allocator::print_report() const
+{
+    const auto categories = get_category_statistics();
+    for (size_t i = 0; i < categories.size(); i++)
+    {
+        const auto& c = categories[i];
+        std::printf("memory_category name=%s allocations=%u requested=%llu allocated=%llu device_local=%llu\n",
+            get_memory_category_name(static_cast<memory_category>(i)), c.allocation_count,
+            static_cast<unsigned long long>(c.requested_size), static_cast<unsigned long long>(c.allocated_size),
+            static_cast<unsigned long long>(c.device_local_size));
+    }
+    const auto heaps = get_heap_budgets();
+    for (size_t i = 0; i < heaps.size(); i++)
+    {
+        const auto& h = heaps[i];
+        std::printf("memory_heap index=%zu device_local=%d size=%llu usage=%llu budget=%llu\n", i,
+            h.is_device_local ? 1 : 0, static_cast<unsigned long long>(h.size),
+            static_cast<unsigned long long>(h.usage), static_cast<unsigned long long>(h.budget));
+    }
+}
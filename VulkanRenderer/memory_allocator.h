@@ -0,0 +1,158 @@
+#pragma once
+#include <array>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+class memory_allocator;
+
+// What an allocation is used for, the allocator accounts the memory of every category.
+enum class memory_category
+{
+    // vertex, index, meshlet and chunk buffers of models and the transforms of scenes
+    model,
+    // acceleration structures and the instances and chunks they are built and traced with
+    acceleration_structure,
+    // memory acceleration structure builds only need while they run
+    scratch,
+    // depth buffers, ray tracing targets and other resources the size of the framebuffer
+    attachment,
+    ui,
+    // host visible memory uploads and readbacks are copied through
+    staging,
+    // uniform buffers, draw commands and shader binding tables
+    other,
+};
+
+const size_t MEMORY_CATEGORY_COUNT = 7;
+
+const char* get_memory_category_name(memory_category category);
+
+// A range of a block of device memory, which is returned to its allocator when the allocation is destroyed.
+class memory_allocation
+{
+    friend class memory_allocator;
+    memory_allocator* allocator;
+    uint32_t pool;
+    uint32_t block;
+    uint32_t order;
+    memory_category category;
+
+public:
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset;
+    vk::DeviceSize size;
+    // points at the range if the memory is host visible, such blocks stay mapped while they exist
+    void* ptr;
+
+    memory_allocation();
+    memory_allocation(memory_allocation&& other) noexcept;
+    memory_allocation& operator=(memory_allocation&& other) noexcept;
+    ~memory_allocation();
+
+    // Makes host writes to the range visible to the device, which only does something for non-coherent memory. The
+    // range is widened to whole nonCoherentAtomSize atoms, empty ranges are skipped.
+    void flush(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+};
+
+struct memory_pool_statistics
+{
+    uint32_t memory_type;
+    bool is_linear;
+    uint32_t block_count;
+    uint32_t allocation_count;
+    // bytes of all blocks, which includes those of dedicated allocations
+    vk::DeviceSize block_size;
+    // bytes of the power of two ranges handed out and the bytes that were requested for them
+    vk::DeviceSize allocated_size;
+    vk::DeviceSize requested_size;
+    vk::DeviceSize largest_free_range;
+};
+
+struct memory_category_statistics
+{
+    uint32_t allocation_count;
+    // bytes that were requested and bytes of the power of two ranges handed out for them
+    vk::DeviceSize requested_size;
+    vk::DeviceSize allocated_size;
+    // the part of requested_size in device local memory
+    vk::DeviceSize device_local_size;
+};
+
+struct memory_heap_budget
+{
+    bool is_device_local;
+    vk::DeviceSize size;
+    // The memory the process uses and the most it should use, which accounts for other processes. Without
+    // VK_EXT_memory_budget these are the blocks of the allocator and the size of the heap.
+    vk::DeviceSize usage;
+    vk::DeviceSize budget;
+};
+
+// Allocates device memory in large blocks per memory type and hands out ranges of them with a buddy allocator:
+// ranges are powers of two of at least the requested size and alignment, which are split off larger free ones and
+// merged with their free buddy again when they are released. Resources larger than a block get a dedicated one.
+// Linear and optimal resources never share a block, so bufferImageGranularity is respected without padding.
+class memory_allocator
+{
+    struct memory_block
+    {
+        vk::DeviceMemory memory;
+        vk::DeviceSize size;
+        void* ptr;
+        // offsets of the free ranges of every order, dedicated blocks have none
+        std::vector<std::set<vk::DeviceSize>> free_ranges;
+        uint32_t allocation_count;
+        vk::DeviceSize requested_size;
+    };
+
+    // the blocks of a memory type for linear or optimal resources, released blocks leave a null entry so the
+    // indices of the others stay valid
+    struct memory_pool
+    {
+        std::vector<std::unique_ptr<memory_block>> blocks;
+    };
+
+    vk::PhysicalDevice physical_device;
+    vk::Device device;
+    vk::PhysicalDeviceMemoryProperties memory_properties;
+    vk::DeviceSize non_coherent_atom_size;
+    uint32_t block_order;
+    std::vector<memory_pool> pools;
+    std::array<memory_category_statistics, MEMORY_CATEGORY_COUNT> categories;
+    bool is_memory_budget_supported;
+    mutable std::mutex mutex;
+
+    std::unique_ptr<memory_block> allocate_block(uint32_t memory_type, vk::DeviceSize size, bool is_dedicated);
+    void free_block(memory_pool& pool, uint32_t block);
+    // the size of the range of the allocation, or of its block if it is dedicated
+    vk::DeviceSize get_allocated_size(const memory_allocation& allocation) const;
+    bool is_device_local(const memory_allocation& allocation) const;
+
+public:
+    // Blocks are allocated with device addresses, which requires the bufferDeviceAddress feature. The allocator must
+    // outlive every buffer and image allocated from it. Budgets are queried with VK_EXT_memory_budget, which must be
+    // enabled if the physical device supports it.
+    memory_allocator(vk::PhysicalDevice physical_device, vk::Device device,
+        vk::DeviceSize block_size = 64 * 1024 * 1024);
+    memory_allocator(const memory_allocator&) = delete;
+    memory_allocator& operator=(const memory_allocator&) = delete;
+    ~memory_allocator();
+
+    // Linear resources are buffers and linear images.
+    memory_allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags memory_flags,
+        bool is_linear, memory_category category);
+    void free(memory_allocation& allocation);
+    void flush(const memory_allocation& allocation, vk::DeviceSize offset, vk::DeviceSize size);
+
+    std::vector<memory_pool_statistics> get_statistics() const;
+    std::array<memory_category_statistics, MEMORY_CATEGORY_COUNT> get_category_statistics() const;
+    // one entry per memory heap
+    std::vector<memory_heap_budget> get_heap_budgets() const;
+    // Prints the usage of every pool. Fragmentation is the share of the free memory of a pool outside of its largest
+    // free range, waste is the share of the allocated memory that wasn't requested.
+    void print_statistics() const;
+    // Prints a line per category and heap of space separated key=value pairs, with sizes in bytes, for scripts.
+    void print_report() const;
+};
@@ -0,0 +1,458 @@
+#include "stdafx.h"
+#include "mesh_optimizer.h"
+
+#include <numeric>
+#include <unordered_map>
+
+// Clusters are split where their running ACMR gets within this factor of the ACMR of the whole cluster. Smaller
+// clusters can be sorted more precisely for overdraw but start with a cold vertex cache.
+static const float OVERDRAW_CLUSTER_THRESHOLD = 1.05f;
+
+// Simulates a FIFO cache through timestamps: a vertex is cached if fewer than VERTEX_CACHE_SIZE vertices were added
+// after it.
+struct fifo_cache
+{
+    std::vector<uint32_t> timestamps;
+    uint32_t time;
+
+    explicit fifo_cache(size_t vertex_count)
+        : timestamps(vertex_count, 0), time(VERTEX_CACHE_SIZE + 1)
+    {
+    }
+
+    bool contains(uint32_t vertex) const
+    {
+        return time - timestamps[vertex] <= VERTEX_CACHE_SIZE;
+    }
+
+    // Returns the number of cache misses.
+    uint32_t add(const glm::uvec3& triangle)
+    {
+        uint32_t misses = 0;
+        for (auto j = 0; j < 3; j++)
+        {
+            if (!contains(triangle[j]))
+            {
+                timestamps[triangle[j]] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    void clear()
+    {
+        time += VERTEX_CACHE_SIZE + 1;
+    }
+};
+
+vertex_cache_statistics analyze_vertex_cache(const std::vector<glm::uvec3>& triangles, size_t vertex_count)
+{
+    fifo_cache cache(vertex_count);
+    size_t misses = 0;
+    for (const auto& triangle : triangles)
+    {
+        misses += cache.add(triangle);
+    }
+
+    return {
+        triangles.empty() ? 0.f : static_cast<float>(misses) / triangles.size(),
+        vertex_count == 0 ? 0.f : static_cast<float>(misses) / vertex_count,
+    };
+}
+
+struct weld_key
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::u8vec3 color;
+    uint8_t padding;
+};
+
+struct weld_key_hash
+{
+    size_t operator()(const weld_key& key) const
+    {
+        std::array<uint8_t, sizeof(weld_key)> bytes;
+        memcpy(bytes.data(), &key, sizeof(key));
+
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (const auto byte : bytes)
+        {
+            hash = (hash ^ byte) * 0x100000001b3ull;
+        }
+        return static_cast<size_t>(hash);
+    }
+};
+
+struct weld_key_equal
+{
+    bool operator()(const weld_key& a, const weld_key& b) const
+    {
+        return memcmp(&a, &b, sizeof(weld_key)) == 0;
+    }
+};
+
+struct welded_mesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::u8vec3> colors;
+    std::vector<glm::uvec3> triangles;
+};
+
+// Merges vertices whose attributes are bitwise identical. Unique vertices keep the order of their first occurrence.
+static welded_mesh weld_vertices(const ply_mesh& mesh, const std::vector<glm::uvec3>& triangles)
+{
+    welded_mesh result;
+    std::unordered_map<weld_key, uint32_t, weld_key_hash, weld_key_equal> unique_vertices;
+    unique_vertices.reserve(mesh.positions.size());
+
+    std::vector<uint32_t> remap(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++)
+    {
+        weld_key key{};
+        key.position = mesh.positions[i];
+        if (!mesh.normals.empty())
+        {
+            key.normal = mesh.normals[i];
+        }
+        if (!mesh.colors.empty())
+        {
+            key.color = mesh.colors[i];
+        }
+
+        const auto [it, is_new] = unique_vertices.emplace(key, static_cast<uint32_t>(result.positions.size()));
+        if (is_new)
+        {
+            result.positions.push_back(key.position);
+            if (!mesh.normals.empty())
+            {
+                result.normals.push_back(key.normal);
+            }
+            if (!mesh.colors.empty())
+            {
+                result.colors.push_back(key.color);
+            }
+        }
+        remap[i] = it->second;
+    }
+
+    result.triangles.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        result.triangles[i] = glm::uvec3(remap[triangles[i].x], remap[triangles[i].y], remap[triangles[i].z]);
+    }
+    return result;
+}
+
+// Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" by Sander et al. Emits all
+// triangles around a fanning vertex and then fans around the oldest adjacent vertex that stays cached while its
+// remaining triangles are emitted. When no neighbour has triangles left, it fans around the most recently used vertex
+// on the dead-end stack that has, and only when the stack is exhausted around the next live vertex in index order.
+static std::vector<glm::uvec3> tipsify(const std::vector<glm::uvec3>& triangles, size_t vertex_count)
+{
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    for (const auto& triangle : triangles)
+    {
+        for (auto j = 0; j < 3; j++)
+        {
+            offsets[triangle[j] + 1]++;
+        }
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<uint32_t> adjacency(offsets.back());
+    std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        for (auto j = 0; j < 3; j++)
+        {
+            adjacency[cursors[triangles[i][j]]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    std::vector<uint32_t> live_triangles(vertex_count);
+    for (size_t i = 0; i < vertex_count; i++)
+    {
+        live_triangles[i] = offsets[i + 1] - offsets[i];
+    }
+
+    fifo_cache cache(vertex_count);
+    std::vector<bool> is_emitted(triangles.size(), false);
+    std::vector<uint32_t> dead_end_stack;
+    std::vector<uint32_t> candidates;
+    // Vertices never become live again, so the scan for live vertices continues where the previous one stopped and all
+    // scans together visit every vertex once.
+    size_t scan_position = 0;
+
+    const auto skip_dead_end = [&]()
+    {
+        while (!dead_end_stack.empty())
+        {
+            const auto vertex = dead_end_stack.back();
+            dead_end_stack.pop_back();
+            if (live_triangles[vertex] > 0)
+            {
+                return vertex;
+            }
+        }
+
+        while (scan_position < vertex_count && live_triangles[scan_position] == 0)
+        {
+            scan_position++;
+        }
+        return scan_position < vertex_count ? static_cast<uint32_t>(scan_position) : UINT32_MAX;
+    };
+
+    std::vector<glm::uvec3> result;
+    result.reserve(triangles.size());
+
+    auto fanning_vertex = skip_dead_end();
+    while (fanning_vertex != UINT32_MAX)
+    {
+        candidates.clear();
+        for (auto i = offsets[fanning_vertex]; i < offsets[fanning_vertex + 1]; i++)
+        {
+            const auto triangle_index = adjacency[i];
+            if (is_emitted[triangle_index])
+            {
+                continue;
+            }
+            is_emitted[triangle_index] = true;
+
+            const auto& triangle = triangles[triangle_index];
+            result.push_back(triangle);
+            cache.add(triangle);
+            for (auto j = 0; j < 3; j++)
+            {
+                dead_end_stack.push_back(triangle[j]);
+                candidates.push_back(triangle[j]);
+                live_triangles[triangle[j]]--;
+            }
+        }
+
+        auto next_vertex = UINT32_MAX;
+        int64_t best_priority = -1;
+        for (const auto vertex : candidates)
+        {
+            if (live_triangles[vertex] == 0)
+            {
+                continue;
+            }
+
+            // prefer the oldest vertex that will still be cached after its remaining triangles are emitted
+            int64_t priority = 0;
+            const auto age = static_cast<int64_t>(cache.time - cache.timestamps[vertex]);
+            if (age + 2 * static_cast<int64_t>(live_triangles[vertex]) <= VERTEX_CACHE_SIZE)
+            {
+                priority = age;
+            }
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                next_vertex = vertex;
+            }
+        }
+
+        fanning_vertex = next_vertex != UINT32_MAX ? next_vertex : skip_dead_end();
+    }
+
+    assert(result.size() == triangles.size());
+    return result;
+}
+
+// Splits the triangle order into clusters that can be reordered without hurting the vertex cache much. Hard
+// boundaries are triangles where all vertices miss the cache, soft boundaries split clusters where their prefix has
+// a low enough ACMR.
+static std::vector<size_t> find_cluster_boundaries(const std::vector<glm::uvec3>& triangles, size_t vertex_count)
+{
+    fifo_cache cache(vertex_count);
+    std::vector<size_t> hard_boundaries;
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        if (cache.add(triangles[i]) == 3 || i == 0)
+        {
+            hard_boundaries.push_back(i);
+        }
+    }
+    hard_boundaries.push_back(triangles.size());
+
+    std::vector<size_t> boundaries;
+    for (size_t c = 0; c + 1 < hard_boundaries.size(); c++)
+    {
+        const auto first = hard_boundaries[c];
+        const auto last = hard_boundaries[c + 1];
+
+        cache.clear();
+        size_t cluster_misses = 0;
+        for (auto i = first; i < last; i++)
+        {
+            cluster_misses += cache.add(triangles[i]);
+        }
+        const auto threshold = OVERDRAW_CLUSTER_THRESHOLD * cluster_misses / (last - first);
+
+        cache.clear();
+        boundaries.push_back(first);
+        auto cluster_first = first;
+        size_t misses = 0;
+        for (auto i = first; i < last; i++)
+        {
+            misses += cache.add(triangles[i]);
+            if (i + 1 < last && static_cast<float>(misses) / (i + 1 - cluster_first) <= threshold)
+            {
+                boundaries.push_back(i + 1);
+                cluster_first = i + 1;
+                misses = 0;
+                cache.clear();
+            }
+        }
+    }
+    boundaries.push_back(triangles.size());
+    return boundaries;
+}
+
+// Draws clusters that face away from the center of the mesh first, so they are likely to occlude the clusters drawn
+// after them from any direction.
+static std::vector<glm::uvec3> sort_clusters_for_overdraw(const std::vector<glm::uvec3>& triangles,
+    const std::vector<glm::vec3>& positions)
+{
+    struct cluster
+    {
+        size_t first;
+        size_t last;
+        float sort_key;
+    };
+
+    glm::vec3 mesh_centroid(0.f);
+    auto mesh_area = 0.f;
+    std::vector<cluster> clusters;
+    std::vector<glm::vec3> centroids;
+    std::vector<glm::vec3> normals;
+
+    const auto boundaries = find_cluster_boundaries(triangles, positions.size());
+    for (size_t c = 0; c + 1 < boundaries.size(); c++)
+    {
+        glm::vec3 centroid(0.f);
+        glm::vec3 normal(0.f);
+        auto area = 0.f;
+        for (auto i = boundaries[c]; i < boundaries[c + 1]; i++)
+        {
+            const auto& p0 = positions[triangles[i].x];
+            const auto& p1 = positions[triangles[i].y];
+            const auto& p2 = positions[triangles[i].z];
+            const auto cross = glm::cross(p1 - p0, p2 - p0);
+            const auto triangle_area = glm::length(cross);
+            centroid += (p0 + p1 + p2) / 3.f * triangle_area;
+            normal += cross;
+            area += triangle_area;
+        }
+
+        mesh_centroid += centroid;
+        mesh_area += area;
+        clusters.push_back({ boundaries[c], boundaries[c + 1], 0.f });
+        centroids.push_back(area > 0.f ? centroid / area : centroid);
+        normals.push_back(normal);
+    }
+
+    if (mesh_area > 0.f)
+    {
+        mesh_centroid /= mesh_area;
+    }
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        const auto length = glm::length(normals[c]);
+        clusters[c].sort_key = length > 0.f ? glm::dot(centroids[c] - mesh_centroid, normals[c] / length) : 0.f;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const cluster& a, const cluster& b)
+        {
+            return a.sort_key > b.sort_key;
+        });
+
+    std::vector<glm::uvec3> result;
+    result.reserve(triangles.size());
+    for (const auto& cluster : clusters)
+    {
+        result.insert(result.end(), triangles.begin() + cluster.first, triangles.begin() + cluster.last);
+    }
+    return result;
+}
+
+template <typename T>
+static std::shared_ptr<std::vector<T>> remap_vertices(const std::vector<T>& vertices,
+    const std::vector<uint32_t>& remap)
+{
+    auto result = std::make_shared<std::vector<T>>(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        (*result)[remap[i]] = vertices[i];
+    }
+    return result;
+}
+
+void optimize_mesh(ply_mesh& mesh)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<glm::uvec3> triangles(mesh.triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        triangles[i] = mesh.triangles[i];
+    }
+    const auto original_vertex_count = mesh.positions.size();
+    const auto before = analyze_vertex_cache(triangles, original_vertex_count);
+
+    auto welded = weld_vertices(mesh, triangles);
+    const auto vertex_count = welded.positions.size();
+    welded.triangles = tipsify(welded.triangles, vertex_count);
+    auto optimized_triangles = std::make_shared<std::vector<glm::uvec3>>(
+        sort_clusters_for_overdraw(welded.triangles, welded.positions));
+
+    // Number vertices in the order they are fetched. Unused vertices are kept at the end, so the bounding box of the
+    // mesh doesn't change.
+    std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+    uint32_t next_index = 0;
+    for (auto& triangle : *optimized_triangles)
+    {
+        for (auto j = 0; j < 3; j++)
+        {
+            if (remap[triangle[j]] == UINT32_MAX)
+            {
+                remap[triangle[j]] = next_index++;
+            }
+            triangle[j] = remap[triangle[j]];
+        }
+    }
+    for (auto& index : remap)
+    {
+        if (index == UINT32_MAX)
+        {
+            index = next_index++;
+        }
+    }
+
+    const auto after = analyze_vertex_cache(*optimized_triangles, vertex_count);
+
+    auto positions = remap_vertices(welded.positions, remap);
+    mesh.positions = std::span<const glm::vec3>(*positions);
+    mesh.storage.emplace_back(positions);
+    if (!mesh.normals.empty())
+    {
+        auto normals = remap_vertices(welded.normals, remap);
+        mesh.normals = std::span<const glm::vec3>(*normals);
+        mesh.storage.emplace_back(normals);
+    }
+    if (!mesh.colors.empty())
+    {
+        auto colors = remap_vertices(welded.colors, remap);
+        mesh.colors = std::span<const glm::u8vec3>(*colors);
+        mesh.storage.emplace_back(colors);
+    }
+    mesh.triangles = std::span<const glm::uvec3>(*optimized_triangles);
+    mesh.storage.emplace_back(optimized_triangles);
+
+    std::printf("Optimized mesh in %.2lf ms: %zu -> %zu vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+        original_vertex_count, vertex_count, before.acmr, after.acmr, before.atvr, after.atvr);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "ply_reader.h"
+
+#define VERTEX_CACHE_SIZE 16
+
+struct vertex_cache_statistics
+{
+    // average cache miss ratio: transformed vertices per triangle
+    float acmr;
+    // average transformed to vertex ratio: transformed vertices per unique vertex, 1 is optimal
+    float atvr;
+};
+
+vertex_cache_statistics analyze_vertex_cache(const std::vector<glm::uvec3>& triangles, size_t vertex_count);
+
+// Welds exact duplicate vertices, reorders triangles for the post-transform vertex cache and for overdraw, and
+// reorders vertices in the order they are first used. The views of the mesh are replaced by views of the optimized
+// arrays, which are added to its storage.
+void optimize_mesh(ply_mesh& mesh);
@@ -0,0 +1,415 @@
+#include "stdafx.h"
+#include <execution>
+#include <numeric>
+#include "mesh_simplifier.h"
+#include "parallel.h"
+
+// Weight of the planes perpendicular to boundary edges that keep the borders of open scans in place.
+static const float BOUNDARY_WEIGHT = 10.f;
+
+static const size_t MIN_LOD_TRIANGLE_COUNT = 1024;
+
+// The chain ends when a level keeps more than this fraction of the triangles of the previous one.
+static const float MAX_LOD_RATIO = 0.75f;
+
+// Collapses that turn a triangle by more than about 75 degrees are rejected.
+static const float MIN_NORMAL_COSINE = 0.25f;
+
+static const size_t BLOCK_SIZE = 1 << 12;
+
+// Symmetric 3x3 matrix A, vector b and scalar c of the quadric error p^T A p + 2 b^T p + c.
+struct quadric
+{
+    float a00, a01, a02, a11, a12, a22;
+    float b0, b1, b2;
+    float c;
+};
+
+static quadric plane_quadric(const glm::vec3& normal, const glm::vec3& point, float weight)
+{
+    const auto d = -glm::dot(normal, point);
+    return {
+        weight * normal.x * normal.x, weight * normal.x * normal.y, weight * normal.x * normal.z,
+        weight * normal.y * normal.y, weight * normal.y * normal.z, weight * normal.z * normal.z,
+        weight * d * normal.x, weight * d * normal.y, weight * d * normal.z,
+        weight * d * d,
+    };
+}
+
+static void add_quadric(quadric& q, const quadric& r)
+{
+    q.a00 += r.a00;
+    q.a01 += r.a01;
+    q.a02 += r.a02;
+    q.a11 += r.a11;
+    q.a12 += r.a12;
+    q.a22 += r.a22;
+    q.b0 += r.b0;
+    q.b1 += r.b1;
+    q.b2 += r.b2;
+    q.c += r.c;
+}
+
+static float evaluate_quadric(const quadric& q, const quadric& r, const glm::vec3& p)
+{
+    const auto error =
+        (q.a00 + r.a00) * p.x * p.x + 2 * (q.a01 + r.a01) * p.x * p.y + 2 * (q.a02 + r.a02) * p.x * p.z
+        + (q.a11 + r.a11) * p.y * p.y + 2 * (q.a12 + r.a12) * p.y * p.z + (q.a22 + r.a22) * p.z * p.z
+        + 2 * ((q.b0 + r.b0) * p.x + (q.b1 + r.b1) * p.y + (q.b2 + r.b2) * p.z)
+        + q.c + r.c;
+    return glm::max(error, 0.f);
+}
+
+// Triangles around every vertex in ascending order, so results don't depend on thread scheduling.
+struct vertex_triangles
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+};
+
+static vertex_triangles build_vertex_triangles(const std::vector<glm::uvec3>& triangles, size_t vertex_count)
+{
+    vertex_triangles adjacency;
+    adjacency.offsets.assign(vertex_count + 1, 0);
+    parallel_for(triangles.size(), BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                for (auto j = 0; j < 3; j++)
+                {
+                    std::atomic_ref(adjacency.offsets[triangles[i][j]]).fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+
+    std::exclusive_scan(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin(), 0u);
+
+    std::vector<uint32_t> cursors(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    adjacency.triangles.resize(3 * triangles.size());
+    parallel_for(triangles.size(), BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                for (auto j = 0; j < 3; j++)
+                {
+                    const auto slot = std::atomic_ref(cursors[triangles[i][j]]).fetch_add(1,
+                        std::memory_order_relaxed);
+                    adjacency.triangles[slot] = static_cast<uint32_t>(i);
+                }
+            }
+        });
+
+    parallel_for(vertex_count, BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                std::sort(adjacency.triangles.begin() + adjacency.offsets[i],
+                    adjacency.triangles.begin() + adjacency.offsets[i + 1]);
+            }
+        });
+
+    return adjacency;
+}
+
+struct neighbor
+{
+    uint32_t vertex;
+    // number of triangles that share the edge to the neighbor
+    uint32_t triangle_count;
+    uint32_t triangle;
+};
+
+// Collects the vertices that share an edge with a vertex.
+static void find_neighbors(uint32_t vertex, const std::vector<glm::uvec3>& triangles,
+    const vertex_triangles& adjacency, std::vector<neighbor>& neighbors)
+{
+    neighbors.clear();
+    for (auto i = adjacency.offsets[vertex]; i < adjacency.offsets[vertex + 1]; i++)
+    {
+        const auto& triangle = triangles[adjacency.triangles[i]];
+        for (auto j = 0; j < 3; j++)
+        {
+            if (triangle[j] != vertex)
+            {
+                neighbors.push_back({ triangle[j], 1, adjacency.triangles[i] });
+            }
+        }
+    }
+
+    std::sort(neighbors.begin(), neighbors.end(), [](const neighbor& a, const neighbor& b)
+        {
+            return a.vertex < b.vertex;
+        });
+
+    size_t unique_count = 0;
+    for (size_t i = 0; i < neighbors.size(); i++)
+    {
+        if (unique_count > 0 && neighbors[unique_count - 1].vertex == neighbors[i].vertex)
+        {
+            neighbors[unique_count - 1].triangle_count++;
+        }
+        else
+        {
+            neighbors[unique_count++] = neighbors[i];
+        }
+    }
+    neighbors.resize(unique_count);
+}
+
+static std::vector<quadric> compute_quadrics(const std::vector<glm::vec3>& positions,
+    const std::vector<glm::uvec3>& triangles)
+{
+    const auto adjacency = build_vertex_triangles(triangles, positions.size());
+    std::vector<quadric> quadrics(positions.size());
+    parallel_for(positions.size(), BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            std::vector<neighbor> neighbors;
+            for (auto i = first; i < last; i++)
+            {
+                quadric q{};
+                for (auto k = adjacency.offsets[i]; k < adjacency.offsets[i + 1]; k++)
+                {
+                    const auto& triangle = triangles[adjacency.triangles[k]];
+                    const auto normal = glm::cross(positions[triangle.y] - positions[triangle.x],
+                        positions[triangle.z] - positions[triangle.x]);
+                    const auto length = glm::length(normal);
+                    if (length > 0.f)
+                    {
+                        add_quadric(q, plane_quadric(normal / length, positions[triangle.x], 1.f));
+                    }
+                }
+
+                // edges used by a single triangle are on the boundary
+                find_neighbors(static_cast<uint32_t>(i), triangles, adjacency, neighbors);
+                for (const auto& n : neighbors)
+                {
+                    if (n.triangle_count != 1)
+                    {
+                        continue;
+                    }
+
+                    const auto& triangle = triangles[n.triangle];
+                    const auto face_normal = glm::cross(positions[triangle.y] - positions[triangle.x],
+                        positions[triangle.z] - positions[triangle.x]);
+                    const auto normal = glm::cross(positions[n.vertex] - positions[i], face_normal);
+                    const auto length = glm::length(normal);
+                    if (length > 0.f)
+                    {
+                        add_quadric(q, plane_quadric(normal / length, positions[i], BOUNDARY_WEIGHT));
+                    }
+                }
+
+                quadrics[i] = q;
+            }
+        });
+    return quadrics;
+}
+
+struct collapse
+{
+    uint32_t from;
+    uint32_t to;
+    float cost;
+    // triangles that share the collapsed edge and disappear
+    uint32_t removed_triangle_count;
+};
+
+// Finds the cheapest collapse of a vertex onto one of its neighbors. Boundary vertices may only slide along the
+// boundary, vertices on non-manifold edges are kept.
+static collapse find_best_collapse(uint32_t vertex, const std::vector<glm::vec3>& positions,
+    const std::vector<quadric>& quadrics, const std::vector<glm::uvec3>& triangles,
+    const vertex_triangles& adjacency, std::vector<neighbor>& neighbors)
+{
+    collapse best{ vertex, vertex, std::numeric_limits<float>::infinity(), 0 };
+
+    find_neighbors(vertex, triangles, adjacency, neighbors);
+    auto is_boundary = false;
+    for (const auto& n : neighbors)
+    {
+        if (n.triangle_count > 2)
+        {
+            return best;
+        }
+        is_boundary = is_boundary || n.triangle_count == 1;
+    }
+
+    for (const auto& n : neighbors)
+    {
+        if (is_boundary && n.triangle_count != 1)
+        {
+            continue;
+        }
+
+        const auto cost = evaluate_quadric(quadrics[vertex], quadrics[n.vertex], positions[n.vertex]);
+        if (cost >= best.cost)
+        {
+            continue;
+        }
+
+        auto is_flipped = false;
+        for (auto i = adjacency.offsets[vertex]; i < adjacency.offsets[vertex + 1] && !is_flipped; i++)
+        {
+            const auto& triangle = triangles[adjacency.triangles[i]];
+            if (triangle.x == n.vertex || triangle.y == n.vertex || triangle.z == n.vertex)
+            {
+                continue;
+            }
+
+            std::array<glm::vec3, 3> corners{
+                positions[triangle.x], positions[triangle.y], positions[triangle.z]
+            };
+            const auto old_normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            for (auto j = 0; j < 3; j++)
+            {
+                if (triangle[j] == vertex)
+                {
+                    corners[j] = positions[n.vertex];
+                }
+            }
+            const auto new_normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            is_flipped = glm::dot(old_normal, new_normal)
+                < MIN_NORMAL_COSINE * glm::length(old_normal) * glm::length(new_normal);
+        }
+
+        if (!is_flipped)
+        {
+            best = { vertex, n.vertex, cost, n.triangle_count };
+        }
+    }
+
+    return best;
+}
+
+// Collapses vertices in passes until at most target_triangle_count triangles are left or no collapse is possible.
+// Every pass picks the cheapest collapse of each vertex in parallel and applies them in order of their cost, skipping
+// collapses whose triangles were already changed in the same pass.
+static void simplify(const std::vector<glm::vec3>& positions, std::vector<quadric>& quadrics,
+    std::vector<glm::uvec3>& triangles, size_t target_triangle_count, float& max_cost)
+{
+    const auto vertex_count = positions.size();
+    std::vector<collapse> collapses(vertex_count);
+    std::vector<uint32_t> remap(vertex_count);
+    std::vector<uint8_t> is_locked(vertex_count);
+
+    while (triangles.size() > target_triangle_count)
+    {
+        const auto adjacency = build_vertex_triangles(triangles, vertex_count);
+        parallel_for(vertex_count, BLOCK_SIZE, [&](size_t first, size_t last)
+            {
+                std::vector<neighbor> neighbors;
+                for (auto i = first; i < last; i++)
+                {
+                    collapses[i] = find_best_collapse(static_cast<uint32_t>(i), positions, quadrics, triangles,
+                        adjacency, neighbors);
+                }
+            });
+
+        std::vector<collapse> candidates;
+        std::copy_if(collapses.begin(), collapses.end(), std::back_inserter(candidates), [](const collapse& c)
+            {
+                return c.from != c.to;
+            });
+        std::sort(std::execution::par, candidates.begin(), candidates.end(), [](const collapse& a, const collapse& b)
+            {
+                return a.cost < b.cost || (a.cost == b.cost && a.from < b.from);
+            });
+
+        std::iota(remap.begin(), remap.end(), 0u);
+        std::fill(is_locked.begin(), is_locked.end(), uint8_t(0));
+        const auto excess_triangle_count = triangles.size() - target_triangle_count;
+        size_t removed_triangle_count = 0;
+        for (const auto& c : candidates)
+        {
+            if (removed_triangle_count >= excess_triangle_count)
+            {
+                break;
+            }
+            if (is_locked[c.from] || remap[c.to] != c.to)
+            {
+                continue;
+            }
+
+            // the flip test assumed that the other vertices of the triangles around the collapsed vertex stay put
+            auto is_ring_moved = false;
+            for (auto i = adjacency.offsets[c.from]; i < adjacency.offsets[c.from + 1]; i++)
+            {
+                const auto& triangle = triangles[adjacency.triangles[i]];
+                for (auto j = 0; j < 3; j++)
+                {
+                    is_ring_moved = is_ring_moved || remap[triangle[j]] != triangle[j];
+                }
+            }
+            if (is_ring_moved)
+            {
+                continue;
+            }
+
+            for (auto i = adjacency.offsets[c.from]; i < adjacency.offsets[c.from + 1]; i++)
+            {
+                const auto& triangle = triangles[adjacency.triangles[i]];
+                for (auto j = 0; j < 3; j++)
+                {
+                    is_locked[triangle[j]] = 1;
+                }
+            }
+
+            remap[c.from] = c.to;
+            add_quadric(quadrics[c.to], quadrics[c.from]);
+            max_cost = glm::max(max_cost, c.cost);
+            removed_triangle_count += c.removed_triangle_count;
+        }
+
+        if (removed_triangle_count == 0)
+        {
+            break;
+        }
+
+        parallel_for(triangles.size(), BLOCK_SIZE, [&](size_t first, size_t last)
+            {
+                for (auto i = first; i < last; i++)
+                {
+                    auto& triangle = triangles[i];
+                    triangle = glm::uvec3(remap[triangle.x], remap[triangle.y], remap[triangle.z]);
+                }
+            });
+        triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [](const glm::uvec3& triangle)
+            {
+                return triangle.x == triangle.y || triangle.y == triangle.z || triangle.z == triangle.x;
+            }), triangles.end());
+    }
+}
+
+std::vector<simplified_lod> build_lod_chain(const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    const strided_view<glm::uvec3>& triangles)
+{
+    std::vector<glm::vec3> normalized_positions(positions.size());
+    parallel_for(positions.size(), BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                normalized_positions[i] = (positions[i] - glm::vec3(transformation)) * transformation.w;
+            }
+        });
+
+    std::vector<glm::uvec3> current(triangles.size());
+    for (size_t i = 0; i < current.size(); i++)
+    {
+        current[i] = triangles[i];
+    }
+
+    auto quadrics = compute_quadrics(normalized_positions, current);
+    auto max_cost = 0.f;
+
+    std::vector<simplified_lod> lods;
+    while (lods.size() + 1 < MAX_LOD_COUNT && current.size() > MIN_LOD_TRIANGLE_COUNT)
+    {
+        const auto previous_triangle_count = current.size();
+        simplify(normalized_positions, quadrics, current, previous_triangle_count / 2, max_cost);
+        if (current.size() > MAX_LOD_RATIO * previous_triangle_count)
+        {
+            break;
+        }
+        lods.push_back({ current, glm::sqrt(max_cost) });
+    }
+    return lods;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "data_types.h"
+#include "ply_reader.h"
+
+// A level of detail in the combined index and meshlet buffers of a model. Level 0 is the full resolution mesh.
+struct lod_level
+{
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    // largest distance the simplified surface may deviate from the original, in normalized model space
+    float error;
+};
+
+struct simplified_lod
+{
+    std::vector<glm::uvec3> triangles;
+    float error;
+};
+
+// Generates up to MAX_LOD_COUNT - 1 coarser levels with quadric error edge collapses, each with about half the
+// triangles of the previous one. Vertices are only ever collapsed onto other vertices, so all levels index the
+// original vertex buffer.
+std::vector<simplified_lod> build_lod_chain(const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    const strided_view<glm::uvec3>& triangles);
@@ -0,0 +1,183 @@
+#include "stdafx.h"
+#include "meshlet.h"
+#include "parallel.h"
+
+// Covers the difference between the float positions used here and the snorm positions the shaders see.
+static const float QUANTIZATION_MARGIN = 1.e-4f;
+
+// A cutoff that no dot product reaches.
+static const float DISABLED_CONE_CUTOFF = 2.f;
+
+static void compute_bounds(meshlet& m, const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    const strided_view<glm::uvec3>& triangles, uint32_t first_vertex, bool compute_cones)
+{
+    const auto first_triangle = m.first_index / 3;
+    const auto triangle_count = m.index_count / 3;
+    const auto transform = [&](uint32_t index)
+    {
+        return (positions[first_vertex + index] - glm::vec3(transformation)) * transformation.w;
+    };
+
+    glm::vec3 min(transform(triangles[first_triangle].x));
+    glm::vec3 max(min);
+    for (auto i = first_triangle; i < first_triangle + triangle_count; i++)
+    {
+        const auto triangle = triangles[i];
+        for (auto j = 0; j < 3; j++)
+        {
+            const auto position = transform(triangle[j]);
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+    }
+
+    m.center = (min + max) / 2.f;
+    m.radius = 0.f;
+    for (auto i = first_triangle; i < first_triangle + triangle_count; i++)
+    {
+        const auto triangle = triangles[i];
+        for (auto j = 0; j < 3; j++)
+        {
+            m.radius = glm::max(m.radius, glm::distance(m.center, transform(triangle[j])));
+        }
+    }
+    m.radius += QUANTIZATION_MARGIN;
+
+    m.cone_apex = m.center;
+    m.cone_axis = glm::vec3(0.f);
+    m.cone_cutoff = DISABLED_CONE_CUTOFF;
+    if (!compute_cones)
+    {
+        return;
+    }
+
+    // The axis is the average triangle normal and the cutoff is derived from the widest angle between the axis and
+    // a triangle normal. The apex is moved back along the axis until every triangle plane is in front of it.
+    glm::vec3 axis(0.f);
+    for (auto i = first_triangle; i < first_triangle + triangle_count; i++)
+    {
+        const auto triangle = triangles[i];
+        const auto normal = glm::cross(transform(triangle.y) - transform(triangle.x),
+            transform(triangle.z) - transform(triangle.x));
+        const auto length = glm::length(normal);
+        if (length > 0.f)
+        {
+            axis += normal / length;
+        }
+    }
+    if (glm::length(axis) == 0.f)
+    {
+        return;
+    }
+    axis = glm::normalize(axis);
+
+    auto min_dot = 1.f;
+    auto max_t = 0.f;
+    for (auto i = first_triangle; i < first_triangle + triangle_count; i++)
+    {
+        const auto triangle = triangles[i];
+        const auto a = transform(triangle.x);
+        const auto normal = glm::cross(transform(triangle.y) - a, transform(triangle.z) - a);
+        const auto length = glm::length(normal);
+        if (length == 0.f)
+        {
+            continue;
+        }
+
+        const auto unit_normal = normal / length;
+        const auto dot = glm::dot(axis, unit_normal);
+        min_dot = glm::min(min_dot, dot);
+        if (dot > 0.f)
+        {
+            max_t = glm::max(max_t, glm::dot(m.center - a, unit_normal) / dot);
+        }
+    }
+
+    // cones wider than a hemisphere can't be culled
+    if (min_dot <= 0.1f)
+    {
+        return;
+    }
+
+    m.cone_apex = m.center - axis * max_t;
+    m.cone_axis = axis;
+    m.cone_cutoff = glm::sqrt(1.f - min_dot * min_dot);
+}
+
+std::vector<meshlet> build_meshlets(const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    const strided_view<glm::uvec3>& triangles, bool compute_cones, std::span<const uint32_t> segment_triangle_counts,
+    std::span<const uint32_t> segment_first_vertices)
+{
+    std::vector<meshlet> meshlets;
+    // the first vertex of the segment of every meshlet, which its indices are relative to
+    std::vector<uint32_t> meshlet_first_vertices;
+    // relative indices of different segments may collide, which is harmless since no meshlet crosses segments
+    std::vector<uint32_t> vertex_meshlets(positions.size(), UINT32_MAX);
+
+    meshlet current{};
+    uint32_t current_vertex_count = 0;
+    uint32_t first_vertex = 0;
+    size_t segment = 0;
+    size_t segment_end = segment_triangle_counts.empty() ? triangles.size() : segment_triangle_counts[0];
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+        auto is_segment_start = false;
+        while (i == segment_end)
+        {
+            segment_end += segment_triangle_counts[++segment];
+            is_segment_start = true;
+        }
+
+        const auto triangle = triangles[i];
+        const auto meshlet_index = static_cast<uint32_t>(meshlets.size());
+
+        uint32_t new_vertex_count = 0;
+        for (auto j = 0; j < 3; j++)
+        {
+            const auto is_duplicate = (j > 0 && triangle[j] == triangle[0]) || (j > 1 && triangle[j] == triangle[1]);
+            if (vertex_meshlets[triangle[j]] != meshlet_index && !is_duplicate)
+            {
+                new_vertex_count++;
+            }
+        }
+
+        if (current.index_count == 3 * MAX_MESHLET_TRIANGLES
+            || current_vertex_count + new_vertex_count > MAX_MESHLET_VERTICES
+            || (is_segment_start && current.index_count > 0))
+        {
+            meshlets.push_back(current);
+            meshlet_first_vertices.push_back(first_vertex);
+            current = meshlet{};
+            current.first_index = static_cast<uint32_t>(3 * i);
+            current_vertex_count = 0;
+            new_vertex_count = 3 - (triangle.y == triangle.x) - (triangle.z == triangle.x || triangle.z == triangle.y);
+        }
+
+        for (auto j = 0; j < 3; j++)
+        {
+            vertex_meshlets[triangle[j]] = static_cast<uint32_t>(meshlets.size());
+        }
+        if (current.index_count == 0 && !segment_first_vertices.empty())
+        {
+            first_vertex = segment_first_vertices[segment];
+        }
+        current_vertex_count += new_vertex_count;
+        current.index_count += 3;
+    }
+    if (current.index_count > 0)
+    {
+        meshlets.push_back(current);
+        meshlet_first_vertices.push_back(first_vertex);
+    }
+
+    parallel_for(meshlets.size(), 256, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                compute_bounds(meshlets[i], positions, transformation, triangles, meshlet_first_vertices[i],
+                    compute_cones);
+            }
+        });
+
+    return meshlets;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "ply_reader.h"
+
+#define MAX_MESHLET_VERTICES 64
+#define MAX_MESHLET_TRIANGLES 124
+
+// Layout must be kept in sync with cull.comp. Bounds are in the normalized model space of the quantized vertices.
+struct meshlet
+{
+    glm::vec3 center;
+    float radius;
+    // the meshlet faces away from the camera if dot(normalize(cone_apex - camera), cone_axis) >= cone_cutoff
+    glm::vec3 cone_apex;
+    float cone_cutoff;
+    glm::vec3 cone_axis;
+    uint32_t first_index;
+    uint32_t index_count;
+    // level of detail the meshlet belongs to
+    uint32_t lod;
+    // position chunk whose dequantization applies to the vertices of the meshlet
+    uint32_t chunk;
+    uint32_t padding;
+};
+
+// Splits the triangles into consecutive runs of at most MAX_MESHLET_TRIANGLES triangles that reference at most
+// MAX_MESHLET_VERTICES vertices, so the index buffer doesn't have to be rewritten. Cache optimized index orders give
+// tighter meshlets. Without compute_cones every meshlet gets a cone that never culls. The triangles may be divided into
+// consecutive segments of the given sizes, which no meshlet crosses. If segment_first_vertices is given, the indices
+// of each segment are relative to its first vertex.
+std::vector<meshlet> build_meshlets(const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    const strided_view<glm::uvec3>& triangles, bool compute_cones,
+    std::span<const uint32_t> segment_triangle_counts = {}, std::span<const uint32_t> segment_first_vertices = {});
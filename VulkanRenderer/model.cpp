@@ -1,189 +1,744 @@
 #include "stdafx.h"
 #include "model.h"
 #include "data_types.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlet.h"
+#include "model_cache.h"
 #include "pipeline.h"
+#include "parallel.h"
+#include "ply_reader.h"
+#include "point_cloud.h"
+#include "upload_manager.h"
+#include "vertex_packing.h"
 
-#pragma warning( push )
-#pragma warning( disable: 4267 )
-#include <tinyply.h>
-#pragma warning( pop )
+model::model(uint32_t vertex_count, vertex_layout layout, uint32_t index_count, vk::IndexType index_type,
+    std::unique_ptr<buffer> vertex_buffer, std::unique_ptr<buffer> index_buffer, uint32_t meshlet_count,
+    std::unique_ptr<buffer> meshlet_buffer, std::vector<lod_level> lods, std::vector<position_chunk> chunks,
+    std::unique_ptr<buffer> chunk_buffer, std::unique_ptr<buffer> residency_buffer,
+    std::unique_ptr<chunk_streamer> streamer)
+    : index_count(index_count), vertex_count(vertex_count), layout(layout), index_type(index_type),
+    vertex_buffer(std::move(vertex_buffer)), index_buffer(std::move(index_buffer)), meshlet_count(meshlet_count),
+    meshlet_buffer(std::move(meshlet_buffer)), lods(std::move(lods)), chunks(std::move(chunks)),
+    chunk_buffer(std::move(chunk_buffer)), residency_buffer(std::move(residency_buffer)),
+    streamer(std::move(streamer))
+{
+}
 
-model::model(uint32_t vertex_count, uint32_t index_count, std::unique_ptr<buffer> vertex_buffer,
-    std::unique_ptr<buffer> index_buffer)
-    : index_count(index_count), vertex_count(vertex_count), vertex_buffer(std::move(vertex_buffer)),
-    index_buffer(std::move(index_buffer))
+void model::draw(vk::CommandBuffer command_buffer, vk::Buffer draw_command_buffer, uint32_t draw_count,
+    uint32_t max_draw_count) const
 {
+    command_buffer.bindIndexBuffer(index_buffer->buf.get(), 0, index_type);
+    command_buffer.bindVertexBuffers(0, { vertex_buffer->buf.get() }, { 0 });
+    for (uint32_t first = 0; first < draw_count; first += max_draw_count)
+    {
+        command_buffer.drawIndexedIndirect(draw_command_buffer, first * sizeof(vk::DrawIndexedIndirectCommand),
+            std::min(max_draw_count, draw_count - first), sizeof(vk::DrawIndexedIndirectCommand));
+    }
 }
 
-void model::draw(vk::CommandBuffer command_buffer) const
+void model::draw_counted(vk::CommandBuffer command_buffer, vk::Buffer draw_command_buffer,
+    vk::Buffer draw_count_buffer, uint32_t max_draw_count) const
 {
-    command_buffer.bindIndexBuffer(index_buffer->buf.get(), 0, vk::IndexType::eUint32);
+    command_buffer.bindIndexBuffer(index_buffer->buf.get(), 0, index_type);
     command_buffer.bindVertexBuffers(0, { vertex_buffer->buf.get() }, { 0 });
-    command_buffer.drawIndexed(index_count, 1, 0, 0, 0);
+    command_buffer.drawIndexedIndirectCountKHR(draw_command_buffer, 0, draw_count_buffer, 0, max_draw_count,
+        sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+uint32_t model::get_max_lod_meshlet_count() const
+{
+    return std::ranges::max(lods, {}, &lod_level::meshlet_count).meshlet_count;
+}
+
+bool model::is_point_cloud() const
+{
+    return !index_buffer;
+}
+
+bool model::update_residency(vk::Queue queue, const model_uniform_data& camera)
+{
+    return streamer && streamer->update(queue, camera, vertex_buffer->buf.get(), index_buffer->buf.get(),
+        residency_buffer->buf.get());
 }
 
-static glm::i16vec3 r16g16b16_snorm(float x, float y, float z)
+// The gather does about 4 times the work of the scatter, with atomic counting, per vertex sorts and more passes over
+// memory, so it's only used with enough hardware threads to make up for it.
+static const unsigned MIN_GATHER_THREAD_COUNT = 8;
+
+// Sums the area weighted face normals around every vertex. Face normals are computed in parallel and then gathered
+// per vertex through a vertex to face adjacency table; faces are visited in ascending order, so the result is
+// identical to a sequential scatter over all triangles.
+static std::vector<glm::vec3> generate_unnormalized_normals_gather(const strided_view<glm::vec3>& positions,
+    const strided_view<glm::uvec3>& triangles)
 {
-    assert(x >= -1.f && x <= 1.f);
-    assert(y >= -1.f && y <= 1.f);
-    assert(z >= -1.f && z <= 1.f);
+    const size_t block_size = 1 << 14;
+    const auto vertex_count = positions.size();
+    const auto triangle_count = triangles.size();
+
+    std::vector<glm::vec3> face_normals(triangle_count);
+    std::vector<uint32_t> face_offsets(vertex_count + 1, 0);
+    parallel_for(triangle_count, block_size, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                const auto triangle = triangles[i];
+                const auto a = positions[triangle.x];
+                const auto b = positions[triangle.y];
+                const auto c = positions[triangle.z];
+                face_normals[i] = cross(b - a, c - a);
+
+                std::atomic_ref(face_offsets[triangle.x]).fetch_add(1, std::memory_order_relaxed);
+                std::atomic_ref(face_offsets[triangle.y]).fetch_add(1, std::memory_order_relaxed);
+                std::atomic_ref(face_offsets[triangle.z]).fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+    std::exclusive_scan(face_offsets.begin(), face_offsets.end(), face_offsets.begin(), 0u);
 
-    return glm::i16vec3(
-        static_cast<int16_t>(UINT16_MAX * (x + 1) / 2 + INT16_MIN),
-        static_cast<int16_t>(UINT16_MAX * (y + 1) / 2 + INT16_MIN),
-        static_cast<int16_t>(UINT16_MAX * (z + 1) / 2 + INT16_MIN)
-    );
+    std::vector<uint32_t> cursors(face_offsets.begin(), face_offsets.end() - 1);
+    std::vector<uint32_t> vertex_faces(3 * triangle_count);
+    parallel_for(triangle_count, block_size, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                const auto triangle = triangles[i];
+                for (auto j = 0; j < 3; j++)
+                {
+                    const auto slot = std::atomic_ref(cursors[triangle[j]]).fetch_add(1, std::memory_order_relaxed);
+                    vertex_faces[slot] = static_cast<uint32_t>(i);
+                }
+            }
+        });
+
+    std::vector<glm::vec3> normals(vertex_count);
+    parallel_for(vertex_count, block_size, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                const auto faces_begin = vertex_faces.begin() + face_offsets[i];
+                const auto faces_end = vertex_faces.begin() + face_offsets[i + 1];
+                std::sort(faces_begin, faces_end);
+
+                glm::vec3 normal(0.f);
+                for (auto face = faces_begin; face != faces_end; ++face)
+                {
+                    normal += face_normals[*face];
+                }
+                normals[i] = normal;
+            }
+        });
+
+    return normals;
 }
 
-static std::vector<float> generate_unnormalized_normals(const std::span<float>& positions,
-    const std::span<uint32_t>& indices)
+static std::vector<glm::vec3> generate_unnormalized_normals_scatter(const strided_view<glm::vec3>& positions,
+    const strided_view<glm::uvec3>& triangles)
 {
-    std::vector<float> normals(positions.size(), 0.f);
-    for (size_t i = 0; i < indices.size() / 3; i++)
+    std::vector<glm::vec3> normals(positions.size(), glm::vec3(0.f));
+    for (size_t i = 0; i < triangles.size(); i++)
     {
-        const auto a_index = indices[3 * i];
-        glm::vec3 a(positions[3 * a_index], positions[3 * a_index + 1], positions[3 * a_index + 2]);
-        const auto b_index = indices[3 * i + 1];
-        glm::vec3 b(positions[3 * b_index], positions[3 * b_index + 1], positions[3 * b_index + 2]);
-        const auto c_index = indices[3 * i + 2];
-        glm::vec3 c(positions[3 * c_index], positions[3 * c_index + 1], positions[3 * c_index + 2]);
+        const auto triangle = triangles[i];
+        const auto a = positions[triangle.x];
+        const auto b = positions[triangle.y];
+        const auto c = positions[triangle.z];
 
         const auto weighted_normal = cross(b - a, c - a);
-        normals[3 * a_index] += weighted_normal.x;
-        normals[3 * a_index + 1] += weighted_normal.y;
-        normals[3 * a_index + 2] += weighted_normal.z;
-        normals[3 * b_index] += weighted_normal.x;
-        normals[3 * b_index + 1] += weighted_normal.y;
-        normals[3 * b_index + 2] += weighted_normal.z;
-        normals[3 * c_index] += weighted_normal.x;
-        normals[3 * c_index + 1] += weighted_normal.y;
-        normals[3 * c_index + 2] += weighted_normal.z;
+        normals[triangle.x] += weighted_normal;
+        normals[triangle.y] += weighted_normal;
+        normals[triangle.z] += weighted_normal;
     }
     return normals;
 }
 
-static glm::vec4 unitize(const std::span<float>& positions)
+static bool is_gather_faster()
 {
-    glm::vec3 min(positions[0], positions[1], positions[2]);
-    glm::vec3 max(positions[0], positions[1], positions[2]);
+    return std::thread::hardware_concurrency() >= MIN_GATHER_THREAD_COUNT;
+}
 
-    for (size_t i = 0; i < positions.size() / 3; i++)
+static std::vector<glm::vec3> generate_unnormalized_normals(const strided_view<glm::vec3>& positions,
+    const strided_view<glm::uvec3>& triangles)
+{
+    return is_gather_faster()
+        ? generate_unnormalized_normals_gather(positions, triangles)
+        : generate_unnormalized_normals_scatter(positions, triangles);
+}
+
+void benchmark_normal_generation()
+{
+    const size_t repetitions = 3;
+    // quads per row of the grids, each split into two triangles
+    const size_t row_size = 1000;
+    std::printf("Generating normals of grids with %zu quads per row, best of %zu runs, %u hardware threads, loading "
+        "uses the %s:\n", row_size, repetitions, std::thread::hardware_concurrency(),
+        is_gather_faster() ? "gather" : "scatter");
+
+    for (const size_t target_triangle_count : { 1'000'000, 3'000'000, 10'000'000, 30'000'000 })
     {
-        glm::vec3 position(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
-        min = glm::min(min, position);
-        max = glm::max(max, position);
+        const auto row_count = target_triangle_count / (2 * row_size);
+        std::vector<glm::vec3> positions;
+        positions.reserve((row_count + 1) * (row_size + 1));
+        for (size_t y = 0; y <= row_count; y++)
+        {
+            for (size_t x = 0; x <= row_size; x++)
+            {
+                // a bumpy height field, so the faces around a vertex have different normals
+                const auto height = 0.5f * std::sin(0.37f * x) * std::cos(0.23f * y);
+                positions.emplace_back(static_cast<float>(x), static_cast<float>(y), height);
+            }
+        }
+        std::vector<glm::uvec3> triangles;
+        triangles.reserve(2 * row_count * row_size);
+        for (size_t y = 0; y < row_count; y++)
+        {
+            for (size_t x = 0; x < row_size; x++)
+            {
+                const auto corner = static_cast<uint32_t>(y * (row_size + 1) + x);
+                const auto above = corner + static_cast<uint32_t>(row_size + 1);
+                triangles.emplace_back(corner, corner + 1, above);
+                triangles.emplace_back(corner + 1, above + 1, above);
+            }
+        }
+
+        const strided_view<glm::vec3> position_view = std::span<const glm::vec3>(positions);
+        const strided_view<glm::uvec3> triangle_view = std::span<const glm::uvec3>(triangles);
+        std::vector<glm::vec3> normals, scatter_normals;
+        const auto measure = [&](auto generate, std::vector<glm::vec3>& result)
+        {
+            auto best = std::numeric_limits<double>::max();
+            for (size_t i = 0; i < repetitions; i++)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                result = generate(position_view, triangle_view);
+                best = std::min(best,
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            return best;
+        };
+        const auto gather_time = measure(generate_unnormalized_normals_gather, normals);
+        const auto scatter_time = measure(generate_unnormalized_normals_scatter, scatter_normals);
+        const auto is_identical =
+            memcmp(normals.data(), scatter_normals.data(), normals.size() * sizeof(glm::vec3)) == 0;
+
+        std::printf("%9zu triangles: gather %8.2lf ms, scatter %8.2lf ms, %.2lfx, %s\n", triangles.size(),
+            gather_time, scatter_time, scatter_time / gather_time, is_identical ? "identical" : "DIFFERENT");
     }
+}
 
-    return glm::vec4(
-        (min + max) / 2.f,
-        2.f / glm::max(max.x - min.x, glm::max(max.y - min.y, max.z - min.z))
-    );
+vk::IndexType get_index_type(size_t vertex_count)
+{
+    return vertex_count <= static_cast<size_t>(UINT16_MAX) + 1 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
 }
 
-static std::shared_ptr<tinyply::PlyData> try_request_properties_from_element(
-    tinyply::PlyFile& ply_file,
-    const std::string& element_key,
-    const std::vector<std::string>& property_keys
-)
+// Indices are relative to the first vertex of their chunk, so the largest chunk decides the index type.
+static vk::IndexType get_chunk_index_type(std::span<const position_chunk> chunks)
 {
-    try
+    uint32_t vertex_count = 0;
+    for (const auto& chunk : chunks)
     {
-        return ply_file.request_properties_from_element(element_key, property_keys);
+        vertex_count = std::max(vertex_count, chunk.vertex_count);
     }
-    catch (...)
+    return get_index_type(vertex_count);
+}
+
+size_t get_index_size(vk::IndexType index_type)
+{
+    switch (index_type)
+    {
+    case vk::IndexType::eUint16:
+        return sizeof(uint16_t);
+    case vk::IndexType::eUint32:
+        return sizeof(uint32_t);
+    default:
+        throw std::runtime_error("Unsupported index type");
+    }
+}
+
+static const vk::DeviceSize STAGING_SLOT_SIZE = 4 * 1024 * 1024;
+static const uint32_t STAGING_SLOT_COUNT = 3;
+
+// The buffers are sources of copies when acceleration structures are built on a queue of another family.
+static std::unique_ptr<buffer> create_model_buffer(vk::Device device, memory_allocator& allocator,
+    vk::BufferUsageFlags usage_flags, vk::DeviceSize size)
+{
+    return std::make_unique<buffer>(device, allocator,
+        usage_flags
+        | vk::BufferUsageFlagBits::eTransferDst
+        | vk::BufferUsageFlagBits::eTransferSrc
+        | vk::BufferUsageFlagBits::eShaderDeviceAddress
+        | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR
+        | vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, size, memory_category::model);
+}
+
+static uint64_t get_model_cache_load_flags(const model_load_options& options)
+{
+    return (options.optimize_mesh ? 1 : 0) | (options.cull_backfaces ? 2 : 0) | (options.generate_lods ? 4 : 0)
+        | (options.compact_vertices ? 8 : 0) | (options.chunk_positions ? 16 : 0)
+        | static_cast<uint64_t>(options.vertex_positions) << 5;
+}
+
+vertex_layout get_vertex_layout(const model_load_options& options)
+{
+    return { options.vertex_positions, options.compact_vertices };
+}
+
+// Creates the buffers of a model whose vertices and indices are streamed from its cache. The vertex and index buffers
+// are pools of slots, and no chunk is resident until the first update.
+static model create_streamed_model(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+    vertex_layout layout, model_cache cache, const model_load_options& options, std::mutex* queue_mutex)
+{
+    const auto vertex_count = cache.vertex_count;
+    const auto index_type = get_chunk_index_type(cache.chunks);
+    auto streamer = std::make_unique<chunk_streamer>(device, allocator, std::move(cache), index_type,
+        options.residency_budget, options.upload_budget);
+    const auto& meshlets = streamer->meshlets;
+    std::vector<lod_level> lods = streamer->get_lods();
+    std::vector<position_chunk> chunks(streamer->get_chunks().begin(), streamer->get_chunks().end());
+
+    auto vertex_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlagBits::eVertexBuffer,
+        streamer->get_vertex_buffer_size());
+    auto index_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlagBits::eIndexBuffer,
+        streamer->get_index_buffer_size());
+    auto meshlet_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlags(),
+        meshlets.size() * sizeof(meshlet));
+    auto chunk_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlags(),
+        chunks.size() * sizeof(position_chunk));
+    auto residency_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlags(),
+        chunks.size() * sizeof(chunk_residency));
+
+    upload_manager uploads(device, allocator, queues.transfer, queues.graphics, STAGING_SLOT_SIZE,
+        STAGING_SLOT_COUNT, queue_mutex);
+    uploads.upload(meshlet_buffer->buf.get(), 0, meshlets.data(), meshlets.size() * sizeof(meshlet));
+    uploads.upload(chunk_buffer->buf.get(), 0, chunks.data(), chunks.size() * sizeof(position_chunk));
+    uploads.upload(residency_buffer->buf.get(), 0, sizeof(chunk_residency), chunks.size(),
+        [&](size_t, size_t count, void* data)
+        {
+            std::fill_n(static_cast<chunk_residency*>(data), count, chunk_residency{ 0, 0, 0, 0 });
+        });
+    uploads.wait_idle();
+
+    std::printf("Model streamed: %u triangles, %zu levels of detail, %zu of %zu position chunks resident, "
+        "%zu-bit indices, %.2lf MB\n", lods[0].index_count / 3, lods.size(), streamer->get_slot_count(),
+        chunks.size(), 8 * get_index_size(index_type), (vertex_buffer->size + index_buffer->size) / (1024. * 1024.));
+    const auto meshlet_count = static_cast<uint32_t>(meshlets.size());
+    const auto index_count = lods[0].index_count;
+    return model(static_cast<uint32_t>(vertex_count), layout, index_count, index_type, std::move(vertex_buffer),
+        std::move(index_buffer), meshlet_count, std::move(meshlet_buffer), std::move(lods), std::move(chunks),
+        std::move(chunk_buffer), std::move(residency_buffer), std::move(streamer));
+}
+
+static void set_progress(model_load_progress* progress, const char* stage, float fraction)
+{
+    if (progress)
     {
-        return nullptr;
+        progress->stage = stage;
+        progress->fraction = fraction;
     }
 }
 
-model read_model(vk::PhysicalDevice physical_device, vk::Device device, vk::CommandPool command_pool, vk::Queue queue,
-    const std::string& path)
+// Uploads the vertices of a PLY file without faces as points. Point clouds aren't cached, since they need no
+// preprocessing beyond quantization.
+static model create_point_cloud(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+    const ply_mesh& mesh, vertex_layout layout, const model_load_options& options, std::mutex* queue_mutex,
+    model_load_progress* progress)
 {
-    std::ifstream stream(path, std::ios_base::binary);
-    tinyply::PlyFile ply_file;
-    ply_file.parse_header(stream);
+    const auto transformation = unitize(mesh.positions);
+    auto positions = mesh.positions;
+    auto colors = mesh.colors;
+    std::vector<glm::vec3> kept_positions;
+    std::vector<glm::u8vec3> kept_colors;
+    if (options.max_points_per_cell > 0)
+    {
+        set_progress(progress, "Decimating points", .25f);
+        const auto start = std::chrono::steady_clock::now();
+        const auto kept = decimate_points(positions, transformation, options.max_points_per_cell);
+        kept_positions.resize(kept.size());
+        kept_colors.resize(colors.empty() ? 0 : kept.size());
+        parallel_for(kept.size(), 1 << 14, [&](size_t first, size_t last)
+            {
+                for (auto i = first; i < last; i++)
+                {
+                    kept_positions[i] = positions[kept[i]];
+                    if (!colors.empty())
+                    {
+                        kept_colors[i] = colors[kept[i]];
+                    }
+                }
+            });
+        positions = std::span<const glm::vec3>(kept_positions);
+        colors = std::span<const glm::u8vec3>(kept_colors);
+        std::printf("Decimated %zu to %zu points in %.2lf ms\n", mesh.positions.size(), kept.size(),
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    const auto point_count = positions.size();
+    auto vertex_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlags(),
+        point_count * sizeof(point_format::vertex));
 
-    auto positionData = ply_file.request_properties_from_element("vertex", { "x", "y", "z" });
-    auto normalData = try_request_properties_from_element(ply_file, "vertex", { "nx", "ny", "nz" });
-    auto colorData = try_request_properties_from_element(ply_file, "vertex", { "red", "green", "blue" });
-    auto indexData = ply_file.request_properties_from_element("face", { "vertex_indices" });
-    ply_file.read(stream);
+    upload_manager uploads(device, allocator, queues.transfer, queues.graphics, STAGING_SLOT_SIZE,
+        STAGING_SLOT_COUNT, queue_mutex);
+    uploads.upload(vertex_buffer->buf.get(), 0, sizeof(point_format::vertex), point_count,
+        [&](size_t first, size_t count, void* data)
+        {
+            set_progress(progress, "Uploading", .5f + .5f * static_cast<float>(first) / point_count);
+            pack_points(positions, colors, transformation, first, count, data);
+        });
+    uploads.wait_idle();
+    set_progress(progress, "Uploading", 1.f);
 
-    assert(positionData->count > 0);
-    std::span positions(reinterpret_cast<float*>(positionData->buffer.get()), 3 * positionData->count);
-    glm::vec4 transformation(unitize(positions));
+    std::printf("Point cloud loaded: %zu points, %.2lf MB\n", point_count, vertex_buffer->size / (1024. * 1024.));
+    return model(static_cast<uint32_t>(point_count), layout, 0, vk::IndexType::eUint32, std::move(vertex_buffer),
+        nullptr, 0, nullptr, {}, {}, nullptr, nullptr);
+}
 
-    assert(indexData->count > 0);
-    std::span indices(reinterpret_cast<uint32_t*>(indexData->buffer.get()), 3 * indexData->count);
+model read_model(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+    const std::string& path, const model_load_options& options, std::mutex* queue_mutex, model_load_progress* progress)
+{
+    const auto report_progress = [&](const char* stage, float fraction)
+    {
+        set_progress(progress, stage, fraction);
+    };
 
+    report_progress("Reading model", 0.f);
+    const auto load_flags = get_model_cache_load_flags(options);
+    const auto layout = get_vertex_layout(options);
+    const auto vertex_size = get_vertex_format_info(layout).size;
+    // hashed at most once, by whichever of opening and writing the cache needs it first
+    auto source_key = get_model_source_key(path);
+    auto cache = try_open_model_cache(path, source_key, load_flags, vertex_size);
+    ply_mesh mesh;
+    std::vector<glm::vec3> generated_normals;
+    strided_view<glm::vec3> normals;
+    glm::vec4 transformation;
+    size_t vertex_count;
+    // consecutive runs of triangles in index buffer order, a single run holds all levels of detail when cached
+    std::vector<strided_view<glm::uvec3>> triangle_runs;
+    std::vector<simplified_lod> simplified_lods;
+    std::vector<lod_level> lods;
+    // positions, normals and colors of the vertices the runs index, which are the chunk vertices if positions are
+    // chunked
+    strided_view<glm::vec3> positions;
+    strided_view<glm::u8vec3> colors;
+    chunked_mesh chunked;
+    std::vector<glm::vec3> chunk_positions;
+    std::vector<glm::vec3> chunk_normals;
+    std::vector<glm::u8vec3> chunk_colors;
+    std::vector<position_chunk> chunks;
+    // the transformation every chunk is packed with, the identity for position chunks that hold their grid steps
+    std::vector<glm::vec4> quantizations;
+    std::vector<meshlet> built_meshlets;
+    std::span<const meshlet> meshlets;
+    std::unique_ptr<model_cache_writer> cache_writer;
 
-    std::vector<float> normals;
-    if (normalData)
+    if (cache)
     {
-        std::span span(reinterpret_cast<float*>(normalData->buffer.get()), 3 * normalData->count);
-        normals.assign(span.begin(), span.end());
+        std::printf("Using model cache %s\n", get_model_cache_path(path).c_str());
+        vertex_count = cache->vertex_count;
+        triangle_runs.push_back(cache->triangles);
+        meshlets = cache->meshlets;
+        lods = cache->lods;
+        chunks.assign(cache->chunks.begin(), cache->chunks.end());
     }
     else
     {
-        normals = generate_unnormalized_normals(positions, indices);
+        mesh = read_ply(path);
+        assert(mesh.positions.size() > 0);
+        if (mesh.triangles.empty())
+        {
+            return create_point_cloud(device, allocator, queues, mesh, layout, options, queue_mutex, progress);
+        }
+
+        if (options.optimize_mesh)
+        {
+            report_progress("Optimizing mesh", .15f);
+            optimize_mesh(mesh);
+        }
+
+        transformation = unitize(mesh.positions);
+
+        normals = mesh.normals;
+        if (normals.empty())
+        {
+            const auto start = std::chrono::steady_clock::now();
+            generated_normals = generate_unnormalized_normals(mesh.positions, mesh.triangles);
+            normals = std::span<const glm::vec3>(generated_normals);
+            std::printf("Generated normals in %.2lf ms\n",
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        vertex_count = mesh.positions.size();
+        triangle_runs.push_back(mesh.triangles);
+
+        if (options.generate_lods)
+        {
+            report_progress("Generating levels of detail", .25f);
+            const auto start = std::chrono::steady_clock::now();
+            simplified_lods = build_lod_chain(mesh.positions, transformation, mesh.triangles);
+            std::printf("Generated %zu levels of detail in %.2lf ms\n", simplified_lods.size(),
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            for (const auto& lod : simplified_lods)
+            {
+                triangle_runs.push_back(std::span<const glm::uvec3>(lod.triangles));
+            }
+        }
+
+        positions = mesh.positions;
+        colors = mesh.colors;
+        if (options.chunk_positions)
+        {
+            report_progress("Splitting position chunks", .35f);
+            const auto start = std::chrono::steady_clock::now();
+            chunked = split_position_chunks(mesh.positions, transformation, triangle_runs);
+            vertex_count = chunked.source_vertices.size();
+            chunk_positions.resize(vertex_count);
+            chunk_normals.resize(vertex_count);
+            chunk_colors.resize(colors.empty() ? 0 : vertex_count);
+            parallel_for(vertex_count, 1 << 14, [&](size_t first, size_t last)
+                {
+                    for (auto i = first; i < last; i++)
+                    {
+                        const auto source = chunked.source_vertices[i];
+                        chunk_positions[i] = mesh.positions[source];
+                        chunk_normals[i] = normals[source];
+                        if (!colors.empty())
+                        {
+                            chunk_colors[i] = colors[source];
+                        }
+                    }
+                });
+            positions = std::span<const glm::vec3>(chunk_positions);
+            normals = std::span<const glm::vec3>(chunk_normals);
+            colors = std::span<const glm::u8vec3>(chunk_colors);
+
+            chunks = chunked.chunks;
+            triangle_runs.clear();
+            for (const auto& run : chunked.runs)
+            {
+                triangle_runs.push_back(std::span<const glm::uvec3>(run));
+            }
+            std::printf("Split positions into %zu chunks in %.2lf ms\n", chunks.size(),
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        else
+        {
+            // a single chunk that is quantized against the whole model and needs no dequantization
+            chunks.push_back({
+                glm::vec4(0.f, 0.f, 0.f, 1.f),
+                0,
+                static_cast<uint32_t>(vertex_count),
+                0,
+                static_cast<uint32_t>(3 * triangle_runs[0].size())
+            });
+            quantizations.push_back(transformation);
+            for (const auto& run : triangle_runs)
+            {
+                chunked.chunk_triangle_counts.push_back({ static_cast<uint32_t>(run.size()) });
+            }
+        }
+
+        report_progress("Building meshlets", .4f);
+        // every level and chunk gets its own meshlets, so the cull shader can pick a level per meshlet and the vertex
+        // shader knows how to dequantize their positions
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<uint32_t> chunk_first_vertices(chunks.size());
+        std::transform(chunks.begin(), chunks.end(), chunk_first_vertices.begin(), [](const position_chunk& chunk)
+            {
+                return chunk.first_vertex;
+            });
+        for (size_t i = 0; i < triangle_runs.size(); i++)
+        {
+            const auto first_index = lods.empty() ? 0 : lods.back().first_index + lods.back().index_count;
+            const auto& chunk_triangle_counts = chunked.chunk_triangle_counts[i];
+            auto level_meshlets = build_meshlets(positions, transformation, triangle_runs[i],
+                options.cull_backfaces, chunk_triangle_counts, chunk_first_vertices);
+            uint32_t chunk = 0;
+            uint32_t chunk_end = 3 * chunk_triangle_counts[0];
+            for (auto& m : level_meshlets)
+            {
+                while (m.first_index >= chunk_end)
+                {
+                    chunk_end += 3 * chunk_triangle_counts[++chunk];
+                }
+                m.first_index += first_index;
+                m.lod = static_cast<uint32_t>(i);
+                m.chunk = chunk;
+            }
+
+            lods.push_back({
+                first_index,
+                static_cast<uint32_t>(3 * triangle_runs[i].size()),
+                static_cast<uint32_t>(built_meshlets.size()),
+                static_cast<uint32_t>(level_meshlets.size()),
+                i == 0 ? 0.f : simplified_lods[i - 1].error
+            });
+            built_meshlets.insert(built_meshlets.end(), level_meshlets.begin(), level_meshlets.end());
+        }
+        meshlets = built_meshlets;
+        std::printf("Built %zu meshlets in %.2lf ms\n", meshlets.size(),
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        if (options.chunk_positions)
+        {
+            // replaces the chunk positions with their steps on the grid, after the meshlet bounds were computed
+            quantize_position_chunks(chunk_positions, transformation, layout.position, chunks);
+            quantizations.assign(chunks.size(), glm::vec4(0.f, 0.f, 0.f, 1.f));
+        }
+
+        cache_writer = std::make_unique<model_cache_writer>(path, source_key, load_flags, vertex_count, vertex_size,
+            (lods.back().first_index + lods.back().index_count) / 3, meshlets.size(), chunks.size(), transformation,
+            lods);
     }
 
-    std::vector<uint8_t> colors(3 * positionData->count, UINT8_MAX);
-    if (colorData)
+    // Chunks are packed into ordinary memory first, since staging memory may be uncached and the chunk is read
+    // back to write the model cache.
+    std::vector<uint8_t> packed_vertices;
+    size_t packed_chunk = 0;
+    const auto pack_vertex_range = [&](size_t first, size_t count)
+    {
+        packed_vertices.resize(count * vertex_size);
+        for (size_t packed = 0; packed < count;)
+        {
+            const auto v = first + packed;
+            while (chunks[packed_chunk].first_vertex + chunks[packed_chunk].vertex_count <= v)
+            {
+                packed_chunk++;
+            }
+            const auto chunk_end = chunks[packed_chunk].first_vertex + chunks[packed_chunk].vertex_count;
+            const auto packed_count = std::min(count - packed, chunk_end - v);
+            auto* packed_data = packed_vertices.data() + packed * vertex_size;
+            pack_vertices(positions, normals, colors, quantizations[packed_chunk], v, packed_count, layout,
+                packed_data);
+            packed += packed_count;
+        }
+        cache_writer->write_vertices(packed_vertices.data(), count);
+    };
+    const auto finish_cache = [&]()
+    {
+        for (const auto& triangles : triangle_runs)
+        {
+            cache_writer->write_triangles(triangles);
+        }
+        cache_writer->write_meshlets(meshlets);
+        cache_writer->write_chunks(chunks);
+        cache_writer->commit();
+    };
+
+    if (options.residency_budget > 0)
     {
-        std::span span(colorData->buffer.get(), 3 * colorData->count);
-        colors.assign(span.begin(), span.end());
+        // the cache file is where the chunks are streamed from
+        if (!cache)
+        {
+            report_progress("Writing model cache", .5f);
+            const auto block_vertex_count = STAGING_SLOT_SIZE / vertex_size;
+            for (size_t first = 0; first < vertex_count; first += block_vertex_count)
+            {
+                pack_vertex_range(first, std::min(block_vertex_count, vertex_count - first));
+            }
+            finish_cache();
+            cache = try_open_model_cache(path, source_key, load_flags, vertex_size);
+            if (!cache)
+            {
+                throw std::runtime_error("Failed to write the model cache the model is streamed from");
+            }
+        }
+        return create_streamed_model(device, allocator, queues, layout, std::move(*cache), options,
+            queue_mutex);
     }
 
-    buffer vertex_buffer(physical_device, device, vk::BufferUsageFlagBits::eTransferSrc, HOST_VISIBLE_AND_COHERENT,
-        positionData->count * sizeof(vertex));
-    auto* vertices = static_cast<vertex*>(device.mapMemory(vertex_buffer.memory.get(), 0, vertex_buffer.size));
-    for (uint32_t i = 0; i < positionData->count; i++)
+    const auto index_count = lods.back().first_index + lods.back().index_count;
+    const auto index_type = get_chunk_index_type(chunks);
+    const auto index_size = get_index_size(index_type);
+    auto vertex_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlagBits::eVertexBuffer,
+        vertex_count * vertex_size);
+    // the size is rounded up to whole 32-bit words, since the ray tracing shaders read 16-bit indices in pairs
+    auto index_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlagBits::eIndexBuffer,
+        (index_count * index_size + 3) / 4 * 4);
+    auto meshlet_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlags(),
+        meshlets.size_bytes());
+    auto chunk_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlags(),
+        chunks.size() * sizeof(position_chunk));
+    auto residency_buffer = create_model_buffer(device, allocator, vk::BufferUsageFlags(),
+        chunks.size() * sizeof(chunk_residency));
+
+    const auto upload_size = vertex_count * vertex_size + index_count * index_size + meshlets.size_bytes()
+        + chunks.size() * (sizeof(position_chunk) + sizeof(chunk_residency));
+    const auto first_upload_fraction = cache ? 0.f : .5f;
+    size_t uploaded_size = 0;
+    const auto report_upload = [&](size_t size)
     {
-        vertices[i].position = r16g16b16_snorm(
-            (positions[3 * i] - transformation.x) * transformation.w,
-            (positions[3 * i + 1] - transformation.y) * transformation.w,
-            (positions[3 * i + 2] - transformation.z) * transformation.w
-        );
+        report_progress("Uploading", first_upload_fraction + (1.f - first_upload_fraction)
+            * static_cast<float>(uploaded_size) / static_cast<float>(upload_size));
+        uploaded_size += size;
+    };
 
-        auto unnormalized_normal = glm::vec3(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
-        auto normal = length(unnormalized_normal) > 1.e-10f
-            ? normalize(unnormalized_normal)
-            : unnormalized_normal;
+    upload_manager uploads(device, allocator, queues.transfer, queues.graphics, STAGING_SLOT_SIZE,
+        STAGING_SLOT_COUNT, queue_mutex);
+    uploads.upload(vertex_buffer->buf.get(), 0, vertex_size, vertex_count,
+        [&](size_t first, size_t count, void* data)
+        {
+            report_upload(count * vertex_size);
+            if (cache)
+            {
+                memcpy(data, cache->vertex_data.data() + first * vertex_size, count * vertex_size);
+                return;
+            }
 
-        vertices[i].normal = r16g16b16_snorm(normal.x, normal.y, normal.z);
-        vertices[i].color = glm::u8vec3(colors[3 * i], colors[3 * i + 1], colors[3 * i + 2]);
+            pack_vertex_range(first, count);
+            memcpy(data, packed_vertices.data(), count * vertex_size);
+        });
+
+    size_t first_triangle = 0;
+    for (const auto& triangles : triangle_runs)
+    {
+        uploads.upload(index_buffer->buf.get(), first_triangle * 3 * index_size, 3 * index_size, triangles.size(),
+            [&](size_t first, size_t count, void* data)
+            {
+                report_upload(3 * count * index_size);
+                pack_indices(triangles, first, count, index_type, data);
+            });
+        first_triangle += triangles.size();
+    }
+
+    uploads.upload(meshlet_buffer->buf.get(), 0, sizeof(meshlet), meshlets.size(),
+        [&](size_t first, size_t count, void* data)
+        {
+            report_upload(count * sizeof(meshlet));
+            memcpy(data, meshlets.data() + first, count * sizeof(meshlet));
+        });
+
+    uploads.upload(chunk_buffer->buf.get(), 0, sizeof(position_chunk), chunks.size(),
+        [&](size_t first, size_t count, void* data)
+        {
+            report_upload(count * sizeof(position_chunk));
+            memcpy(data, chunks.data() + first, count * sizeof(position_chunk));
+        });
+
+    // every chunk is resident where the meshlets expect it, its indices are relative to its first vertex
+    uploads.upload(residency_buffer->buf.get(), 0, sizeof(chunk_residency), chunks.size(),
+        [&](size_t first, size_t count, void* data)
+        {
+            report_upload(count * sizeof(chunk_residency));
+            auto* residencies = static_cast<chunk_residency*>(data);
+            for (size_t i = 0; i < count; i++)
+            {
+                residencies[i] = { 0, static_cast<int32_t>(chunks[first + i].first_vertex), 1, 0 };
+            }
+        });
+
+    if (cache_writer)
+    {
+        finish_cache();
     }
-    device.unmapMemory(vertex_buffer.memory.get());
-    auto device_vertex_buffer = vertex_buffer.copy_from_host_to_device_for_vertex_input(
-        physical_device, device,
-        vk::BufferUsageFlagBits::eVertexBuffer
-        | vk::BufferUsageFlagBits::eTransferDst
-        | vk::BufferUsageFlagBits::eShaderDeviceAddress
-        | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR
-        | vk::BufferUsageFlagBits::eStorageBuffer
-        , command_pool, queue
-    );
-
-    buffer index_buffer(physical_device, device, vk::BufferUsageFlagBits::eTransferSrc, HOST_VISIBLE_AND_COHERENT,
-        indices.size() * sizeof(*indices.data()));
-    memcpy(device.mapMemory(index_buffer.memory.get(), 0, index_buffer.size), indices.data(),
-        indices.size() * sizeof(*indices.data()));
-    device.unmapMemory(index_buffer.memory.get());
-    auto device_index_buffer = index_buffer.copy_from_host_to_device_for_vertex_input(
-        physical_device, device,
-        vk::BufferUsageFlagBits::eIndexBuffer
-        | vk::BufferUsageFlagBits::eTransferDst
-        | vk::BufferUsageFlagBits::eShaderDeviceAddress
-        | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR
-        | vk::BufferUsageFlagBits::eStorageBuffer
-        , command_pool, queue
-    );
 
-    queue.waitIdle();
+    uploads.wait_idle();
+    report_progress("Uploading", 1.f);
 
-    std::printf("Model loaded: %llu triangles, %.2lf MB\n", positionData->count / 3,
-        (vertex_buffer.size + index_buffer.size) / (1024. * 1024.));
-    return model(static_cast<uint32_t>(positionData->count), static_cast<uint32_t>(indices.size()), std::move(device_vertex_buffer),
-        std::move(device_index_buffer));
+    std::printf("Model loaded: %u triangles, %zu levels of detail, %zu position chunks, %zu-bit indices, %.2lf MB\n",
+        lods[0].index_count / 3, lods.size(), chunks.size(), 8 * index_size,
+        (vertex_buffer->size + index_buffer->size) / (1024. * 1024.));
+    return model(static_cast<uint32_t>(vertex_count), layout, lods[0].index_count, index_type,
+        std::move(vertex_buffer), std::move(index_buffer), static_cast<uint32_t>(meshlets.size()),
+        std::move(meshlet_buffer), std::move(lods), std::move(chunks), std::move(chunk_buffer),
+        std::move(residency_buffer));
 }
@@ -1,20 +1,101 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <vulkan/vulkan.hpp>
 #include "buffer.h"
+#include "chunk_streamer.h"
+#include "data_types.h"
+#include "mesh_simplifier.h"
+#include "position_chunks.h"
+#include "vertex_format.h"
+#include "vulkan_context.h"
 
 struct model
 {
+    // indices of the full resolution mesh, coarser levels of detail follow them in the index buffer
     uint32_t index_count;
     uint32_t vertex_count;
+    vertex_layout layout;
+    vk::IndexType index_type;
     std::unique_ptr<buffer> vertex_buffer;
     std::unique_ptr<buffer> index_buffer;
+    uint32_t meshlet_count;
+    std::unique_ptr<buffer> meshlet_buffer;
+    std::vector<lod_level> lods;
+    std::vector<position_chunk> chunks;
+    std::unique_ptr<buffer> chunk_buffer;
+    // a chunk_residency per position chunk, all chunks are resident unless the model is streamed
+    std::unique_ptr<buffer> residency_buffer;
+    // set if the vertex and index buffers only hold the chunks that fit into the residency budget
+    std::unique_ptr<chunk_streamer> streamer;
 
-    model(uint32_t vertex_count, uint32_t index_count, std::unique_ptr<buffer> vertex_buffer,
-        std::unique_ptr<buffer> index_buffer);
-    void draw(vk::CommandBuffer command_buffer) const;
+    model(uint32_t vertex_count, vertex_layout layout, uint32_t index_count, vk::IndexType index_type,
+        std::unique_ptr<buffer> vertex_buffer, std::unique_ptr<buffer> index_buffer, uint32_t meshlet_count,
+        std::unique_ptr<buffer> meshlet_buffer, std::vector<lod_level> lods, std::vector<position_chunk> chunks,
+        std::unique_ptr<buffer> chunk_buffer, std::unique_ptr<buffer> residency_buffer,
+        std::unique_ptr<chunk_streamer> streamer = nullptr);
+    // Point clouds only have a vertex buffer of point_format points, which are splatted instead of drawn.
+    bool is_point_cloud() const;
+    // Draws draw_count indexed indirect commands, one per meshlet.
+    void draw(vk::CommandBuffer command_buffer, vk::Buffer draw_command_buffer, uint32_t draw_count,
+        uint32_t max_draw_count) const;
+    // Draws the commands the cull shader appended, as many as draw_count_buffer holds and at most max_draw_count.
+    // Requires VK_KHR_draw_indirect_count.
+    void draw_counted(vk::CommandBuffer command_buffer, vk::Buffer draw_command_buffer, vk::Buffer draw_count_buffer,
+        uint32_t max_draw_count) const;
+    // Number of meshlets of the level of detail with the most meshlets, which bounds the draws of a frame.
+    uint32_t get_max_lod_meshlet_count() const;
+    // Streams the chunks the camera needs into the buffers of a streamed model, see chunk_streamer::update. Returns
+    // false if nothing was uploaded, which is always the case if the model isn't streamed.
+    bool update_residency(vk::Queue queue, const model_uniform_data& camera);
 };
 
-model read_model(vk::PhysicalDevice physical_device, vk::Device device, vk::CommandPool command_pool, vk::Queue queue,
-    const std::string& path);
+// Returns the smallest index type that can address vertex_count vertices.
+vk::IndexType get_index_type(size_t vertex_count);
+size_t get_index_size(vk::IndexType index_type);
+
+struct model_load_options
+{
+    bool optimize_mesh;
+    // Computes normal cones so meshlets facing away from the camera are culled. Back faces are visible through holes
+    // in open meshes, so this is only correct for closed ones.
+    bool cull_backfaces;
+    // Adds simplified levels of detail that are selected by their projected error on screen.
+    bool generate_lods;
+    // Stores vertices in the compact layout with octahedral normals.
+    bool compact_vertices;
+    // Trades the precision of positions for bandwidth, 16-bit snorm positions are the default.
+    position_format vertex_positions;
+    // Quantizes positions relative to spatial chunks instead of the whole model, for more precision on large meshes.
+    bool chunk_positions;
+    // Streams position chunks from the model cache into this many bytes of vertex and index memory if not 0, so the
+    // model doesn't have to fit into device memory. Requires chunk_positions.
+    size_t residency_budget;
+    // Maximum number of bytes uploaded per update of a streamed model, at least one chunk is uploaded.
+    size_t upload_budget;
+    // Thins point clouds to about this many points per cell of a grid over the model if not 0, see decimate_points.
+    uint32_t max_points_per_cell;
+};
+
+vertex_layout get_vertex_layout(const model_load_options& options);
+
+// Progress of read_model, which is written by the loading thread and may be read by any other.
+struct model_load_progress
+{
+    std::atomic<const char*> stage;
+    // in [0, 1], preprocessing a model that isn't cached takes the first half and uploading it the rest
+    std::atomic<float> fraction;
+};
+
+// Buffers are uploaded on the transfer queue and owned by the graphics queue afterwards. queue_mutex is held while
+// submitting to the queues, so they can be shared with a render loop on another thread.
+model read_model(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+    const std::string& path, const model_load_options& options, std::mutex* queue_mutex = nullptr,
+    model_load_progress* progress = nullptr);
+
+// Prints how long the parallel gather and the sequential scatter over all triangles take to generate the normals of
+// meshes without them, for grids of 1 to 30 million triangles. Models are loaded with the gather only if there are
+// enough hardware threads for it to win.
+void benchmark_normal_generation();
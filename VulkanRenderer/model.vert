@@ -6,6 +6,24 @@ layout(set = 0, binding = 0, std140) uniform ub
     mat4 modelView;
 };
 
+// the compact vertex layout stores an octahedral normal in the first two components
+layout(constant_id = 0) const bool OCTAHEDRAL_NORMALS = false;
+
+struct PositionChunk
+{
+    vec4 dequantization;
+    uint firstVertex;
+    uint vertexCount;
+    uint firstIndex;
+    uint indexCount;
+};
+
+// the cull shader passes the chunk of every meshlet as its first instance
+layout(set = 0, binding = 1, std430) readonly buffer cb
+{
+    PositionChunk chunks[];
+};
+
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec3 vertexColor;
@@ -14,10 +32,24 @@ layout(location = 0) out vec3 position;
 layout(location = 1) out vec3 normal;
 layout(location = 2) out vec3 color;
 
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 void main()
 {
-    gl_Position = projection * modelView * vec4(vertexPosition, 1.0);
-    position = vec3(modelView * vec4(vertexPosition, 1.0));
-    normal = vec3(modelView * vec4(vertexNormal, 0.0));
+    vec4 dequantization = chunks[gl_InstanceIndex].dequantization;
+    // not fused, so vertices shared by position chunks land on the same grid point in each of them
+    precise vec3 objectPosition = vertexPosition * dequantization.w + dequantization.xyz;
+    vec3 objectNormal = OCTAHEDRAL_NORMALS ? decodeOctahedral(vertexNormal.xy) : vertexNormal;
+
+    gl_Position = projection * modelView * vec4(objectPosition, 1.0);
+    position = vec3(modelView * vec4(objectPosition, 1.0));
+    normal = vec3(modelView * vec4(objectNormal, 0.0));
     color = vertexColor;
 }
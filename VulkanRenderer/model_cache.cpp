@@ -0,0 +1,280 @@
+#include "stdafx.h"
+#include "model_cache.h"
+
+#include <filesystem>
+
+static const char MODEL_CACHE_MAGIC[4] = { 'V', 'R', 'M', 'C' };
+
+// 64-bit FNV-1a over 8 byte words, interleaved over four lanes so the multiplications don't form a single chain.
+static uint64_t hash_file(const std::string& path)
+{
+    const mapped_file file(path);
+    const auto data = file.data();
+    const uint64_t prime = 0x100000001b3ull;
+    std::array<uint64_t, 4> lanes{
+        0xcbf29ce484222325ull, 0x84222325cbf29ce4ull, 0xcbf29ce4cbf29ce4ull, 0x8422232584222325ull
+    };
+
+    const auto word_count = data.size() / sizeof(uint64_t);
+    for (size_t i = 0; i < word_count; i++)
+    {
+        uint64_t word;
+        memcpy(&word, data.data() + i * sizeof(uint64_t), sizeof(word));
+        lanes[i % lanes.size()] = (lanes[i % lanes.size()] ^ word) * prime;
+    }
+
+    auto hash = static_cast<uint64_t>(data.size());
+    for (auto i = word_count * sizeof(uint64_t); i < data.size(); i++)
+    {
+        hash = (hash ^ data[i]) * prime;
+    }
+    for (const auto lane : lanes)
+    {
+        hash = (hash ^ lane) * prime;
+    }
+    return hash;
+}
+
+static uint64_t get_source_hash(const std::string& model_path, model_source_key& source_key)
+{
+    if (!source_key.hash)
+    {
+        source_key.hash = hash_file(model_path);
+    }
+    return *source_key.hash;
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+    const uint64_t alignment = 16;
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+std::string get_model_cache_path(const std::string& model_path)
+{
+    return model_path + ".vrcache";
+}
+
+model_source_key get_model_source_key(const std::string& model_path)
+{
+    return {
+        std::filesystem::file_size(model_path),
+        std::filesystem::last_write_time(model_path).time_since_epoch().count(),
+        std::nullopt
+    };
+}
+
+std::optional<model_cache> try_open_model_cache(const std::string& model_path, model_source_key& source_key,
+    uint64_t load_flags, size_t vertex_size)
+{
+    const auto cache_path = get_model_cache_path(model_path);
+    if (!std::filesystem::exists(cache_path))
+    {
+        return std::nullopt;
+    }
+
+    auto file = std::make_unique<mapped_file>(cache_path);
+    const auto data = file->data();
+    if (data.size() < sizeof(model_cache_header))
+    {
+        return std::nullopt;
+    }
+
+    model_cache_header header;
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, MODEL_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != MODEL_CACHE_VERSION
+        || header.load_flags != load_flags
+        || header.vertex_size != vertex_size
+        || header.lod_count == 0
+        || header.lod_count > MAX_LOD_COUNT
+        || header.vertex_offset + header.vertex_count * header.vertex_size > data.size()
+        || header.index_offset + header.index_count * sizeof(uint32_t) > data.size()
+        || header.meshlet_offset + header.meshlet_count * sizeof(meshlet) > data.size()
+        || header.chunk_count == 0
+        || header.chunk_offset + header.chunk_count * sizeof(position_chunk) > data.size())
+    {
+        return std::nullopt;
+    }
+
+    for (uint32_t i = 0; i < header.lod_count; i++)
+    {
+        const auto& lod = header.lods[i];
+        if (static_cast<uint64_t>(lod.first_index) + lod.index_count > header.index_count
+            || static_cast<uint64_t>(lod.first_meshlet) + lod.meshlet_count > header.meshlet_count)
+        {
+            return std::nullopt;
+        }
+    }
+
+    if (header.source_size != source_key.size
+        || header.source_time != source_key.time
+        || header.source_hash != get_source_hash(model_path, source_key))
+    {
+        return std::nullopt;
+    }
+
+    model_cache cache;
+    cache.transformation = glm::vec4(header.transformation[0], header.transformation[1], header.transformation[2],
+        header.transformation[3]);
+    cache.vertex_count = header.vertex_count;
+    cache.vertex_data = data.subspan(header.vertex_offset, header.vertex_count * header.vertex_size);
+    cache.triangles = strided_view<glm::uvec3>(data.data() + header.index_offset, header.index_count / 3,
+        sizeof(glm::uvec3));
+    cache.meshlets = std::span(reinterpret_cast<const meshlet*>(data.data() + header.meshlet_offset),
+        header.meshlet_count);
+    cache.lods.assign(header.lods, header.lods + header.lod_count);
+    cache.chunks = std::span(reinterpret_cast<const position_chunk*>(data.data() + header.chunk_offset),
+        header.chunk_count);
+    cache.file = std::move(file);
+    return cache;
+}
+
+model_cache_writer::model_cache_writer(const std::string& model_path, model_source_key& source_key,
+    uint64_t load_flags, size_t vertex_count, size_t vertex_size, size_t triangle_count, size_t meshlet_count,
+    size_t chunk_count, const glm::vec4& transformation, std::span<const lod_level> lods)
+    : cache_path(get_model_cache_path(model_path)), temporary_path(cache_path + ".tmp"), header{},
+    written_vertex_count(0), written_index_count(0), written_meshlet_count(0), written_chunk_count(0),
+    is_committed(false)
+{
+    memcpy(header.magic, MODEL_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_CACHE_VERSION;
+    header.source_size = source_key.size;
+    header.source_time = source_key.time;
+    header.source_hash = get_source_hash(model_path, source_key);
+    header.load_flags = load_flags;
+    header.vertex_count = vertex_count;
+    header.vertex_size = vertex_size;
+    header.index_count = 3 * triangle_count;
+    for (auto i = 0; i < 4; i++)
+    {
+        header.transformation[i] = transformation[i];
+    }
+    header.vertex_offset = align_offset(sizeof(header));
+    header.index_offset = align_offset(header.vertex_offset + vertex_count * vertex_size);
+    header.meshlet_count = meshlet_count;
+    header.meshlet_offset = align_offset(header.index_offset + header.index_count * sizeof(uint32_t));
+    header.chunk_count = chunk_count;
+    header.chunk_offset = align_offset(header.meshlet_offset + meshlet_count * sizeof(meshlet));
+    assert(!lods.empty() && lods.size() <= MAX_LOD_COUNT);
+    header.lod_count = static_cast<uint32_t>(lods.size());
+    std::copy(lods.begin(), lods.end(), header.lods);
+
+    stream.open(temporary_path, std::ios_base::binary | std::ios_base::trunc);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_padding(header.vertex_offset);
+}
+
+model_cache_writer::~model_cache_writer()
+{
+    if (!is_committed)
+    {
+        stream.close();
+        std::error_code error;
+        std::filesystem::remove(temporary_path, error);
+    }
+}
+
+void model_cache_writer::write_padding(uint64_t offset)
+{
+    const std::array<char, 16> padding{};
+    const auto position = static_cast<uint64_t>(stream.tellp());
+    assert(!stream || (position <= offset && offset - position <= padding.size()));
+    if (stream)
+    {
+        stream.write(padding.data(), offset - position);
+    }
+}
+
+void model_cache_writer::write_vertices(const void* vertices, size_t count)
+{
+    assert(written_index_count == 0);
+    assert(written_vertex_count + count <= header.vertex_count);
+
+    stream.write(static_cast<const char*>(vertices), count * header.vertex_size);
+    written_vertex_count += count;
+}
+
+void model_cache_writer::write_triangles(const strided_view<glm::uvec3>& triangles)
+{
+    assert(written_vertex_count == header.vertex_count);
+    assert(written_meshlet_count == 0);
+    assert(written_index_count + 3 * triangles.size() <= header.index_count);
+
+    if (written_index_count == 0)
+    {
+        write_padding(header.index_offset);
+    }
+
+    if (triangles.is_contiguous())
+    {
+        stream.write(reinterpret_cast<const char*>(triangles.data), triangles.size() * sizeof(glm::uvec3));
+    }
+    else
+    {
+        std::vector<glm::uvec3> block;
+        const size_t block_size = 1 << 16;
+        for (size_t first = 0; first < triangles.size(); first += block_size)
+        {
+            block.resize(std::min(block_size, triangles.size() - first));
+            for (size_t i = 0; i < block.size(); i++)
+            {
+                block[i] = triangles[first + i];
+            }
+            stream.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(glm::uvec3));
+        }
+    }
+    written_index_count += 3 * triangles.size();
+}
+
+void model_cache_writer::write_meshlets(std::span<const meshlet> meshlets)
+{
+    assert(written_index_count == header.index_count);
+    assert(written_meshlet_count + meshlets.size() <= header.meshlet_count);
+
+    if (written_meshlet_count == 0)
+    {
+        write_padding(header.meshlet_offset);
+    }
+
+    stream.write(reinterpret_cast<const char*>(meshlets.data()), meshlets.size_bytes());
+    written_meshlet_count += meshlets.size();
+}
+
+void model_cache_writer::write_chunks(std::span<const position_chunk> chunks)
+{
+    assert(written_meshlet_count == header.meshlet_count);
+    assert(written_chunk_count + chunks.size() <= header.chunk_count);
+
+    if (written_chunk_count == 0)
+    {
+        write_padding(header.chunk_offset);
+    }
+
+    stream.write(reinterpret_cast<const char*>(chunks.data()), chunks.size_bytes());
+    written_chunk_count += chunks.size();
+}
+
+void model_cache_writer::commit()
+{
+    assert(written_vertex_count == header.vertex_count);
+    assert(written_index_count == header.index_count);
+    assert(written_meshlet_count == header.meshlet_count);
+    assert(written_chunk_count == header.chunk_count);
+
+    stream.close();
+    if (!stream)
+    {
+        std::printf("Could not write model cache %s\n", cache_path.c_str());
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path, cache_path, error);
+    if (error)
+    {
+        std::printf("Could not write model cache %s\n", cache_path.c_str());
+        return;
+    }
+    is_committed = true;
+}
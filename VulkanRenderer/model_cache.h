@@ -0,0 +1,103 @@
+#pragma once
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include "data_types.h"
+#include "mapped_file.h"
+#include "mesh_simplifier.h"
+#include "meshlet.h"
+#include "position_chunks.h"
+#include "ply_reader.h"
+
+#define MODEL_CACHE_VERSION 8u
+
+// Layout of a cache file: this header followed by the vertex, index, meshlet and position chunk arrays at the given
+// offsets. The index and meshlet arrays hold all levels of detail back to back. The BLAS section is reserved for a
+// serialized bottom level acceleration structure and is currently always empty.
+struct model_cache_header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_time;
+    uint64_t source_hash;
+    // model_load_options that affect the cached data
+    uint64_t load_flags;
+    uint64_t vertex_count;
+    uint64_t vertex_size;
+    uint64_t index_count;
+    float transformation[4];
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t meshlet_count;
+    uint64_t meshlet_offset;
+    uint64_t chunk_count;
+    uint64_t chunk_offset;
+    uint64_t blas_offset;
+    uint64_t blas_size;
+    uint32_t lod_count;
+    lod_level lods[MAX_LOD_COUNT];
+};
+
+struct model_cache
+{
+    std::unique_ptr<mapped_file> file;
+    glm::vec4 transformation;
+    size_t vertex_count;
+    // packed vertices in the layout selected by the load flags
+    std::span<const uint8_t> vertex_data;
+    strided_view<glm::uvec3> triangles;
+    std::span<const meshlet> meshlets;
+    std::vector<lod_level> lods;
+    std::span<const position_chunk> chunks;
+};
+
+// Identifies the version of the source model a cache was built from. Hashing reads the whole model, so the hash is
+// only computed once it's needed: when the size and write time match a cache, or when a new cache is written.
+struct model_source_key
+{
+    uint64_t size;
+    int64_t time;
+    std::optional<uint64_t> hash;
+};
+
+std::string get_model_cache_path(const std::string& model_path);
+// Returns the size and write time of the model, without its hash.
+model_source_key get_model_source_key(const std::string& model_path);
+// Hashes the model into source_key if its size and write time match the cache.
+std::optional<model_cache> try_open_model_cache(const std::string& model_path, model_source_key& source_key,
+    uint64_t load_flags, size_t vertex_size);
+
+// Writes a cache file incrementally, so vertices can be stored chunk by chunk as they are packed. Vertices have to be
+// written before triangles, triangles before meshlets and meshlets before position chunks. The file only replaces an
+// existing cache once commit succeeds.
+class model_cache_writer
+{
+    std::string cache_path;
+    std::string temporary_path;
+    std::ofstream stream;
+    model_cache_header header;
+    uint64_t written_vertex_count;
+    uint64_t written_index_count;
+    uint64_t written_meshlet_count;
+    uint64_t written_chunk_count;
+    bool is_committed;
+
+    void write_padding(uint64_t offset);
+
+public:
+    // Hashes the model into source_key unless it already has been.
+    model_cache_writer(const std::string& model_path, model_source_key& source_key, uint64_t load_flags,
+        size_t vertex_count, size_t vertex_size, size_t triangle_count, size_t meshlet_count, size_t chunk_count,
+        const glm::vec4& transformation, std::span<const lod_level> lods);
+    model_cache_writer(const model_cache_writer&) = delete;
+    model_cache_writer& operator=(const model_cache_writer&) = delete;
+    ~model_cache_writer();
+
+    void write_vertices(const void* vertices, size_t count);
+    void write_triangles(const strided_view<glm::uvec3>& triangles);
+    void write_meshlets(std::span<const meshlet> meshlets);
+    void write_chunks(std::span<const position_chunk> chunks);
+    void commit();
+};
@@ -0,0 +1,55 @@
+#include "stdafx.h"
+#include "model_loader.h"
+
+model_loader::model_loader(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+    std::mutex* queue_mutex, const std::string& path, const model_load_options& options)
+    : progress{ "", 0.f }, is_done(false), path(path)
+{
+    thread = std::thread([=, this, &allocator]()
+        {
+            try
+            {
+                loaded_model.emplace(read_model(device, allocator, queues, path, options, queue_mutex,
+                    &progress));
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            is_done = true;
+        });
+}
+
+model_loader::~model_loader()
+{
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+bool model_loader::is_finished() const
+{
+    return is_done;
+}
+
+const char* model_loader::get_stage() const
+{
+    return progress.stage;
+}
+
+float model_loader::get_fraction() const
+{
+    return progress.fraction;
+}
+
+model model_loader::get()
+{
+    assert(is_done);
+    thread.join();
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    return std::move(*loaded_model);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vulkan/vulkan.hpp>
+#include "model.h"
+
+// Reads a model on a worker thread, so the render loop keeps running while it is preprocessed and uploaded. The
+// queues are shared with the render loop, which has to hold queue_mutex while using them.
+class model_loader
+{
+    model_load_progress progress;
+    std::optional<model> loaded_model;
+    std::exception_ptr error;
+    std::atomic<bool> is_done;
+    std::thread thread;
+
+public:
+    const std::string path;
+
+    model_loader(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+        std::mutex* queue_mutex, const std::string& path, const model_load_options& options);
+    model_loader(const model_loader&) = delete;
+    model_loader& operator=(const model_loader&) = delete;
+    ~model_loader();
+
+    // True once the buffers of the model are uploaded or loading failed.
+    bool is_finished() const;
+    const char* get_stage() const;
+    float get_fraction() const;
+    // Returns the finished model or rethrows the error loading it failed with.
+    model get();
+};
@@ -2,14 +2,26 @@
 #include "model_renderer.h"
 
 
-model_renderer::model_renderer(vk::PhysicalDevice physical_device, vk::Device device,
+model_renderer::model_renderer(vk::PhysicalDevice physical_device, vk::Device device, memory_allocator& allocator,
     vk::DescriptorPool descriptor_pool, vk::Extent2D framebuffer_size,
-    const pipeline* model_pipeline, const model* mdl)
+    const pipeline* model_pipeline, const pipeline* cull_pipeline, const model* mdl)
     : mdl(mdl)
     , model_pipeline(model_pipeline)
-    , uniform_buffer(physical_device, device, vk::BufferUsageFlagBits::eUniformBuffer, HOST_VISIBLE_AND_COHERENT,
-        sizeof(model_uniform_data))
+    , cull_pipeline(cull_pipeline)
+    , uniform_buffer(device, allocator, vk::BufferUsageFlagBits::eUniformBuffer, HOST_VISIBLE_AND_COHERENT,
+        sizeof(model_uniform_data), memory_category::other)
+    , draw_command_buffer(device, allocator,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        mdl->get_max_lod_meshlet_count() * sizeof(vk::DrawIndexedIndirectCommand), memory_category::other)
+    , draw_count_buffer(device, allocator,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+        | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, sizeof(uint32_t), memory_category::other)
     , framebuffer_size(framebuffer_size)
+    , max_draw_indirect_count(physical_device.getProperties().limits.maxDrawIndirectCount)
+    , max_draw_count(mdl->get_max_lod_meshlet_count())
+    , is_draw_count_supported(is_draw_indirect_count_supported(physical_device))
 {
     std::array set_layouts{ model_pipeline->set_layout.get() };
     descriptor_set = std::move(device.allocateDescriptorSetsUnique(
@@ -29,7 +41,74 @@ model_renderer::model_renderer(vk::PhysicalDevice physical_device, vk::Device de
         .setDstSet(descriptor_set.get())
         .setPBufferInfo(&model_ub_info);
 
-    device.updateDescriptorSets({ model_ub_write_description }, {});
+    auto chunk_buffer_info = vk::DescriptorBufferInfo()
+        .setBuffer(mdl->chunk_buffer->buf.get())
+        .setRange(mdl->chunk_buffer->size);
+
+    const auto chunk_buffer_write_description = vk::WriteDescriptorSet()
+        .setDstBinding(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(descriptor_set.get())
+        .setPBufferInfo(&chunk_buffer_info);
+
+    device.updateDescriptorSets({ model_ub_write_description, chunk_buffer_write_description }, {});
+
+    std::array cull_set_layouts{ cull_pipeline->set_layout.get() };
+    cull_descriptor_set = std::move(device.allocateDescriptorSetsUnique(
+        vk::DescriptorSetAllocateInfo()
+        .setDescriptorPool(descriptor_pool)
+        .setSetLayouts(cull_set_layouts)
+    )[0]);
+
+    auto meshlet_buffer_info = vk::DescriptorBufferInfo()
+        .setBuffer(mdl->meshlet_buffer->buf.get())
+        .setRange(mdl->meshlet_buffer->size);
+
+    auto draw_command_buffer_info = vk::DescriptorBufferInfo()
+        .setBuffer(draw_command_buffer.buf.get())
+        .setRange(draw_command_buffer.size);
+
+    auto residency_buffer_info = vk::DescriptorBufferInfo()
+        .setBuffer(mdl->residency_buffer->buf.get())
+        .setRange(mdl->residency_buffer->size);
+
+    auto draw_count_buffer_info = vk::DescriptorBufferInfo()
+        .setBuffer(draw_count_buffer.buf.get())
+        .setRange(draw_count_buffer.size);
+
+    device.updateDescriptorSets({
+        vk::WriteDescriptorSet()
+        .setDstBinding(0)
+        .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(cull_descriptor_set.get())
+        .setPBufferInfo(&model_ub_info),
+        vk::WriteDescriptorSet()
+        .setDstBinding(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(cull_descriptor_set.get())
+        .setPBufferInfo(&meshlet_buffer_info),
+        vk::WriteDescriptorSet()
+        .setDstBinding(2)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(cull_descriptor_set.get())
+        .setPBufferInfo(&draw_command_buffer_info),
+        vk::WriteDescriptorSet()
+        .setDstBinding(3)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(cull_descriptor_set.get())
+        .setPBufferInfo(&residency_buffer_info),
+        vk::WriteDescriptorSet()
+        .setDstBinding(4)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(cull_descriptor_set.get())
+        .setPBufferInfo(&draw_count_buffer_info),
+        }, {});
 }
 
 void model_renderer::update(vk::Device device, model_uniform_data model_uniform_data) const
@@ -41,7 +120,7 @@ void model_renderer::draw_outside_renderpass(vk::CommandBuffer command_buffer) c
 {
     command_buffer.pipelineBarrier(
         vk::PipelineStageFlagBits::eHost,
-        vk::PipelineStageFlagBits::eVertexShader,
+        vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eComputeShader,
         vk::DependencyFlagBits(),
         {},
         {
@@ -53,6 +132,75 @@ void model_renderer::draw_outside_renderpass(vk::CommandBuffer command_buffer) c
         },
         {}
     );
+
+    // The level of detail is selected on the GPU as well, since the camera changes without rerecording.
+    cull_push_constants push_constants{};
+    assert(mdl->lods.size() <= MAX_LOD_COUNT);
+    for (size_t i = 0; i < mdl->lods.size(); i++)
+    {
+        push_constants.lod_errors[i] = mdl->lods[i].error;
+        push_constants.first_meshlets[i] = mdl->lods[i].first_meshlet;
+        push_constants.meshlet_counts[i] = mdl->lods[i].meshlet_count;
+    }
+    push_constants.lod_count = static_cast<uint32_t>(mdl->lods.size());
+    push_constants.viewport_height = static_cast<float>(framebuffer_size.height);
+    push_constants.compact_draws = is_draw_count_supported ? 1 : 0;
+
+    if (is_draw_count_supported)
+    {
+        // the draw of the previous frame has to read its count before it is cleared
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eDrawIndirect,
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::DependencyFlagBits(),
+            {},
+            {},
+            {}
+        );
+        command_buffer.fillBuffer(draw_count_buffer.buf.get(), 0, draw_count_buffer.size, 0);
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::DependencyFlagBits(),
+            {},
+            {
+                vk::BufferMemoryBarrier()
+                .setBuffer(draw_count_buffer.buf.get())
+                .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+                .setSize(draw_count_buffer.size)
+            },
+            {}
+        );
+    }
+
+    // one invocation per meshlet of the largest level of detail culls the meshlet of the selected one
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cull_pipeline->layout.get(), 0,
+        cull_descriptor_set.get(), {});
+    command_buffer.pushConstants(cull_pipeline->layout.get(), vk::ShaderStageFlagBits::eCompute, 0,
+        sizeof(push_constants), &push_constants);
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, cull_pipeline->pl.get());
+    command_buffer.dispatch((max_draw_count + 63) / 64, 1, 1);
+
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eDrawIndirect,
+        vk::DependencyFlagBits(),
+        {},
+        {
+            vk::BufferMemoryBarrier()
+            .setBuffer(draw_command_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+            .setSize(draw_command_buffer.size),
+            vk::BufferMemoryBarrier()
+            .setBuffer(draw_count_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+            .setSize(draw_count_buffer.size)
+        },
+        {}
+    );
 }
 
 void model_renderer::draw(vk::CommandBuffer command_buffer) const
@@ -72,5 +220,13 @@ void model_renderer::draw(vk::CommandBuffer command_buffer) const
 
     command_buffer.setScissor(0, { vk::Rect2D().setExtent(framebuffer_size) });
 
-    mdl->draw(command_buffer);
+    if (is_draw_count_supported)
+    {
+        mdl->draw_counted(command_buffer, draw_command_buffer.buf.get(), draw_count_buffer.buf.get(),
+            std::min(max_draw_count, max_draw_indirect_count));
+    }
+    else
+    {
+        mdl->draw(command_buffer, draw_command_buffer.buf.get(), max_draw_count, max_draw_indirect_count);
+    }
 }
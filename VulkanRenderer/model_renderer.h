@@ -9,13 +9,23 @@ class model_renderer : public renderer
 {
     const model* mdl;
     const pipeline* model_pipeline;
+    const pipeline* cull_pipeline;
     buffer uniform_buffer;
+    // one command per meshlet of the largest level of detail
+    buffer draw_command_buffer;
+    // number of commands the cull shader appended, if the device can read it with VK_KHR_draw_indirect_count
+    buffer draw_count_buffer;
     vk::UniqueDescriptorSet descriptor_set;
+    vk::UniqueDescriptorSet cull_descriptor_set;
     vk::Extent2D framebuffer_size;
+    uint32_t max_draw_indirect_count;
+    uint32_t max_draw_count;
+    bool is_draw_count_supported;
 
 public:
-    model_renderer(vk::PhysicalDevice physical_device, vk::Device device, vk::DescriptorPool descriptor_pool,
-        vk::Extent2D framebuffer_size, const pipeline* model_pipeline, const model* mdl);
+    model_renderer(vk::PhysicalDevice physical_device, vk::Device device, memory_allocator& allocator,
+        vk::DescriptorPool descriptor_pool, vk::Extent2D framebuffer_size, const pipeline* model_pipeline,
+        const pipeline* cull_pipeline, const model* mdl);
     void update(vk::Device device, model_uniform_data model_uniform_data) const override;
 
     void draw_outside_renderpass(vk::CommandBuffer command_buffer) const override;
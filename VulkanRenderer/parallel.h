@@ -0,0 +1,17 @@
+#pragma once
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <vector>
+
+// Calls func(first, last) for consecutive ranges covering [0, count) on the parallel STL thread pool.
+template <typename Func>
+void parallel_for(size_t count, size_t block_size, Func func)
+{
+    std::vector<size_t> blocks((count + block_size - 1) / block_size);
+    std::iota(blocks.begin(), blocks.end(), size_t(0));
+    std::for_each(std::execution::par, blocks.begin(), blocks.end(), [&](size_t block)
+        {
+            func(block * block_size, std::min(count, (block + 1) * block_size));
+        });
+}
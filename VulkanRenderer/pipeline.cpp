@@ -22,6 +22,34 @@ static uint32_t model_rmiss_shader_spv[] = {
 #include "model.rmiss.num"
 };
 
+static uint32_t cull_comp_shader_spv[] = {
+#include "cull.comp.num"
+};
+
+static uint32_t scene_vert_shader_spv[] = {
+#include "scene.vert.num"
+};
+
+static uint32_t scene_cull_comp_shader_spv[] = {
+#include "scene_cull.comp.num"
+};
+
+static uint32_t scene_draws_comp_shader_spv[] = {
+#include "scene_draws.comp.num"
+};
+
+static uint32_t splat_comp_shader_spv[] = {
+#include "splat.comp.num"
+};
+
+static uint32_t splat_resolve_vert_shader_spv[] = {
+#include "splat_resolve.vert.num"
+};
+
+static uint32_t splat_resolve_frag_shader_spv[] = {
+#include "splat_resolve.frag.num"
+};
+
 static uint32_t ui_vert_shader_spv[] = {
 #include "ui.vert.num"
 };
@@ -298,12 +326,15 @@ pipeline create_textured_quad_pipeline(vk::Device device, vk::RenderPass render_
         std::move(pl.value));
 }
 
-pipeline create_model_pipeline(vk::Device device, vk::RenderPass render_pass)
+// Creates a pipeline that draws the vertices of the given layout with vert_code and model.frag.
+static pipeline create_mesh_pipeline(vk::Device device, vk::RenderPass render_pass, vertex_layout layout,
+    std::span<const uint32_t> vert_code, std::span<const vk::DescriptorSetLayoutBinding> bindings,
+    std::span<const vk::PushConstantRange> push_constant_ranges)
 {
     auto vert_shader = device.createShaderModule(
         vk::ShaderModuleCreateInfo()
-        .setCodeSize(sizeof(model_vert_shader_spv))
-        .setPCode(model_vert_shader_spv)
+        .setCodeSize(vert_code.size_bytes())
+        .setPCode(vert_code.data())
     );
 
     auto frag_shader = device.createShaderModule(
@@ -312,10 +343,23 @@ pipeline create_model_pipeline(vk::Device device, vk::RenderPass render_pass)
         .setPCode(model_frag_shader_spv)
     );
 
+    const auto format = get_vertex_format_info(layout);
+    const VkBool32 octahedral_normals = format.octahedral_normals;
+    const auto octahedral_normals_entry = vk::SpecializationMapEntry()
+        .setConstantID(0)
+        .setOffset(0)
+        .setSize(sizeof(octahedral_normals));
+    const auto vert_specialization = vk::SpecializationInfo()
+        .setMapEntryCount(1)
+        .setPMapEntries(&octahedral_normals_entry)
+        .setDataSize(sizeof(octahedral_normals))
+        .setPData(&octahedral_normals);
+
     auto vert_stage = vk::PipelineShaderStageCreateInfo()
         .setStage(vk::ShaderStageFlagBits::eVertex)
         .setModule(vert_shader)
-        .setPName("main");
+        .setPName("main")
+        .setPSpecializationInfo(&vert_specialization);
 
     auto frag_stage = vk::PipelineShaderStageCreateInfo()
         .setModule(frag_shader)
@@ -325,29 +369,12 @@ pipeline create_model_pipeline(vk::Device device, vk::RenderPass render_pass)
     std::array stages{ vert_stage, frag_stage };
 
     auto input_binding = vk::VertexInputBindingDescription()
-        .setStride(sizeof(vertex));
-
-    auto position_attribute = vk::VertexInputAttributeDescription()
-        .setFormat(vk::Format::eR16G16B16Snorm)
-        .setLocation(0)
-        .setOffset(offsetof(vertex, position));
-
-    auto normal_attribute = vk::VertexInputAttributeDescription()
-        .setFormat(vk::Format::eR16G16B16Snorm)
-        .setLocation(1)
-        .setOffset(offsetof(vertex, normal));
-
-    auto color_attribute = vk::VertexInputAttributeDescription()
-        .setFormat(vk::Format::eR8G8B8Unorm)
-        .setLocation(2)
-        .setOffset(offsetof(vertex, color));
-
-    std::array attributes{ position_attribute, normal_attribute, color_attribute };
+        .setStride(format.size);
 
     auto input_state = vk::PipelineVertexInputStateCreateInfo()
         .setVertexBindingDescriptionCount(1)
         .setPVertexBindingDescriptions(&input_binding)
-        .setVertexAttributeDescriptions(attributes);
+        .setVertexAttributeDescriptions(format.attributes);
 
     auto assembly_state = vk::PipelineInputAssemblyStateCreateInfo()
         .setTopology(vk::PrimitiveTopology::eTriangleList);
@@ -379,20 +406,376 @@ pipeline create_model_pipeline(vk::Device device, vk::RenderPass render_pass)
         .setDepthWriteEnable(true)
         .setDepthCompareOp(vk::CompareOp::eLessOrEqual);
 
-    auto binding = vk::DescriptorSetLayoutBinding()
+    auto set_layout = device.createDescriptorSetLayoutUnique(
+        vk::DescriptorSetLayoutCreateInfo()
+        .setBindingCount(static_cast<uint32_t>(bindings.size()))
+        .setPBindings(bindings.data())
+    );
+    auto pipeline_layout = device.createPipelineLayoutUnique(
+        vk::PipelineLayoutCreateInfo()
+        .setSetLayoutCount(1)
+        .setPSetLayouts(&set_layout.get())
+        .setPushConstantRangeCount(static_cast<uint32_t>(push_constant_ranges.size()))
+        .setPPushConstantRanges(push_constant_ranges.data())
+    );
+
+    std::array dynamic_states{ vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+
+    auto dynamic_state = vk::PipelineDynamicStateCreateInfo()
+        .setDynamicStates(dynamic_states);
+
+    auto pl = device.createGraphicsPipelineUnique(
+        nullptr,
+        vk::GraphicsPipelineCreateInfo()
+        .setStages(stages)
+        .setPVertexInputState(&input_state)
+        .setPInputAssemblyState(&assembly_state)
+        .setPViewportState(&viewport_state)
+        .setPRasterizationState(&rasterization_state)
+        .setPMultisampleState(&multisample_state)
+        .setPColorBlendState(&blend_state)
+        .setPDepthStencilState(&depth_stencil_state)
+        .setRenderPass(render_pass)
+        .setLayout(pipeline_layout.get())
+        .setPDynamicState(&dynamic_state)
+    );
+
+    return pipeline(device, { vert_shader, frag_shader }, std::vector<vk::Sampler>(), std::move(pipeline_layout),
+        std::move(set_layout), std::move(pl.value));
+}
+
+pipeline create_model_pipeline(vk::Device device, vk::RenderPass render_pass, vertex_layout layout)
+{
+    auto uniform_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(0)
         .setDescriptorCount(1)
         .setDescriptorType(vk::DescriptorType::eUniformBuffer)
         .setStageFlags(vk::ShaderStageFlagBits::eVertex);
 
+    auto chunk_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(1)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eVertex);
+
+    std::array bindings{
+        uniform_buffer_binding,
+        chunk_buffer_binding,
+    };
+
+    return create_mesh_pipeline(device, render_pass, layout, model_vert_shader_spv, bindings, {});
+}
+
+pipeline create_scene_pipeline(vk::Device device, vk::RenderPass render_pass, vertex_layout layout)
+{
+    std::array<vk::DescriptorSetLayoutBinding, 4> bindings;
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i]
+            .setBinding(i)
+            .setDescriptorCount(1)
+            .setDescriptorType(i == 0 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer)
+            .setStageFlags(vk::ShaderStageFlagBits::eVertex);
+    }
+
+    const auto push_constant_range = vk::PushConstantRange()
+        .setStageFlags(vk::ShaderStageFlagBits::eVertex)
+        .setSize(sizeof(scene_push_constants));
+
+    return create_mesh_pipeline(device, render_pass, layout, scene_vert_shader_spv, bindings,
+        { &push_constant_range, 1 });
+}
+
+// Creates a compute pipeline whose descriptor set has a binding of every given type, in order.
+static pipeline create_compute_pipeline(vk::Device device, std::span<const uint32_t> comp_code,
+    std::span<const vk::DescriptorType> binding_types, uint32_t push_constants_size)
+{
+    auto comp_shader = device.createShaderModule(
+        vk::ShaderModuleCreateInfo()
+        .setCodeSize(comp_code.size_bytes())
+        .setPCode(comp_code.data())
+    );
+
+    auto comp_stage = vk::PipelineShaderStageCreateInfo()
+        .setStage(vk::ShaderStageFlagBits::eCompute)
+        .setModule(comp_shader)
+        .setPName("main");
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings(binding_types.size());
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i]
+            .setBinding(i)
+            .setDescriptorCount(1)
+            .setDescriptorType(binding_types[i])
+            .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    }
+
     auto set_layout = device.createDescriptorSetLayoutUnique(
         vk::DescriptorSetLayoutCreateInfo()
-        .setBindingCount(1)
-        .setPBindings(&binding)
+        .setBindings(bindings)
     );
+    auto push_constant_range = vk::PushConstantRange()
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+        .setSize(push_constants_size);
+
     auto layout = device.createPipelineLayoutUnique(
         vk::PipelineLayoutCreateInfo()
         .setSetLayoutCount(1)
         .setPSetLayouts(&set_layout.get())
+        .setPushConstantRangeCount(push_constants_size > 0 ? 1 : 0)
+        .setPPushConstantRanges(&push_constant_range)
+    );
+
+    auto pl = device.createComputePipelineUnique(
+        nullptr,
+        vk::ComputePipelineCreateInfo()
+        .setStage(comp_stage)
+        .setLayout(layout.get())
+    );
+
+    return pipeline(device, { comp_shader }, std::vector<vk::Sampler>(), std::move(layout), std::move(set_layout),
+        std::move(pl.value));
+}
+
+pipeline create_scene_cull_pipeline(vk::Device device)
+{
+    const std::array binding_types{
+        vk::DescriptorType::eUniformBuffer,
+        vk::DescriptorType::eStorageBuffer,
+        vk::DescriptorType::eStorageBuffer,
+    };
+    return create_compute_pipeline(device, scene_cull_comp_shader_spv, binding_types,
+        sizeof(scene_cull_push_constants));
+}
+
+pipeline create_scene_draws_pipeline(vk::Device device)
+{
+    const std::array binding_types{
+        vk::DescriptorType::eStorageBuffer,
+        vk::DescriptorType::eStorageBuffer,
+        vk::DescriptorType::eStorageBuffer,
+        vk::DescriptorType::eStorageBuffer,
+    };
+    return create_compute_pipeline(device, scene_draws_comp_shader_spv, binding_types, 0);
+}
+
+pipeline create_cull_pipeline(vk::Device device)
+{
+    auto comp_shader = device.createShaderModule(
+        vk::ShaderModuleCreateInfo()
+        .setCodeSize(sizeof(cull_comp_shader_spv))
+        .setPCode(cull_comp_shader_spv)
+    );
+
+    auto comp_stage = vk::PipelineShaderStageCreateInfo()
+        .setStage(vk::ShaderStageFlagBits::eCompute)
+        .setModule(comp_shader)
+        .setPName("main");
+
+    auto uniform_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(0)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+    auto meshlet_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(1)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+    auto draw_command_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(2)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+    auto residency_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(3)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+    auto draw_count_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(4)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+    std::array bindings{
+        uniform_buffer_binding,
+        meshlet_buffer_binding,
+        draw_command_buffer_binding,
+        residency_buffer_binding,
+        draw_count_buffer_binding,
+    };
+
+    auto set_layout = device.createDescriptorSetLayoutUnique(
+        vk::DescriptorSetLayoutCreateInfo()
+        .setBindings(bindings)
+    );
+    auto push_constant_range = vk::PushConstantRange()
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+        .setSize(sizeof(cull_push_constants));
+
+    auto layout = device.createPipelineLayoutUnique(
+        vk::PipelineLayoutCreateInfo()
+        .setSetLayoutCount(1)
+        .setPSetLayouts(&set_layout.get())
+        .setPushConstantRangeCount(1)
+        .setPPushConstantRanges(&push_constant_range)
+    );
+
+    auto pl = device.createComputePipelineUnique(
+        nullptr,
+        vk::ComputePipelineCreateInfo()
+        .setStage(comp_stage)
+        .setLayout(layout.get())
+    );
+
+    return pipeline(device, { comp_shader }, std::vector<vk::Sampler>(), std::move(layout), std::move(set_layout),
+        std::move(pl.value));
+}
+
+pipeline create_splat_pipeline(vk::Device device)
+{
+    auto comp_shader = device.createShaderModule(
+        vk::ShaderModuleCreateInfo()
+        .setCodeSize(sizeof(splat_comp_shader_spv))
+        .setPCode(splat_comp_shader_spv)
+    );
+
+    auto comp_stage = vk::PipelineShaderStageCreateInfo()
+        .setStage(vk::ShaderStageFlagBits::eCompute)
+        .setModule(comp_shader)
+        .setPName("main");
+
+    auto uniform_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(0)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+    auto pixel_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(1)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+    std::array bindings{
+        uniform_buffer_binding,
+        pixel_buffer_binding,
+    };
+
+    auto set_layout = device.createDescriptorSetLayoutUnique(
+        vk::DescriptorSetLayoutCreateInfo()
+        .setBindings(bindings)
+    );
+    auto push_constant_range = vk::PushConstantRange()
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+        .setSize(sizeof(splat_push_constants));
+
+    auto layout = device.createPipelineLayoutUnique(
+        vk::PipelineLayoutCreateInfo()
+        .setSetLayoutCount(1)
+        .setPSetLayouts(&set_layout.get())
+        .setPushConstantRangeCount(1)
+        .setPPushConstantRanges(&push_constant_range)
+    );
+
+    auto pl = device.createComputePipelineUnique(
+        nullptr,
+        vk::ComputePipelineCreateInfo()
+        .setStage(comp_stage)
+        .setLayout(layout.get())
+    );
+
+    return pipeline(device, { comp_shader }, std::vector<vk::Sampler>(), std::move(layout), std::move(set_layout),
+        std::move(pl.value));
+}
+
+pipeline create_splat_resolve_pipeline(vk::Device device, vk::RenderPass render_pass)
+{
+    auto vert_shader = device.createShaderModule(
+        vk::ShaderModuleCreateInfo()
+        .setCodeSize(sizeof(splat_resolve_vert_shader_spv))
+        .setPCode(splat_resolve_vert_shader_spv)
+    );
+
+    auto frag_shader = device.createShaderModule(
+        vk::ShaderModuleCreateInfo()
+        .setCodeSize(sizeof(splat_resolve_frag_shader_spv))
+        .setPCode(splat_resolve_frag_shader_spv)
+    );
+
+    auto vert_stage = vk::PipelineShaderStageCreateInfo()
+        .setStage(vk::ShaderStageFlagBits::eVertex)
+        .setModule(vert_shader)
+        .setPName("main");
+
+    auto frag_stage = vk::PipelineShaderStageCreateInfo()
+        .setModule(frag_shader)
+        .setStage(vk::ShaderStageFlagBits::eFragment)
+        .setPName("main");
+
+    std::array stages{ vert_stage, frag_stage };
+
+    // the vertex shader generates its positions
+    auto input_state = vk::PipelineVertexInputStateCreateInfo();
+
+    auto assembly_state = vk::PipelineInputAssemblyStateCreateInfo()
+        .setTopology(vk::PrimitiveTopology::eTriangleList);
+
+    auto viewport_state = vk::PipelineViewportStateCreateInfo()
+        .setViewportCount(1)
+        .setScissorCount(1);
+
+    auto rasterization_state = vk::PipelineRasterizationStateCreateInfo()
+        .setLineWidth(1.f);
+
+    auto multisample_state = vk::PipelineMultisampleStateCreateInfo()
+        .setRasterizationSamples(vk::SampleCountFlagBits::e1);
+
+    auto attachment_state = vk::PipelineColorBlendAttachmentState()
+        .setColorWriteMask(
+            vk::ColorComponentFlagBits::eR |
+            vk::ColorComponentFlagBits::eG |
+            vk::ColorComponentFlagBits::eB |
+            vk::ColorComponentFlagBits::eA
+        );
+
+    auto blend_state = vk::PipelineColorBlendStateCreateInfo()
+        .setAttachmentCount(1)
+        .setPAttachments(&attachment_state);
+
+    auto depth_stencil_state = vk::PipelineDepthStencilStateCreateInfo()
+        .setDepthTestEnable(true)
+        .setDepthWriteEnable(true)
+        .setDepthCompareOp(vk::CompareOp::eLessOrEqual);
+
+    auto pixel_buffer_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(0)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setStageFlags(vk::ShaderStageFlagBits::eFragment);
+
+    std::array bindings{ pixel_buffer_binding };
+
+    auto set_layout = device.createDescriptorSetLayoutUnique(
+        vk::DescriptorSetLayoutCreateInfo()
+        .setBindings(bindings)
+    );
+    auto push_constant_range = vk::PushConstantRange()
+        .setStageFlags(vk::ShaderStageFlagBits::eFragment)
+        .setSize(sizeof(splat_resolve_push_constants));
+
+    auto layout = device.createPipelineLayoutUnique(
+        vk::PipelineLayoutCreateInfo()
+        .setSetLayoutCount(1)
+        .setPSetLayouts(&set_layout.get())
+        .setPushConstantRangeCount(1)
+        .setPPushConstantRanges(&push_constant_range)
     );
 
     std::array dynamic_states{ vk::DynamicState::eViewport, vk::DynamicState::eScissor };
@@ -420,7 +803,7 @@ pipeline create_model_pipeline(vk::Device device, vk::RenderPass render_pass)
         std::move(set_layout), std::move(pl.value));
 }
 
-pipeline create_ray_tracing_pipeline(vk::Device device)
+pipeline create_ray_tracing_pipeline(vk::Device device, vertex_layout layout)
 {
     auto raygen_shader = device.createShaderModule(
         vk::ShaderModuleCreateInfo()
@@ -445,10 +828,33 @@ pipeline create_ray_tracing_pipeline(vk::Device device)
         .setModule(raygen_shader)
         .setPName("main");
 
+    // the closest hit shader reads the vertex buffer in 16-bit words, all attributes are aligned to them
+    const auto format = get_vertex_format_info(layout);
+    assert(format.size % sizeof(uint16_t) == 0);
+    const std::array<uint32_t, 4> closest_hit_constants{
+        format.octahedral_normals,
+        static_cast<uint32_t>(format.size / sizeof(uint16_t)),
+        static_cast<uint32_t>(format.attributes[1].offset / sizeof(uint16_t)),
+        static_cast<uint32_t>(format.attributes[2].offset / sizeof(uint16_t)),
+    };
+    std::array<vk::SpecializationMapEntry, closest_hit_constants.size()> closest_hit_constant_entries;
+    for (uint32_t i = 0; i < closest_hit_constants.size(); i++)
+    {
+        closest_hit_constant_entries[i]
+            .setConstantID(i)
+            .setOffset(i * sizeof(uint32_t))
+            .setSize(sizeof(uint32_t));
+    }
+    const auto closest_hit_specialization = vk::SpecializationInfo()
+        .setMapEntries(closest_hit_constant_entries)
+        .setDataSize(sizeof(closest_hit_constants))
+        .setPData(closest_hit_constants.data());
+
     auto closest_hit_stage = vk::PipelineShaderStageCreateInfo()
         .setModule(closest_hit_shader)
         .setStage(vk::ShaderStageFlagBits::eClosestHitKHR)
-        .setPName("main");
+        .setPName("main")
+        .setPSpecializationInfo(&closest_hit_specialization);
 
     auto miss_stage = vk::PipelineShaderStageCreateInfo()
         .setModule(miss_shader)
@@ -474,24 +880,17 @@ pipeline create_ray_tracing_pipeline(vk::Device device)
         .setDescriptorType(vk::DescriptorType::eStorageImage)
         .setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
 
-    auto vertex_buffer_binding = vk::DescriptorSetLayoutBinding()
+    auto chunk_buffer_binding = vk::DescriptorSetLayoutBinding()
         .setBinding(3)
         .setDescriptorCount(1)
         .setDescriptorType(vk::DescriptorType::eStorageBuffer)
         .setStageFlags(vk::ShaderStageFlagBits::eClosestHitKHR);
 
-    auto index_buffer_binding = vk::DescriptorSetLayoutBinding()
-        .setBinding(4)
-        .setDescriptorCount(1)
-        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
-        .setStageFlags(vk::ShaderStageFlagBits::eClosestHitKHR);
-
     std::array bindings{
         uniform_buffer_binding,
         tlas_binding,
         image_binding,
-        vertex_buffer_binding,
-        index_buffer_binding,
+        chunk_buffer_binding,
     };
 
     auto set_layout = device.createDescriptorSetLayoutUnique(
@@ -542,26 +941,25 @@ pipeline create_ray_tracing_pipeline(vk::Device device)
 }
 
 std::unique_ptr<buffer> create_shader_binding_table(vk::PhysicalDevice physical_device, vk::Device device,
-    vk::Pipeline pipeline)
+    memory_allocator& allocator, vk::Pipeline pipeline)
 {
     auto props = physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceRayTracingPipelinePropertiesKHR
     >();
     auto alignment = props.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>().shaderGroupBaseAlignment;
     auto bufferSize = GROUP_COUNT * alignment;
-    auto sbt = std::make_unique<buffer>(physical_device, device, vk::BufferUsageFlagBits::eShaderBindingTableKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+    auto sbt = std::make_unique<buffer>(device, allocator, vk::BufferUsageFlagBits::eShaderBindingTableKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
         vk::MemoryPropertyFlagBits::eHostVisible |
-        vk::MemoryPropertyFlagBits::eHostCoherent, bufferSize);
+        vk::MemoryPropertyFlagBits::eHostCoherent, bufferSize, memory_category::other);
 
     auto handleSize = props.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>().shaderGroupHandleSize;
     auto tempBufferSize = GROUP_COUNT * handleSize;
     auto data = device.getRayTracingShaderGroupHandlesKHR<uint8_t>(pipeline, 0, GROUP_COUNT, tempBufferSize);
 
-    auto* ptr = static_cast<uint8_t*>(device.mapMemory(sbt->memory.get(), 0, VK_WHOLE_SIZE));
+    auto* ptr = sbt->get_mapped<uint8_t>().data();
     memset(ptr, 0xCA, bufferSize);
     memcpy(&ptr[RAYGEN_SHADER_INDEX * alignment], &data[RAYGEN_SHADER_INDEX * handleSize], handleSize);
     memcpy(&ptr[MISS_SHADER_INDEX * alignment], &data[MISS_SHADER_INDEX * handleSize], handleSize);
     memcpy(&ptr[CLOSEST_HIT_SHADER_INDEX * alignment], &data[CLOSEST_HIT_SHADER_INDEX * handleSize], handleSize);
-    device.unmapMemory(sbt->memory.get());
 
     return sbt;
 }
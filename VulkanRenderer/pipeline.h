@@ -1,6 +1,8 @@
 #pragma once
 #include <vulkan/vulkan.h>
 #include "buffer.h"
+#include "data_types.h"
+#include "vertex_format.h"
 
 #define GROUP_COUNT 3u
 #define RAYGEN_SHADER_INDEX 0u
@@ -23,9 +25,19 @@ struct pipeline
     ~pipeline();
 };
 
-pipeline create_model_pipeline(vk::Device device, vk::RenderPass render_pass);
+pipeline create_model_pipeline(vk::Device device, vk::RenderPass render_pass, vertex_layout layout);
 pipeline create_ui_pipeline(vk::Device device, vk::RenderPass render_pass);
 pipeline create_textured_quad_pipeline(vk::Device device, vk::RenderPass render_pass);
-pipeline create_ray_tracing_pipeline(vk::Device device);
+pipeline create_cull_pipeline(vk::Device device);
+// Draws every mesh of a scene once per visible instance. The cull pipeline selects the visible instances and their
+// levels of detail, which the draws pipeline turns into an instanced draw command per meshlet.
+pipeline create_scene_pipeline(vk::Device device, vk::RenderPass render_pass, vertex_layout layout);
+pipeline create_scene_cull_pipeline(vk::Device device);
+pipeline create_scene_draws_pipeline(vk::Device device);
+// Splats points into a buffer of packed depths and colors, which the resolve pipeline draws into the render pass.
+// Both require 64-bit integers, see is_point_splatting_supported.
+pipeline create_splat_pipeline(vk::Device device);
+pipeline create_splat_resolve_pipeline(vk::Device device, vk::RenderPass render_pass);
+pipeline create_ray_tracing_pipeline(vk::Device device, vertex_layout layout);
 std::unique_ptr<buffer> create_shader_binding_table(vk::PhysicalDevice physical_device, vk::Device device,
-    vk::Pipeline pipeline);
+    memory_allocator& allocator, vk::Pipeline pipeline);
@@ -0,0 +1,452 @@
+#include "stdafx.h"
+#include "ply_conversion.h"
+#include "parallel.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PLY_CONVERSION_X86
+#include <emmintrin.h>
+#endif
+
+static const size_t BLOCK_SIZE = 1 << 14;
+
+struct normalization
+{
+    float scale;
+    float minimum;
+};
+
+static normalization get_normalization(ply_type type, bool normalize)
+{
+    const normalization none{ 1.f, std::numeric_limits<float>::lowest() };
+    if (!normalize)
+    {
+        return none;
+    }
+
+    switch (type)
+    {
+    case ply_type::int8:
+        return { 1.f / INT8_MAX, -1.f };
+    case ply_type::uint8:
+        return { 1.f / UINT8_MAX, 0.f };
+    case ply_type::int16:
+        return { 1.f / INT16_MAX, -1.f };
+    case ply_type::uint16:
+        return { 1.f / UINT16_MAX, 0.f };
+    case ply_type::int32:
+        return { 1.f / static_cast<float>(INT32_MAX), -1.f };
+    case ply_type::uint32:
+        return { 1.f / static_cast<float>(UINT32_MAX), 0.f };
+    default:
+        return none;
+    }
+}
+
+#ifdef PLY_CONVERSION_X86
+
+static std::array<__m128i, 2> widen_epi8(__m128i bytes, bool is_signed)
+{
+    if (is_signed)
+    {
+        return { _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8),
+            _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8) };
+    }
+    const auto zero = _mm_setzero_si128();
+    return { _mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero) };
+}
+
+static std::array<__m128i, 2> widen_epi16(__m128i words, bool is_signed)
+{
+    if (is_signed)
+    {
+        return { _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16),
+            _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16) };
+    }
+    const auto zero = _mm_setzero_si128();
+    return { _mm_unpacklo_epi16(words, zero), _mm_unpackhi_epi16(words, zero) };
+}
+
+static void store_normalized(float* destination, __m128i value, const normalization& n)
+{
+    _mm_storeu_ps(destination,
+        _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(value), _mm_set1_ps(n.scale)), _mm_set1_ps(n.minimum)));
+}
+
+// The vectorized conversions return how many scalars they converted, the rest is left to the scalar ones.
+static size_t convert_8_bit_sse(const uint8_t* source, size_t count, bool is_signed, const normalization& n,
+    float* destination)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        const auto words = widen_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)), is_signed);
+        for (size_t j = 0; j < 2; j++)
+        {
+            const auto dwords = widen_epi16(words[j], is_signed);
+            store_normalized(destination + i + 8 * j, dwords[0], n);
+            store_normalized(destination + i + 8 * j + 4, dwords[1], n);
+        }
+    }
+    return i;
+}
+
+static size_t convert_16_bit_sse(const uint8_t* source, size_t count, bool is_signed, const normalization& n,
+    float* destination)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const auto dwords = widen_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 2 * i)), is_signed);
+        store_normalized(destination + i, dwords[0], n);
+        store_normalized(destination + i + 4, dwords[1], n);
+    }
+    return i;
+}
+
+static size_t convert_int32_sse(const uint8_t* source, size_t count, const normalization& n, float* destination)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        store_normalized(destination + i, _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 4 * i)), n);
+    }
+    return i;
+}
+
+static size_t convert_float64_sse(const uint8_t* source, size_t count, float* destination)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const auto* values = reinterpret_cast<const double*>(source) + i;
+        const auto low = _mm_cvtpd_ps(_mm_loadu_pd(values));
+        const auto high = _mm_cvtpd_ps(_mm_loadu_pd(values + 2));
+        _mm_storeu_ps(destination + i, _mm_movelh_ps(low, high));
+    }
+    return i;
+}
+
+static size_t convert_float_colors_sse(const uint8_t* source, size_t count, uint8_t* destination)
+{
+    const auto zero = _mm_setzero_ps();
+    const auto one = _mm_set1_ps(1.f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        std::array<__m128i, 4> channels;
+        for (size_t j = 0; j < 4; j++)
+        {
+            // max picks zero for NaN
+            const auto value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(reinterpret_cast<const float*>(source) + i + 4 * j),
+                zero), one);
+            channels[j] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.f)), _mm_set1_ps(.5f)));
+        }
+        const auto bytes = _mm_packus_epi16(_mm_packs_epi32(channels[0], channels[1]),
+            _mm_packs_epi32(channels[2], channels[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), bytes);
+    }
+    return i;
+}
+
+#endif
+
+template <typename T>
+static float load(const uint8_t* source, size_t i)
+{
+    T value;
+    memcpy(&value, source + i * sizeof(T), sizeof(T));
+    return static_cast<float>(value);
+}
+
+template <typename T>
+static void convert_to_float_scalar(const uint8_t* source, size_t first, size_t count, const normalization& n,
+    float* destination)
+{
+    for (auto i = first; i < count; i++)
+    {
+        destination[i] = std::max(load<T>(source, i) * n.scale, n.minimum);
+    }
+}
+
+// Converts count native scalars stored back to back.
+static void convert_to_float(const uint8_t* source, ply_type type, size_t count, bool normalize, float* destination)
+{
+    const auto n = get_normalization(type, normalize);
+    size_t i = 0;
+#ifdef PLY_CONVERSION_X86
+    switch (type)
+    {
+    case ply_type::int8:
+    case ply_type::uint8:
+        i = convert_8_bit_sse(source, count, type == ply_type::int8, n, destination);
+        break;
+    case ply_type::int16:
+    case ply_type::uint16:
+        i = convert_16_bit_sse(source, count, type == ply_type::int16, n, destination);
+        break;
+    case ply_type::int32:
+        i = convert_int32_sse(source, count, n, destination);
+        break;
+    case ply_type::float64:
+        i = convert_float64_sse(source, count, destination);
+        break;
+    default:
+        break;
+    }
+#endif
+
+    switch (type)
+    {
+    case ply_type::int8:
+        convert_to_float_scalar<int8_t>(source, i, count, n, destination);
+        break;
+    case ply_type::uint8:
+        convert_to_float_scalar<uint8_t>(source, i, count, n, destination);
+        break;
+    case ply_type::int16:
+        convert_to_float_scalar<int16_t>(source, i, count, n, destination);
+        break;
+    case ply_type::uint16:
+        convert_to_float_scalar<uint16_t>(source, i, count, n, destination);
+        break;
+    case ply_type::int32:
+        convert_to_float_scalar<int32_t>(source, i, count, n, destination);
+        break;
+    case ply_type::uint32:
+        convert_to_float_scalar<uint32_t>(source, i, count, n, destination);
+        break;
+    case ply_type::float32:
+        memcpy(destination, source, count * sizeof(float));
+        break;
+    case ply_type::float64:
+        convert_to_float_scalar<double>(source, i, count, n, destination);
+        break;
+    }
+}
+
+template <typename T>
+static void convert_colors_scalar(const uint8_t* source, size_t first, size_t count, ply_type type,
+    uint8_t* destination)
+{
+    for (auto i = first; i < count; i++)
+    {
+        destination[i] = convert_color_channel(load<T>(source, i), type);
+    }
+}
+
+static void convert_to_colors(const uint8_t* source, ply_type type, size_t count, uint8_t* destination)
+{
+    size_t i = 0;
+#ifdef PLY_CONVERSION_X86
+    if (type == ply_type::float32)
+    {
+        i = convert_float_colors_sse(source, count, destination);
+    }
+#endif
+
+    switch (type)
+    {
+    case ply_type::int8:
+        convert_colors_scalar<int8_t>(source, i, count, type, destination);
+        break;
+    case ply_type::uint8:
+        memcpy(destination, source, count);
+        break;
+    case ply_type::int16:
+        convert_colors_scalar<int16_t>(source, i, count, type, destination);
+        break;
+    case ply_type::uint16:
+        convert_colors_scalar<uint16_t>(source, i, count, type, destination);
+        break;
+    case ply_type::int32:
+        convert_colors_scalar<int32_t>(source, i, count, type, destination);
+        break;
+    case ply_type::uint32:
+        convert_colors_scalar<uint32_t>(source, i, count, type, destination);
+        break;
+    case ply_type::float32:
+        convert_colors_scalar<float>(source, i, count, type, destination);
+        break;
+    case ply_type::float64:
+        convert_colors_scalar<double>(source, i, count, type, destination);
+        break;
+    }
+}
+
+// Copies the triples of scalars of Size bytes back to back, so the copies have a constant size.
+template <size_t Size>
+static void gather_triples(const uint8_t* source, size_t stride, size_t count, bool swap_bytes, uint8_t* destination)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto* element = source + i * stride;
+        if (!swap_bytes)
+        {
+            memcpy(destination, element, 3 * Size);
+            destination += 3 * Size;
+            continue;
+        }
+        for (size_t j = 0; j < 3; j++)
+        {
+            destination = std::reverse_copy(element + j * Size, element + (j + 1) * Size, destination);
+        }
+    }
+}
+
+// Converts blocks of triples in parallel. Unless they are already back to back in native byte order, the scalars of a
+// block are first gathered into a buffer, so they are converted together.
+template <typename T, typename Func>
+static void convert_triples(const uint8_t* source, size_t stride, size_t count, ply_type type, bool swap_bytes,
+    T* destination, Func convert)
+{
+    const auto size = ply_type_size(type);
+    parallel_for(count, BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            if (stride == 3 * size && !swap_bytes)
+            {
+                convert(source + first * stride, 3 * (last - first), &destination[first].x);
+                return;
+            }
+
+            std::vector<uint8_t> packed(3 * size * (last - first));
+            const auto* block = source + first * stride;
+            switch (size)
+            {
+            case 1:
+                gather_triples<1>(block, stride, last - first, swap_bytes, packed.data());
+                break;
+            case 2:
+                gather_triples<2>(block, stride, last - first, swap_bytes, packed.data());
+                break;
+            case 4:
+                gather_triples<4>(block, stride, last - first, swap_bytes, packed.data());
+                break;
+            default:
+                gather_triples<8>(block, stride, last - first, swap_bytes, packed.data());
+                break;
+            }
+            convert(packed.data(), 3 * (last - first), &destination[first].x);
+        });
+}
+
+void convert_vec3s(const uint8_t* source, size_t stride, size_t count, ply_type type, bool swap_bytes, bool normalize,
+    glm::vec3* destination)
+{
+    convert_triples(source, stride, count, type, swap_bytes, destination,
+        [&](const uint8_t* packed, size_t scalar_count, float* output)
+        {
+            convert_to_float(packed, type, scalar_count, normalize, output);
+        });
+}
+
+void convert_colors(const uint8_t* source, size_t stride, size_t count, ply_type type, bool swap_bytes,
+    glm::u8vec3* destination)
+{
+    convert_triples(source, stride, count, type, swap_bytes, destination,
+        [&](const uint8_t* packed, size_t scalar_count, uint8_t* output)
+        {
+            convert_to_colors(packed, type, scalar_count, output);
+        });
+}
+
+float convert_normal_component(float value, ply_type type)
+{
+    const auto n = get_normalization(type, true);
+    return std::max(value * n.scale, n.minimum);
+}
+
+uint8_t convert_color_channel(float value, ply_type type)
+{
+    switch (type)
+    {
+    case ply_type::float32:
+    case ply_type::float64:
+        // written so NaN maps to zero
+        return value >= 1.f ? UINT8_MAX : value > 0.f ? static_cast<uint8_t>(value * UINT8_MAX + .5f) : 0;
+    case ply_type::uint16:
+        return static_cast<uint8_t>(value / UINT16_MAX * UINT8_MAX + .5f);
+    default:
+        return static_cast<uint8_t>(std::clamp(value, 0.f, static_cast<float>(UINT8_MAX)));
+    }
+}
+
+template <typename T>
+static void fill_benchmark_source(std::vector<uint8_t>& source, size_t stride, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t j = 0; j < 3; j++)
+        {
+            const auto value = std::is_floating_point_v<T>
+                ? static_cast<T>((i * 3 + j) % 101 / 100.)
+                : static_cast<T>((i * 3 + j) % 101);
+            memcpy(source.data() + i * stride + j * sizeof(T), &value, sizeof(T));
+        }
+    }
+}
+
+void benchmark_ply_conversions()
+{
+    const size_t count = 1 << 22;
+    const size_t repetitions = 5;
+    const std::array<std::pair<ply_type, const char*>, 8> types{ {
+        { ply_type::int8, "int8" },
+        { ply_type::uint8, "uint8" },
+        { ply_type::int16, "int16" },
+        { ply_type::uint16, "uint16" },
+        { ply_type::int32, "int32" },
+        { ply_type::uint32, "uint32" },
+        { ply_type::float32, "float32" },
+        { ply_type::float64, "float64" },
+    } };
+
+    std::vector<glm::vec3> vec3s(count);
+    std::vector<glm::u8vec3> colors(count);
+    std::printf("Converting %zu triples, best of %zu runs:\n", count, repetitions);
+
+    for (const auto& [type, name] : types)
+    {
+        const auto size = ply_type_size(type);
+        // strided triples are followed by 12 bytes of other properties, as in a vertex with positions and normals
+        for (const auto stride : { 3 * size, 3 * size + 12 })
+        {
+            std::vector<uint8_t> source(count * stride);
+            switch (type)
+            {
+            case ply_type::int8: fill_benchmark_source<int8_t>(source, stride, count); break;
+            case ply_type::uint8: fill_benchmark_source<uint8_t>(source, stride, count); break;
+            case ply_type::int16: fill_benchmark_source<int16_t>(source, stride, count); break;
+            case ply_type::uint16: fill_benchmark_source<uint16_t>(source, stride, count); break;
+            case ply_type::int32: fill_benchmark_source<int32_t>(source, stride, count); break;
+            case ply_type::uint32: fill_benchmark_source<uint32_t>(source, stride, count); break;
+            case ply_type::float32: fill_benchmark_source<float>(source, stride, count); break;
+            case ply_type::float64: fill_benchmark_source<double>(source, stride, count); break;
+            }
+
+            const auto measure = [&](const char* conversion, auto convert)
+            {
+                auto best = std::numeric_limits<double>::max();
+                for (size_t i = 0; i < repetitions; i++)
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    convert();
+                    best = std::min(best,
+                        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                }
+                std::printf("%-8s %-8s %-11s %8.2lf ms %8.2lf M triples/s\n", name,
+                    stride == 3 * size ? "packed" : "strided", conversion, best, count / best / 1000.);
+            };
+
+            measure("vec3", [&] { convert_vec3s(source.data(), stride, count, type, false, false, vec3s.data()); });
+            if (type != ply_type::float32 && type != ply_type::float64)
+            {
+                measure("normalized", [&]
+                    {
+                        convert_vec3s(source.data(), stride, count, type, false, true, vec3s.data());
+                    });
+            }
+            measure("color", [&] { convert_colors(source.data(), stride, count, type, false, colors.data()); });
+            measure("swapped", [&] { convert_vec3s(source.data(), stride, count, type, true, false, vec3s.data()); });
+        }
+    }
+}
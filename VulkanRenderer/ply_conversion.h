@@ -0,0 +1,20 @@
+#pragma once
+#include "ply_reader.h"
+
+// Converts count triples of scalars of the given type, the first of which starts at source and the others follow every
+// stride bytes, to vec3s. Integers keep their value, unless normalize is set, which maps signed ones to [-1, 1] and
+// unsigned ones to [0, 1] as for normals.
+void convert_vec3s(const uint8_t* source, size_t stride, size_t count, ply_type type, bool swap_bytes, bool normalize,
+    glm::vec3* destination);
+
+// Converts triples of color channels like convert_vec3s. Floating point channels are mapped from [0, 1], 16-bit
+// unsigned ones from their full range, and other integer ones are clamped to [0, 255].
+void convert_colors(const uint8_t* source, size_t stride, size_t count, ply_type type, bool swap_bytes,
+    glm::u8vec3* destination);
+
+// Scalar versions of the conversions for values that were parsed from ASCII files.
+float convert_normal_component(float value, ply_type type);
+uint8_t convert_color_channel(float value, ply_type type);
+
+// Prints the throughput of every conversion.
+void benchmark_ply_conversions();
@@ -0,0 +1,387 @@
+#include "stdafx.h"
+#include "ply_faces.h"
+#include "parallel.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PLY_FACES_X86
+#include <emmintrin.h>
+#endif
+
+static const size_t BLOCK_SIZE = 1 << 14;
+// larger polygons are split into a fan, as ear clipping takes cubic time in the worst case
+static const uint32_t MAX_EAR_CLIPPING_SIZE = 256;
+
+struct face_layout
+{
+    // bytes of the scalar properties before and after the index list
+    size_t list_offset;
+    size_t suffix_size;
+    ply_type count_type;
+    ply_type index_type;
+};
+
+static bool is_integer(ply_type type)
+{
+    return type != ply_type::float32 && type != ply_type::float64;
+}
+
+static std::optional<face_layout> get_face_layout(const ply_element& element)
+{
+    face_layout layout{};
+    auto has_list = false;
+    for (const auto& property : element.properties)
+    {
+        if (property.is_list)
+        {
+            if (has_list || (property.name != "vertex_indices" && property.name != "vertex_index"))
+            {
+                return std::nullopt;
+            }
+            if (!is_integer(property.list_count_type) || !is_integer(property.type))
+            {
+                throw std::runtime_error("PLY face indices are not integers");
+            }
+            layout.count_type = property.list_count_type;
+            layout.index_type = property.type;
+            has_list = true;
+        }
+        else
+        {
+            (has_list ? layout.suffix_size : layout.list_offset) += ply_type_size(property.type);
+        }
+    }
+
+    if (!has_list)
+    {
+        return std::nullopt;
+    }
+    return layout;
+}
+
+static uint16_t byteswap16(uint16_t value)
+{
+    return static_cast<uint16_t>(value << 8 | value >> 8);
+}
+
+static uint32_t byteswap32(uint32_t value)
+{
+    return value >> 24 | (value >> 8 & 0xff00u) | (value << 8 & 0xff0000u) | value << 24;
+}
+
+static uint32_t read_unsigned(const uint8_t* ptr, size_t size, bool swap_bytes)
+{
+    switch (size)
+    {
+    case 1:
+        return *ptr;
+    case 2:
+    {
+        uint16_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return swap_bytes ? byteswap16(value) : value;
+    }
+    default:
+    {
+        uint32_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return swap_bytes ? byteswap32(value) : value;
+    }
+    }
+}
+
+// Widens count indices of 1, 2 or 4 bytes to uint32. Signed indices are zero extended, which keeps all valid ones.
+static void widen_indices(const uint8_t* source, size_t index_size, bool swap_bytes, size_t count,
+    uint32_t* destination)
+{
+    size_t i = 0;
+#ifdef PLY_FACES_X86
+    const auto zero = _mm_setzero_si128();
+    if (index_size == 1)
+    {
+        for (; i + 16 <= count; i += 16)
+        {
+            const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+            const auto low = _mm_unpacklo_epi8(bytes, zero);
+            const auto high = _mm_unpackhi_epi8(bytes, zero);
+            auto* output = reinterpret_cast<__m128i*>(destination + i);
+            _mm_storeu_si128(output, _mm_unpacklo_epi16(low, zero));
+            _mm_storeu_si128(output + 1, _mm_unpackhi_epi16(low, zero));
+            _mm_storeu_si128(output + 2, _mm_unpacklo_epi16(high, zero));
+            _mm_storeu_si128(output + 3, _mm_unpackhi_epi16(high, zero));
+        }
+    }
+    else if (index_size == 2)
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            auto words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 2 * i));
+            if (swap_bytes)
+            {
+                words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+            }
+            auto* output = reinterpret_cast<__m128i*>(destination + i);
+            _mm_storeu_si128(output, _mm_unpacklo_epi16(words, zero));
+            _mm_storeu_si128(output + 1, _mm_unpackhi_epi16(words, zero));
+        }
+    }
+#endif
+    if (index_size == 4 && !swap_bytes)
+    {
+        memcpy(destination, source, count * sizeof(uint32_t));
+        return;
+    }
+    for (; i < count; i++)
+    {
+        destination[i] = read_unsigned(source + i * index_size, index_size, swap_bytes);
+    }
+}
+
+struct ear_clipping_scratch
+{
+    std::vector<glm::vec2> points;
+    std::vector<uint32_t> remaining;
+};
+
+static void triangulate_fan(const uint32_t* polygon, uint32_t size, glm::uvec3* triangles)
+{
+    for (uint32_t i = 2; i < size; i++)
+    {
+        *triangles++ = glm::uvec3(polygon[0], polygon[i - 1], polygon[i]);
+    }
+}
+
+static float cross(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// Writes the size - 2 triangles of a polygon, keeping its winding. Polygons with more than four vertices are ear
+// clipped in the plane of their Newell normal; if no ear is left, as in self-intersecting polygons, a vertex is clipped
+// anyway.
+static void triangulate_polygon(const uint32_t* polygon, uint32_t size, const strided_view<glm::vec3>& positions,
+    ear_clipping_scratch& scratch, glm::uvec3* triangles)
+{
+    if (size <= 4 || size > MAX_EAR_CLIPPING_SIZE
+        || std::any_of(polygon, polygon + size, [&](uint32_t index) { return index >= positions.size(); }))
+    {
+        triangulate_fan(polygon, size, triangles);
+        return;
+    }
+
+    glm::vec3 normal(0.f);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        const auto current = positions[polygon[i]];
+        const auto next = positions[polygon[(i + 1) % size]];
+        normal += glm::vec3((current.y - next.y) * (current.z + next.z), (current.z - next.z) * (current.x + next.x),
+            (current.x - next.x) * (current.y + next.y));
+    }
+
+    const auto magnitude = glm::abs(normal);
+    const auto axis = magnitude.x > magnitude.y
+        ? (magnitude.x > magnitude.z ? 0 : 2)
+        : (magnitude.y > magnitude.z ? 1 : 2);
+    if (magnitude[axis] == 0.f)
+    {
+        triangulate_fan(polygon, size, triangles);
+        return;
+    }
+
+    // projected onto the other two axes in cyclic order, the polygon winds like the sign of the normal's component
+    const auto orientation = normal[axis] > 0.f ? 1.f : -1.f;
+    scratch.points.resize(size);
+    scratch.remaining.resize(size);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        const auto position = positions[polygon[i]];
+        scratch.points[i] = glm::vec2(position[(axis + 1) % 3], position[(axis + 2) % 3]);
+        scratch.remaining[i] = i;
+    }
+
+    auto& remaining = scratch.remaining;
+    const auto& points = scratch.points;
+    size_t current = 0, misses = 0;
+    while (remaining.size() > 3)
+    {
+        const auto count = remaining.size();
+        current %= count;
+        const auto previous = remaining[(current + count - 1) % count];
+        const auto vertex = remaining[current];
+        const auto next = remaining[(current + 1) % count];
+        const auto& a = points[previous];
+        const auto& b = points[vertex];
+        const auto& c = points[next];
+
+        auto is_ear = orientation * cross(a, b, c) > 0.f;
+        for (size_t i = 0; i < count && is_ear; i++)
+        {
+            const auto other = remaining[i];
+            if (other != previous && other != vertex && other != next)
+            {
+                const auto& p = points[other];
+                is_ear = orientation * cross(a, b, p) < 0.f || orientation * cross(b, c, p) < 0.f
+                    || orientation * cross(c, a, p) < 0.f;
+            }
+        }
+
+        if (is_ear || misses == count)
+        {
+            *triangles++ = glm::uvec3(polygon[previous], polygon[vertex], polygon[next]);
+            remaining.erase(remaining.begin() + current);
+            misses = 0;
+        }
+        else
+        {
+            current++;
+            misses++;
+        }
+    }
+    *triangles = glm::uvec3(polygon[remaining[0]], polygon[remaining[1]], polygon[remaining[2]]);
+}
+
+static size_t get_triangle_count(uint32_t polygon_size)
+{
+    return polygon_size < 3 ? 0 : polygon_size - 2;
+}
+
+std::optional<ply_faces> decode_binary_faces(std::span<const uint8_t> data, const ply_element& element,
+    ply_format format, const strided_view<glm::vec3>& positions)
+{
+    assert(format != ply_format::ascii);
+    const auto layout = get_face_layout(element);
+    if (!layout)
+    {
+        return std::nullopt;
+    }
+
+    const auto swap_bytes = format == ply_format::binary_big_endian;
+    const auto count_size = ply_type_size(layout->count_type);
+    const auto index_size = ply_type_size(layout->index_type);
+    const auto indices_offset = layout->list_offset + count_size;
+    const auto read_polygon_size = [&](size_t offset)
+    {
+        if (offset + indices_offset > data.size())
+        {
+            throw std::runtime_error("PLY face data is truncated");
+        }
+        return read_unsigned(data.data() + offset + layout->list_offset, count_size, swap_bytes);
+    };
+
+    ply_faces faces{};
+    if (element.count == 0)
+    {
+        return faces;
+    }
+
+    // in files with faces of a single size, such as triangle or quad meshes, the faces have a fixed stride and are
+    // gathered and widened a block at a time
+    const auto polygon_size = read_polygon_size(0);
+    const auto stride = indices_offset + polygon_size * index_size + layout->suffix_size;
+    std::atomic<bool> is_fixed_size = element.count * stride <= data.size();
+    if (is_fixed_size)
+    {
+        parallel_for(element.count, BLOCK_SIZE, [&](size_t first, size_t last)
+            {
+                for (auto i = first; i < last && is_fixed_size; i++)
+                {
+                    if (read_unsigned(data.data() + i * stride + layout->list_offset, count_size, swap_bytes)
+                        != polygon_size)
+                    {
+                        is_fixed_size = false;
+                    }
+                }
+            });
+    }
+
+    if (is_fixed_size)
+    {
+        const auto triangles_per_face = get_triangle_count(polygon_size);
+        faces.triangles.resize(element.count * triangles_per_face);
+        faces.size = element.count * stride;
+        parallel_for(element.count, BLOCK_SIZE, [&](size_t first, size_t last)
+            {
+                const auto face_size = polygon_size * index_size;
+                std::vector<uint8_t> packed((last - first) * face_size);
+                for (auto i = first; i < last; i++)
+                {
+                    memcpy(packed.data() + (i - first) * face_size, data.data() + i * stride + indices_offset,
+                        face_size);
+                }
+
+                const auto index_count = (last - first) * polygon_size;
+                if (polygon_size == 3)
+                {
+                    widen_indices(packed.data(), index_size, swap_bytes, index_count,
+                        reinterpret_cast<uint32_t*>(faces.triangles.data() + first));
+                    return;
+                }
+
+                std::vector<uint32_t> indices(index_count);
+                widen_indices(packed.data(), index_size, swap_bytes, index_count, indices.data());
+                ear_clipping_scratch scratch;
+                for (auto i = first; i < last; i++)
+                {
+                    triangulate_polygon(indices.data() + (i - first) * polygon_size, polygon_size, positions, scratch,
+                        faces.triangles.data() + i * triangles_per_face);
+                }
+            });
+        return faces;
+    }
+
+    // otherwise each face has to be visited to find the next one, after which they are triangulated in parallel
+    std::vector<size_t> face_offsets(element.count);
+    std::vector<size_t> first_triangles(element.count);
+    size_t offset = 0, triangle_count = 0;
+    for (size_t i = 0; i < element.count; i++)
+    {
+        const auto size = read_polygon_size(offset);
+        face_offsets[i] = offset;
+        first_triangles[i] = triangle_count;
+        offset += indices_offset + size * index_size + layout->suffix_size;
+        triangle_count += get_triangle_count(size);
+    }
+    if (offset > data.size())
+    {
+        throw std::runtime_error("PLY face data is truncated");
+    }
+
+    faces.triangles.resize(triangle_count);
+    faces.size = offset;
+    parallel_for(element.count, BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            std::vector<uint32_t> polygon;
+            ear_clipping_scratch scratch;
+            for (auto i = first; i < last; i++)
+            {
+                polygon.resize(read_polygon_size(face_offsets[i]));
+                widen_indices(data.data() + face_offsets[i] + indices_offset, index_size, swap_bytes,
+                    polygon.size(), polygon.data());
+                triangulate_polygon(polygon.data(), static_cast<uint32_t>(polygon.size()), positions, scratch,
+                    faces.triangles.data() + first_triangles[i]);
+            }
+        });
+    return faces;
+}
+
+size_t count_triangles(const ply_polygons& polygons)
+{
+    size_t count = 0;
+    for (auto size : polygons.sizes)
+    {
+        count += get_triangle_count(size);
+    }
+    return count;
+}
+
+void triangulate_polygons(const ply_polygons& polygons, const strided_view<glm::vec3>& positions,
+    glm::uvec3* triangles)
+{
+    ear_clipping_scratch scratch;
+    const auto* polygon = polygons.indices.data();
+    for (auto size : polygons.sizes)
+    {
+        triangulate_polygon(polygon, size, positions, scratch, triangles);
+        polygon += size;
+        triangles += get_triangle_count(size);
+    }
+}
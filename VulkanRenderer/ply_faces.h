@@ -0,0 +1,32 @@
+#pragma once
+#include <optional>
+#include <vector>
+#include "ply_reader.h"
+
+struct ply_faces
+{
+    std::vector<glm::uvec3> triangles;
+    // bytes of the file taken by the face element
+    size_t size;
+};
+
+// Triangulates the vertex_indices lists of a binary face element whose data starts at the beginning of data. Any list
+// count and index type is accepted, and the element may have scalar properties besides the list. Triangles and quads
+// are split into a fan, larger polygons are ear clipped using the positions if they are known. Returns nullopt if the
+// element has no vertex_indices list or other lists.
+std::optional<ply_faces> decode_binary_faces(std::span<const uint8_t> data, const ply_element& element,
+    ply_format format, const strided_view<glm::vec3>& positions);
+
+// Polygons of an ASCII face element, as the concatenated indices of all polygons and the vertex count of each.
+struct ply_polygons
+{
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> sizes;
+};
+
+// Returns how many triangles triangulate_polygons writes for the polygons.
+size_t count_triangles(const ply_polygons& polygons);
+
+// Triangulates the polygons like decode_binary_faces, writing count_triangles(polygons) triangles.
+void triangulate_polygons(const ply_polygons& polygons, const strided_view<glm::vec3>& positions,
+    glm::uvec3* triangles);
@@ -0,0 +1,952 @@
+#include "stdafx.h"
+#include "ply_reader.h"
+#include "decompressed_file.h"
+#include "parallel.h"
+#include "ply_conversion.h"
+#include "ply_faces.h"
+
+#include <charconv>
+#include <execution>
+#include <sstream>
+#include <thread>
+
+#pragma warning( push )
+#pragma warning( disable: 4267 )
+#include <tinyply.h>
+#pragma warning( pop )
+
+// bytes of an ASCII file that are waited for before they are scanned, unless the file is already available
+static const size_t ASCII_WAVE_SIZE = size_t(64) << 20;
+
+size_t ply_type_size(ply_type type)
+{
+    switch (type)
+    {
+    case ply_type::int8:
+    case ply_type::uint8:
+        return 1;
+    case ply_type::int16:
+    case ply_type::uint16:
+        return 2;
+    case ply_type::int32:
+    case ply_type::uint32:
+    case ply_type::float32:
+        return 4;
+    case ply_type::float64:
+        return 8;
+    }
+    throw std::runtime_error("Invalid PLY type");
+}
+
+static ply_type parse_ply_type(const std::string& name)
+{
+    if (name == "char" || name == "int8") return ply_type::int8;
+    if (name == "uchar" || name == "uint8") return ply_type::uint8;
+    if (name == "short" || name == "int16") return ply_type::int16;
+    if (name == "ushort" || name == "uint16") return ply_type::uint16;
+    if (name == "int" || name == "int32") return ply_type::int32;
+    if (name == "uint" || name == "uint32") return ply_type::uint32;
+    if (name == "float" || name == "float32") return ply_type::float32;
+    if (name == "double" || name == "float64") return ply_type::float64;
+    throw std::runtime_error("Unknown PLY type " + name);
+}
+
+ply_header parse_ply_header(std::span<const uint8_t> data)
+{
+    ply_header header{};
+    auto has_format = false;
+    size_t position = 0;
+
+    while (true)
+    {
+        const auto* begin = data.data() + position;
+        const auto* end = static_cast<const uint8_t*>(memchr(begin, '\n', data.size() - position));
+        if (!end)
+        {
+            throw std::runtime_error("PLY header is not terminated");
+        }
+        position = end - data.data() + 1;
+
+        std::istringstream line(std::string(reinterpret_cast<const char*>(begin), end - begin));
+        std::string keyword;
+        line >> keyword;
+
+        if (begin == data.data())
+        {
+            if (keyword != "ply")
+            {
+                throw std::runtime_error("Not a PLY file");
+            }
+        }
+        else if (keyword == "format")
+        {
+            std::string format;
+            line >> format;
+            if (format == "ascii") header.format = ply_format::ascii;
+            else if (format == "binary_little_endian") header.format = ply_format::binary_little_endian;
+            else if (format == "binary_big_endian") header.format = ply_format::binary_big_endian;
+            else throw std::runtime_error("Unknown PLY format " + format);
+            has_format = true;
+        }
+        else if (keyword == "element")
+        {
+            ply_element element{};
+            line >> element.name >> element.count;
+            header.elements.push_back(element);
+        }
+        else if (keyword == "property")
+        {
+            if (header.elements.empty())
+            {
+                throw std::runtime_error("PLY property declared outside of element");
+            }
+
+            ply_property property{};
+            std::string type;
+            line >> type;
+            if (type == "list")
+            {
+                std::string count_type, item_type;
+                line >> count_type >> item_type;
+                property.is_list = true;
+                property.list_count_type = parse_ply_type(count_type);
+                property.type = parse_ply_type(item_type);
+            }
+            else
+            {
+                property.type = parse_ply_type(type);
+            }
+            line >> property.name;
+            header.elements.back().properties.push_back(property);
+        }
+        else if (keyword == "end_header")
+        {
+            break;
+        }
+    }
+
+    if (!has_format)
+    {
+        throw std::runtime_error("PLY header has no format");
+    }
+
+    header.size = position;
+    return header;
+}
+
+static uint32_t read_list_count(const uint8_t* ptr, ply_type type)
+{
+    switch (type)
+    {
+    case ply_type::int8:
+    case ply_type::uint8:
+        return *ptr;
+    case ply_type::int16:
+    case ply_type::uint16:
+    {
+        uint16_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    case ply_type::int32:
+    case ply_type::uint32:
+    {
+        uint32_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+    default:
+        throw std::runtime_error("Invalid PLY list count type");
+    }
+}
+
+static std::optional<size_t> find_property(const ply_element& element, const std::string& name)
+{
+    for (size_t i = 0; i < element.properties.size(); i++)
+    {
+        if (element.properties[i].name == name)
+        {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+static size_t get_scalar_offset(const ply_element& element, size_t property_index)
+{
+    size_t offset = 0;
+    for (size_t i = 0; i < property_index; i++)
+    {
+        offset += ply_type_size(element.properties[i].type);
+    }
+    return offset;
+}
+
+struct ply_vec3
+{
+    size_t offset;
+    ply_type type;
+};
+
+// Finds three consecutive properties of the same type.
+static std::optional<ply_vec3> find_vec3(const ply_element& element, const std::array<std::string, 3>& names)
+{
+    const auto index = find_property(element, names[0]);
+    if (!index
+        || *index + 2 >= element.properties.size()
+        || element.properties[*index + 1].name != names[1]
+        || element.properties[*index + 2].name != names[2])
+    {
+        return std::nullopt;
+    }
+
+    const auto type = element.properties[*index].type;
+    for (size_t i = *index; i < *index + 3; i++)
+    {
+        if (element.properties[i].type != type)
+        {
+            return std::nullopt;
+        }
+    }
+
+    return ply_vec3{ get_scalar_offset(element, *index), type };
+}
+
+// Checks if a face element only has lists of three 32-bit indices, which can be used without conversion.
+static bool is_mappable_triangle_list(std::span<const uint8_t> data, const ply_element& element)
+{
+    if (element.properties.size() != 1
+        || !element.properties[0].is_list
+        || (element.properties[0].type != ply_type::int32 && element.properties[0].type != ply_type::uint32))
+    {
+        return false;
+    }
+
+    const auto count_type = element.properties[0].list_count_type;
+    const auto stride = ply_type_size(count_type) + sizeof(glm::uvec3);
+    if (element.count * stride > data.size())
+    {
+        return false;
+    }
+
+    std::atomic<bool> is_triangle_list = true;
+    parallel_for(element.count, 1 << 16, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last && is_triangle_list; i++)
+            {
+                if (read_list_count(data.data() + i * stride, count_type) != 3)
+                {
+                    is_triangle_list = false;
+                }
+            }
+        });
+    return is_triangle_list;
+}
+
+// Reads binary files whose vertex element has no lists. Float positions and normals, uchar colors and triangle lists of
+// 32-bit indices of little endian files are views into the mapped file, other properties are converted from it and
+// other faces are triangulated. Other files go through tinyply.
+static std::optional<ply_mesh> try_map_binary_ply(const ply_header& header, std::shared_ptr<const file_source> file)
+{
+    if (header.format == ply_format::ascii)
+    {
+        return std::nullopt;
+    }
+
+    std::span<const uint8_t> data;
+    const auto swap_bytes = header.format == ply_format::binary_big_endian;
+    ply_mesh mesh;
+    auto offset = header.size;
+    auto has_faces = false;
+
+    for (const auto& element : header.elements)
+    {
+        const auto has_lists = std::ranges::any_of(element.properties, [](auto& p) { return p.is_list; });
+
+        if (element.name == "vertex")
+        {
+            if (has_lists)
+            {
+                return std::nullopt;
+            }
+
+            const auto stride = get_scalar_offset(element, element.properties.size());
+            // the vertices are converted while the rest of a compressed file is decompressed
+            data = file->wait_for(offset + element.count * stride);
+            if (offset + element.count * stride > data.size())
+            {
+                throw std::runtime_error("PLY vertex data is truncated");
+            }
+
+            const auto map_vec3s = [&](const ply_vec3& property, bool normalize) -> strided_view<glm::vec3>
+            {
+                const auto* source = data.data() + offset + property.offset;
+                if (property.type == ply_type::float32 && !swap_bytes)
+                {
+                    return strided_view<glm::vec3>(source, element.count, stride);
+                }
+                auto values = std::make_shared<std::vector<glm::vec3>>(element.count);
+                convert_vec3s(source, stride, element.count, property.type, swap_bytes, normalize, values->data());
+                mesh.storage.emplace_back(values);
+                return std::span<const glm::vec3>(*values);
+            };
+
+            const auto position = find_vec3(element, { "x", "y", "z" });
+            if (!position)
+            {
+                return std::nullopt;
+            }
+            mesh.positions = map_vec3s(*position, false);
+
+            if (find_property(element, "nx"))
+            {
+                const auto normal = find_vec3(element, { "nx", "ny", "nz" });
+                if (!normal)
+                {
+                    return std::nullopt;
+                }
+                mesh.normals = map_vec3s(*normal, true);
+            }
+
+            if (find_property(element, "red"))
+            {
+                const auto color = find_vec3(element, { "red", "green", "blue" });
+                if (!color)
+                {
+                    return std::nullopt;
+                }
+                const auto* source = data.data() + offset + color->offset;
+                if (color->type == ply_type::uint8)
+                {
+                    mesh.colors = strided_view<glm::u8vec3>(source, element.count, stride);
+                }
+                else
+                {
+                    auto colors = std::make_shared<std::vector<glm::u8vec3>>(element.count);
+                    convert_colors(source, stride, element.count, color->type, swap_bytes, colors->data());
+                    mesh.colors = std::span<const glm::u8vec3>(*colors);
+                    mesh.storage.emplace_back(std::move(colors));
+                }
+            }
+
+            offset += element.count * stride;
+        }
+        else if (element.name == "face")
+        {
+            data = file->data();
+            if (!swap_bytes && is_mappable_triangle_list(data.subspan(offset), element))
+            {
+                const auto stride = ply_type_size(element.properties[0].list_count_type) + sizeof(glm::uvec3);
+                mesh.triangles = strided_view<glm::uvec3>(data.data() + offset + stride - sizeof(glm::uvec3),
+                    element.count, stride);
+                offset += element.count * stride;
+            }
+            else
+            {
+                auto faces = decode_binary_faces(data.subspan(offset), element, header.format, mesh.positions);
+                if (!faces)
+                {
+                    return std::nullopt;
+                }
+                auto triangles = std::make_shared<std::vector<glm::uvec3>>(std::move(faces->triangles));
+                mesh.triangles = std::span<const glm::uvec3>(*triangles);
+                mesh.storage.emplace_back(std::move(triangles));
+                offset += faces->size;
+            }
+            has_faces = true;
+        }
+        else if (has_lists)
+        {
+            // the location of any element after this one is unknown without parsing
+            break;
+        }
+        else
+        {
+            offset += element.count * get_scalar_offset(element, element.properties.size());
+        }
+    }
+
+    const auto has_face_element = std::ranges::any_of(header.elements, [](auto& e) { return e.name == "face"; });
+    if (mesh.positions.empty() || (has_face_element && !has_faces))
+    {
+        return std::nullopt;
+    }
+
+    mesh.storage.emplace_back(std::move(file));
+    return mesh;
+}
+
+struct ascii_chunk
+{
+    const char* begin;
+    const char* end;
+    size_t first_line;
+    size_t line_count;
+};
+
+static const char* skip_whitespace(const char* ptr, const char* end)
+{
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r'))
+    {
+        ptr++;
+    }
+    return ptr;
+}
+
+template <typename T>
+static const char* scan_number(const char* ptr, const char* end, T& value)
+{
+    ptr = skip_whitespace(ptr, end);
+    if (ptr < end && *ptr == '+')
+    {
+        ptr++;
+    }
+    const auto result = std::from_chars(ptr, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+static const char* scan_property(const char* ptr, const char* end, ply_type type, float& value)
+{
+    if (type == ply_type::float32)
+    {
+        return scan_number(ptr, end, value);
+    }
+    if (type == ply_type::float64)
+    {
+        double double_value = 0.;
+        ptr = scan_number(ptr, end, double_value);
+        value = static_cast<float>(double_value);
+        return ptr;
+    }
+    int64_t int_value = 0;
+    ptr = scan_number(ptr, end, int_value);
+    value = static_cast<float>(int_value);
+    return ptr;
+}
+
+// Blank lines, including ones that only hold the carriage return of a CRLF line break, don't count as elements.
+static bool is_blank_line(const char* begin, const char* end)
+{
+    return skip_whitespace(begin, end) == end;
+}
+
+static size_t count_element_lines(const char* begin, const char* end)
+{
+    size_t count = 0;
+    while (begin < end)
+    {
+        const auto* line_end = static_cast<const char*>(memchr(begin, '\n', end - begin));
+        if (!line_end)
+        {
+            line_end = end;
+        }
+        if (!is_blank_line(begin, line_end))
+        {
+            count++;
+        }
+        begin = line_end + 1;
+    }
+    return count;
+}
+
+static std::vector<ascii_chunk> split_into_line_chunks(const char* begin, const char* end, size_t first_line)
+{
+    const size_t min_chunk_size = 1 << 16;
+    const size_t chunk_count = 8 * std::max(1u, std::thread::hardware_concurrency());
+    const auto chunk_size = std::max(min_chunk_size, static_cast<size_t>(end - begin) / chunk_count);
+
+    std::vector<ascii_chunk> chunks;
+    while (begin < end)
+    {
+        const auto* chunk_end = begin + std::min(chunk_size, static_cast<size_t>(end - begin));
+        if (chunk_end < end)
+        {
+            const auto* newline = static_cast<const char*>(memchr(chunk_end, '\n', end - chunk_end));
+            chunk_end = newline ? newline + 1 : end;
+        }
+        chunks.push_back({ begin, chunk_end, 0, 0 });
+        begin = chunk_end;
+    }
+
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [](ascii_chunk& chunk)
+        {
+            chunk.line_count = count_element_lines(chunk.begin, chunk.end);
+        });
+
+    for (auto& chunk : chunks)
+    {
+        chunk.first_line = first_line;
+        first_line += chunk.line_count;
+    }
+
+    return chunks;
+}
+
+// Parses ASCII files that start with a vertex element followed by a face element, or that only have a vertex element.
+// The body is split into line aligned chunks which are scanned in parallel, after which the faces of each chunk are
+// triangulated in parallel; other files go through tinyply. The chunks are scanned in waves of the lines that are
+// available, so compressed files are scanned while the rest of them is decompressed.
+static std::optional<ply_mesh> try_parse_ascii_ply(const ply_header& header, const file_source& file)
+{
+    const auto is_point_cloud = header.elements.size() == 1;
+    if (header.format != ply_format::ascii
+        || header.elements.empty()
+        || header.elements[0].name != "vertex"
+        || (!is_point_cloud && header.elements[1].name != "face"))
+    {
+        return std::nullopt;
+    }
+
+    const auto& vertex_element = header.elements[0];
+    if (std::ranges::any_of(vertex_element.properties, [](auto& p) { return p.is_list; })
+        || (!is_point_cloud
+            && (header.elements[1].properties.size() != 1 || !header.elements[1].properties[0].is_list)))
+    {
+        return std::nullopt;
+    }
+
+    const std::array<std::string, 9> slot_names{ "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue" };
+    std::vector<int> slots(vertex_element.properties.size(), -1);
+    std::array<bool, 9> has_slot{};
+    std::array<ply_type, 9> slot_types{};
+    for (size_t i = 0; i < vertex_element.properties.size(); i++)
+    {
+        const auto it = std::ranges::find(slot_names, vertex_element.properties[i].name);
+        if (it != slot_names.end())
+        {
+            slots[i] = static_cast<int>(it - slot_names.begin());
+            has_slot[slots[i]] = true;
+            slot_types[slots[i]] = vertex_element.properties[i].type;
+        }
+    }
+
+    const auto has_group = [&](size_t first)
+    {
+        if (has_slot[first] != has_slot[first + 1] || has_slot[first] != has_slot[first + 2])
+        {
+            throw std::runtime_error("PLY file has incomplete vertex properties");
+        }
+        return has_slot[first];
+    };
+
+    if (!has_group(0))
+    {
+        return std::nullopt;
+    }
+    const auto has_normals = has_group(3);
+    const auto has_colors = has_group(6);
+
+    const auto vertex_count = vertex_element.count;
+    const auto face_count = is_point_cloud ? 0 : header.elements[1].count;
+    auto positions = std::make_shared<std::vector<glm::vec3>>(vertex_count);
+    auto normals = std::make_shared<std::vector<glm::vec3>>(has_normals ? vertex_count : 0);
+    auto colors = std::make_shared<std::vector<glm::u8vec3>>(has_colors ? vertex_count : 0);
+    auto triangles = std::make_shared<std::vector<glm::uvec3>>();
+
+    std::vector<ply_polygons> chunk_polygons;
+    std::atomic<bool> invalid_data = false;
+    std::atomic<bool> invalid_index = false;
+    size_t wave_offset = header.size, wave_size = ASCII_WAVE_SIZE, line_count = 0;
+    while (line_count < vertex_count + face_count && !invalid_data && !invalid_index)
+    {
+        const auto data = file.wait_for(wave_offset + wave_size);
+        const auto is_complete = data.size() < wave_offset + wave_size;
+        const auto* begin = reinterpret_cast<const char*>(data.data() + wave_offset);
+        const auto* end = reinterpret_cast<const char*>(data.data() + data.size());
+        if (!is_complete)
+        {
+            while (end > begin && end[-1] != '\n')
+            {
+                end--;
+            }
+            if (end == begin)
+            {
+                wave_size *= 2;
+                continue;
+            }
+        }
+        if (begin == end)
+        {
+            break;
+        }
+
+        const auto chunks = split_into_line_chunks(begin, end, line_count);
+        const auto first_chunk = chunk_polygons.size();
+        chunk_polygons.resize(first_chunk + chunks.size());
+        wave_offset = reinterpret_cast<const uint8_t*>(end) - data.data();
+        line_count = chunks.back().first_line + chunks.back().line_count;
+
+        std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](const ascii_chunk& chunk)
+            {
+                auto& polygons = chunk_polygons[first_chunk + (&chunk - chunks.data())];
+                const auto* ptr = chunk.begin;
+                for (auto line = chunk.first_line; line < chunk.first_line + chunk.line_count; line++)
+                {
+                    if (line >= vertex_count + face_count)
+                    {
+                        return;
+                    }
+
+                    const char* line_end;
+                    while (true)
+                    {
+                        line_end = static_cast<const char*>(memchr(ptr, '\n', chunk.end - ptr));
+                        if (!line_end)
+                        {
+                            line_end = chunk.end;
+                        }
+                        if (!is_blank_line(ptr, line_end))
+                        {
+                            break;
+                        }
+                        ptr = line_end + 1;
+                    }
+
+                    if (line < vertex_count)
+                    {
+                        std::array<float, 9> values{};
+                        for (size_t i = 0; i < slots.size() && ptr; i++)
+                        {
+                            float value;
+                            ptr = scan_property(ptr, line_end, vertex_element.properties[i].type, value);
+                            if (slots[i] >= 0)
+                            {
+                                values[slots[i]] = value;
+                            }
+                        }
+                        if (!ptr)
+                        {
+                            invalid_data = true;
+                            return;
+                        }
+
+                        (*positions)[line] = glm::vec3(values[0], values[1], values[2]);
+                        if (has_normals)
+                        {
+                            (*normals)[line] = glm::vec3(convert_normal_component(values[3], slot_types[3]),
+                                convert_normal_component(values[4], slot_types[4]),
+                                convert_normal_component(values[5], slot_types[5]));
+                        }
+                        if (has_colors)
+                        {
+                            (*colors)[line] = glm::u8vec3(convert_color_channel(values[6], slot_types[6]),
+                                convert_color_channel(values[7], slot_types[7]),
+                                convert_color_channel(values[8], slot_types[8]));
+                        }
+                    }
+                    else
+                    {
+                        uint32_t count = 0;
+                        ptr = scan_number(ptr, line_end, count);
+                        for (uint32_t i = 0; i < count && ptr; i++)
+                        {
+                            uint32_t index;
+                            ptr = scan_number(ptr, line_end, index);
+                            if (ptr && index >= vertex_count)
+                            {
+                                invalid_index = true;
+                                return;
+                            }
+                            polygons.indices.push_back(index);
+                        }
+                        if (!ptr)
+                        {
+                            invalid_data = true;
+                            return;
+                        }
+
+                        polygons.sizes.push_back(count);
+                    }
+
+                    ptr = line_end + 1;
+                }
+            });
+    }
+
+    if (invalid_data)
+    {
+        throw std::runtime_error("PLY file contains invalid ASCII data");
+    }
+    if (invalid_index)
+    {
+        throw std::runtime_error("PLY file has faces with vertex indices out of range");
+    }
+    if (line_count < vertex_count + face_count)
+    {
+        throw std::runtime_error("PLY file is truncated");
+    }
+
+    std::vector<size_t> first_triangles(chunk_polygons.size() + 1, 0);
+    for (size_t i = 0; i < chunk_polygons.size(); i++)
+    {
+        first_triangles[i + 1] = first_triangles[i] + count_triangles(chunk_polygons[i]);
+    }
+    triangles->resize(first_triangles.back());
+    parallel_for(chunk_polygons.size(), 1, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                triangulate_polygons(chunk_polygons[i], std::span<const glm::vec3>(*positions),
+                    triangles->data() + first_triangles[i]);
+                chunk_polygons[i] = {};
+            }
+        });
+
+    ply_mesh mesh;
+    mesh.positions = std::span<const glm::vec3>(*positions);
+    mesh.storage.emplace_back(positions);
+    if (has_normals)
+    {
+        mesh.normals = std::span<const glm::vec3>(*normals);
+        mesh.storage.emplace_back(normals);
+    }
+    if (has_colors)
+    {
+        mesh.colors = std::span<const glm::u8vec3>(*colors);
+        mesh.storage.emplace_back(colors);
+    }
+    mesh.triangles = std::span<const glm::uvec3>(*triangles);
+    mesh.storage.emplace_back(triangles);
+    return mesh;
+}
+
+static std::shared_ptr<tinyply::PlyData> try_request_properties_from_element(
+    tinyply::PlyFile& ply_file,
+    const std::string& element_key,
+    const std::vector<std::string>& property_keys
+)
+{
+    try
+    {
+        return ply_file.request_properties_from_element(element_key, property_keys);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+// Returns where the face element of a binary file starts, which is only known if no element before it has lists.
+static std::optional<size_t> find_binary_face_offset(const ply_header& header)
+{
+    auto offset = header.size;
+    for (const auto& element : header.elements)
+    {
+        if (element.name == "face")
+        {
+            return offset;
+        }
+        if (std::ranges::any_of(element.properties, [](auto& p) { return p.is_list; }))
+        {
+            return std::nullopt;
+        }
+        offset += element.count * get_scalar_offset(element, element.properties.size());
+    }
+    return std::nullopt;
+}
+
+static ply_type get_ply_type(tinyply::Type type)
+{
+    switch (type)
+    {
+    case tinyply::Type::INT8:
+        return ply_type::int8;
+    case tinyply::Type::UINT8:
+        return ply_type::uint8;
+    case tinyply::Type::INT16:
+        return ply_type::int16;
+    case tinyply::Type::UINT16:
+        return ply_type::uint16;
+    case tinyply::Type::INT32:
+        return ply_type::int32;
+    case tinyply::Type::UINT32:
+        return ply_type::uint32;
+    case tinyply::Type::FLOAT32:
+        return ply_type::float32;
+    case tinyply::Type::FLOAT64:
+        return ply_type::float64;
+    default:
+        throw std::runtime_error("Invalid PLY type");
+    }
+}
+
+// Lets tinyply read files from memory, which also covers decompressed ones.
+class memory_buffer : public std::streambuf
+{
+public:
+    memory_buffer(std::span<const uint8_t> data)
+    {
+        auto* begin = const_cast<char*>(reinterpret_cast<const char*>(data.data()));
+        setg(begin, begin, begin + data.size());
+    }
+
+protected:
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode) override
+    {
+        auto* base = direction == std::ios_base::beg ? eback() : direction == std::ios_base::cur ? gptr() : egptr();
+        auto* position = base + offset;
+        if (position < eback() || position > egptr())
+        {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), position, egptr());
+        return pos_type(position - eback());
+    }
+
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode) override
+    {
+        return seekoff(off_type(position), std::ios_base::beg, mode);
+    }
+};
+
+static ply_mesh read_ply_with_tinyply(const ply_header& header, std::shared_ptr<const file_source> file)
+{
+    memory_buffer buffer(file->data());
+    std::istream stream(&buffer);
+    tinyply::PlyFile ply_file;
+    ply_file.parse_header(stream);
+
+    // tinyply stores lists back to back without their counts, so faces are decoded from the file where possible
+    const auto face_offset = header.format != ply_format::ascii ? find_binary_face_offset(header) : std::nullopt;
+
+    auto position_data = ply_file.request_properties_from_element("vertex", { "x", "y", "z" });
+    auto normal_data = try_request_properties_from_element(ply_file, "vertex", { "nx", "ny", "nz" });
+    auto color_data = try_request_properties_from_element(ply_file, "vertex", { "red", "green", "blue" });
+    // point clouds have no faces
+    auto index_data = face_offset ? nullptr
+        : try_request_properties_from_element(ply_file, "face", { "vertex_indices" });
+    ply_file.read(stream);
+
+    ply_mesh mesh;
+    // tinyply has already swapped the bytes of big endian files
+    const auto get_vec3s = [&](std::shared_ptr<tinyply::PlyData> data, bool normalize) -> strided_view<glm::vec3>
+    {
+        const auto type = get_ply_type(data->t);
+        if (type == ply_type::float32)
+        {
+            mesh.storage.emplace_back(data);
+            return strided_view<glm::vec3>(data->buffer.get(), data->count, sizeof(glm::vec3));
+        }
+        auto values = std::make_shared<std::vector<glm::vec3>>(data->count);
+        convert_vec3s(data->buffer.get(), 3 * ply_type_size(type), data->count, type, false, normalize,
+            values->data());
+        mesh.storage.emplace_back(values);
+        return std::span<const glm::vec3>(*values);
+    };
+
+    mesh.positions = get_vec3s(position_data, false);
+
+    if (face_offset)
+    {
+        const auto& element = *std::ranges::find(header.elements, "face", &ply_element::name);
+        auto faces = decode_binary_faces(file->data().subspan(*face_offset), element, header.format, mesh.positions);
+        if (!faces)
+        {
+            throw std::runtime_error("PLY face element has no vertex_indices list");
+        }
+        auto triangles = std::make_shared<std::vector<glm::uvec3>>(std::move(faces->triangles));
+        mesh.triangles = std::span<const glm::uvec3>(*triangles);
+        mesh.storage.emplace_back(std::move(triangles));
+    }
+    else if (index_data)
+    {
+        if ((index_data->t != tinyply::Type::INT32 && index_data->t != tinyply::Type::UINT32)
+            || index_data->buffer.size_bytes() != index_data->count * sizeof(glm::uvec3))
+        {
+            throw std::runtime_error("PLY file has faces which are not triangles of 32-bit indices");
+        }
+        mesh.triangles = strided_view<glm::uvec3>(index_data->buffer.get(), index_data->count, sizeof(glm::uvec3));
+        mesh.storage.emplace_back(index_data);
+    }
+
+    if (normal_data)
+    {
+        mesh.normals = get_vec3s(normal_data, true);
+    }
+
+    if (color_data)
+    {
+        const auto type = get_ply_type(color_data->t);
+        if (type == ply_type::uint8)
+        {
+            mesh.colors = strided_view<glm::u8vec3>(color_data->buffer.get(), color_data->count, sizeof(glm::u8vec3));
+            mesh.storage.emplace_back(color_data);
+        }
+        else
+        {
+            auto colors = std::make_shared<std::vector<glm::u8vec3>>(color_data->count);
+            convert_colors(color_data->buffer.get(), 3 * ply_type_size(type), color_data->count, type, false,
+                colors->data());
+            mesh.colors = std::span<const glm::u8vec3>(*colors);
+            mesh.storage.emplace_back(std::move(colors));
+        }
+    }
+
+    return mesh;
+}
+
+// Waits until the header of a file that may still be arriving is available.
+static ply_header read_ply_header(const file_source& file)
+{
+    for (size_t size = 1 << 12;; size *= 2)
+    {
+        const auto data = file.wait_for(size);
+        const std::string_view text(reinterpret_cast<const char*>(data.data()), data.size());
+        const auto end_header = text.find("end_header");
+        if (data.size() < size || (end_header != text.npos && text.find('\n', end_header) != text.npos))
+        {
+            return parse_ply_header(data);
+        }
+    }
+}
+
+static ply_mesh read_ply(const ply_header& header, std::shared_ptr<const file_source> file)
+{
+    if (auto mesh = try_parse_ascii_ply(header, *file))
+    {
+        return std::move(*mesh);
+    }
+
+    if (auto mesh = try_map_binary_ply(header, file))
+    {
+        return std::move(*mesh);
+    }
+
+    return read_ply_with_tinyply(header, std::move(file));
+}
+
+ply_mesh read_ply(const std::string& path)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto type = get_compression(path);
+    std::shared_ptr<const decompressed_file> decompressed;
+    std::shared_ptr<const file_source> file;
+    if (type == compression::none)
+    {
+        file = std::make_shared<const mapped_file>(path);
+    }
+    else
+    {
+        decompressed = std::make_shared<const decompressed_file>(path, type);
+        file = decompressed;
+    }
+
+    auto mesh = read_ply(read_ply_header(*file), file);
+    const auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (!decompressed)
+    {
+        const auto size = file->data().size() / (1024. * 1024.);
+        std::printf("Parsed %.2lf MB in %.2lf ms (%.2lf MB/s)\n", size, time, size / time * 1000.);
+        return mesh;
+    }
+
+    // the time parsing didn't wait for decompression, which finishes before its time is known
+    const auto parse_time = time - decompressed->get_wait_time();
+    const auto size = file->data().size() / (1024. * 1024.);
+    const auto compressed_size = decompressed->get_compressed_size() / (1024. * 1024.);
+    const auto decompression_time = decompressed->get_decompression_time();
+    std::printf("Decompressed %.2lf MB to %.2lf MB in %.2lf ms (%.2lf MB/s), parsed in %.2lf ms (%.2lf MB/s)\n",
+        compressed_size, size, decompression_time, size / decompression_time * 1000., parse_time,
+        size / parse_time * 1000.);
+    return mesh;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+template <typename T>
+struct strided_view
+{
+    const uint8_t* data;
+    size_t count;
+    size_t stride;
+
+    strided_view()
+        : data(nullptr), count(0), stride(sizeof(T))
+    {
+    }
+
+    strided_view(const void* data, size_t count, size_t stride)
+        : data(static_cast<const uint8_t*>(data)), count(count), stride(stride)
+    {
+    }
+
+    strided_view(std::span<const T> span)
+        : data(reinterpret_cast<const uint8_t*>(span.data())), count(span.size()), stride(sizeof(T))
+    {
+    }
+
+    T operator[](size_t i) const
+    {
+        T value;
+        memcpy(&value, data + i * stride, sizeof(T));
+        return value;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    bool is_contiguous() const
+    {
+        return stride == sizeof(T);
+    }
+};
+
+enum class ply_format
+{
+    ascii,
+    binary_little_endian,
+    binary_big_endian,
+};
+
+enum class ply_type
+{
+    int8,
+    uint8,
+    int16,
+    uint16,
+    int32,
+    uint32,
+    float32,
+    float64,
+};
+
+size_t ply_type_size(ply_type type);
+
+struct ply_property
+{
+    std::string name;
+    ply_type type;
+    bool is_list;
+    ply_type list_count_type;
+};
+
+struct ply_element
+{
+    std::string name;
+    size_t count;
+    std::vector<ply_property> properties;
+};
+
+struct ply_header
+{
+    ply_format format;
+    std::vector<ply_element> elements;
+    size_t size;
+};
+
+ply_header parse_ply_header(std::span<const uint8_t> data);
+
+struct ply_mesh
+{
+    strided_view<glm::vec3> positions;
+    strided_view<glm::vec3> normals;
+    strided_view<glm::u8vec3> colors;
+    strided_view<glm::uvec3> triangles;
+
+    // keeps the memory referenced by the views alive
+    std::vector<std::shared_ptr<const void>> storage;
+};
+
+ply_mesh read_ply(const std::string& path);
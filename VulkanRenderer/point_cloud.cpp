@@ -0,0 +1,67 @@
+#include "stdafx.h"
+#include "point_cloud.h"
+#include "parallel.h"
+
+static const uint32_t GRID_RESOLUTION = 256; // must be kept in sync with the help of --decimate_points
+static const size_t BLOCK_SIZE = 1 << 16;
+
+static uint32_t get_cell(const glm::vec3& position, const glm::vec4& transformation)
+{
+    const auto normalized = (position - glm::vec3(transformation)) * transformation.w;
+    uint32_t cell = 0;
+    for (auto j = 2; j >= 0; j--)
+    {
+        const auto coordinate = static_cast<int>((normalized[j] + 1.f) / 2.f * GRID_RESOLUTION);
+        cell = cell * GRID_RESOLUTION + static_cast<uint32_t>(glm::clamp(coordinate, 0,
+            static_cast<int>(GRID_RESOLUTION) - 1));
+    }
+    return cell;
+}
+
+// Scrambles the point index, so the kept points are spread over the cell instead of following the scan order.
+static uint32_t hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+std::vector<uint32_t> decimate_points(const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    uint32_t max_points_per_cell)
+{
+    assert(max_points_per_cell > 0);
+    std::vector<uint32_t> cell_counts(GRID_RESOLUTION * GRID_RESOLUTION * GRID_RESOLUTION, 0);
+    parallel_for(positions.size(), BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                std::atomic_ref(cell_counts[get_cell(positions[i], transformation)])
+                    .fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+
+    // a point of a cell with n points is kept with probability max_points_per_cell / n
+    std::vector<uint8_t> is_kept(positions.size());
+    parallel_for(positions.size(), BLOCK_SIZE, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                const auto count = cell_counts[get_cell(positions[i], transformation)];
+                is_kept[i] = hash(static_cast<uint32_t>(i)) % count < max_points_per_cell;
+            }
+        });
+
+    std::vector<uint32_t> kept;
+    kept.reserve(std::count(is_kept.begin(), is_kept.end(), uint8_t(1)));
+    for (uint32_t i = 0; i < is_kept.size(); i++)
+    {
+        if (is_kept[i])
+        {
+            kept.push_back(i);
+        }
+    }
+    return kept;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "ply_reader.h"
+
+// Thins a point cloud where it is denser than max_points_per_cell points per cell of a uniform grid over the model,
+// keeping about that many points of every such cell and all points of sparser ones. Returns the indices of the kept
+// points in their original order, which doesn't depend on the thread count.
+std::vector<uint32_t> decimate_points(const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    uint32_t max_points_per_cell);
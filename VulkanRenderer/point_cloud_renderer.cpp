@@ -0,0 +1,148 @@
+#include "stdafx.h"
+#include "point_cloud_renderer.h"
+
+#define SPLAT_GROUP_SIZE 256u // must be kept in sync with splat.comp
+// invocations loop over the points, so large clouds don't exceed the dispatch limits
+#define MAX_SPLAT_GROUP_COUNT 65535u
+
+point_cloud_renderer::point_cloud_renderer(vk::Device device, memory_allocator& allocator,
+    vk::DescriptorPool descriptor_pool, vk::Extent2D framebuffer_size,
+    const pipeline* splat_pipeline, const pipeline* resolve_pipeline, const model* mdl)
+    : mdl(mdl)
+    , splat_pipeline(splat_pipeline)
+    , resolve_pipeline(resolve_pipeline)
+    , uniform_buffer(device, allocator, vk::BufferUsageFlagBits::eUniformBuffer, HOST_VISIBLE_AND_COHERENT,
+        sizeof(model_uniform_data), memory_category::other)
+    , pixel_buffer(device, allocator,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        static_cast<vk::DeviceSize>(framebuffer_size.width) * framebuffer_size.height * sizeof(uint64_t),
+        memory_category::attachment)
+    , framebuffer_size(framebuffer_size)
+{
+    std::array splat_set_layouts{ splat_pipeline->set_layout.get() };
+    splat_descriptor_set = std::move(device.allocateDescriptorSetsUnique(
+        vk::DescriptorSetAllocateInfo()
+        .setDescriptorPool(descriptor_pool)
+        .setSetLayouts(splat_set_layouts)
+    )[0]);
+
+    std::array resolve_set_layouts{ resolve_pipeline->set_layout.get() };
+    resolve_descriptor_set = std::move(device.allocateDescriptorSetsUnique(
+        vk::DescriptorSetAllocateInfo()
+        .setDescriptorPool(descriptor_pool)
+        .setSetLayouts(resolve_set_layouts)
+    )[0]);
+
+    auto model_ub_info = vk::DescriptorBufferInfo()
+        .setBuffer(uniform_buffer.buf.get())
+        .setRange(uniform_buffer.size);
+
+    auto pixel_buffer_info = vk::DescriptorBufferInfo()
+        .setBuffer(pixel_buffer.buf.get())
+        .setRange(pixel_buffer.size);
+
+    device.updateDescriptorSets({
+        vk::WriteDescriptorSet()
+        .setDstBinding(0)
+        .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(splat_descriptor_set.get())
+        .setPBufferInfo(&model_ub_info),
+        vk::WriteDescriptorSet()
+        .setDstBinding(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(splat_descriptor_set.get())
+        .setPBufferInfo(&pixel_buffer_info),
+        vk::WriteDescriptorSet()
+        .setDstBinding(0)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1)
+        .setDstSet(resolve_descriptor_set.get())
+        .setPBufferInfo(&pixel_buffer_info),
+        }, {});
+}
+
+void point_cloud_renderer::update(vk::Device device, model_uniform_data model_uniform_data) const
+{
+    uniform_buffer.update(device, &model_uniform_data);
+}
+
+void point_cloud_renderer::draw_outside_renderpass(vk::CommandBuffer command_buffer) const
+{
+    // the previous frame has been resolved, since frames using the buffer don't overlap
+    command_buffer.fillBuffer(pixel_buffer.buf.get(), 0, pixel_buffer.size, UINT32_MAX);
+
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eHost | vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::DependencyFlagBits(),
+        {},
+        {
+            vk::BufferMemoryBarrier()
+            .setBuffer(uniform_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eHostWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+            .setSize(uniform_buffer.size),
+            vk::BufferMemoryBarrier()
+            .setBuffer(pixel_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+            .setSize(pixel_buffer.size)
+        },
+        {}
+    );
+
+    const splat_push_constants push_constants{
+        mdl->vertex_buffer->address,
+        mdl->vertex_count,
+        framebuffer_size.width,
+        framebuffer_size.height,
+    };
+
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, splat_pipeline->layout.get(), 0,
+        splat_descriptor_set.get(), {});
+    command_buffer.pushConstants(splat_pipeline->layout.get(), vk::ShaderStageFlagBits::eCompute, 0,
+        sizeof(push_constants), &push_constants);
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, splat_pipeline->pl.get());
+    command_buffer.dispatch(
+        std::min((mdl->vertex_count + SPLAT_GROUP_SIZE - 1) / SPLAT_GROUP_SIZE, MAX_SPLAT_GROUP_COUNT), 1, 1);
+
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eFragmentShader,
+        vk::DependencyFlagBits(),
+        {},
+        {
+            vk::BufferMemoryBarrier()
+            .setBuffer(pixel_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+            .setSize(pixel_buffer.size)
+        },
+        {}
+    );
+}
+
+void point_cloud_renderer::draw(vk::CommandBuffer command_buffer) const
+{
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, resolve_pipeline->layout.get(), 0,
+        resolve_descriptor_set.get(), {});
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, resolve_pipeline->pl.get());
+
+    // the triangle covers the framebuffer and pixels are read by their framebuffer coordinates
+    command_buffer.setViewport(0, {
+                                   vk::Viewport().setWidth(static_cast<float>(framebuffer_size.width))
+                                                 .setHeight(static_cast<float>(framebuffer_size.height))
+                                                 .setMaxDepth(1.0)
+        });
+
+    command_buffer.setScissor(0, { vk::Rect2D().setExtent(framebuffer_size) });
+
+    const splat_resolve_push_constants push_constants{ framebuffer_size.width };
+    command_buffer.pushConstants(resolve_pipeline->layout.get(), vk::ShaderStageFlagBits::eFragment, 0,
+        sizeof(push_constants), &push_constants);
+    command_buffer.draw(3, 1, 0, 0);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "renderer.h"
+#include "data_types.h"
+#include "model.h"
+#include "pipeline.h"
+
+// Renders the points of a point cloud model with a compute shader instead of the rasterizer, which is faster for
+// points that cover about a pixel. Every point is splatted into a buffer of packed depths and colors with 64-bit
+// atomics, which is then drawn into the render pass with depths, so the frame is depth tested as usual.
+class point_cloud_renderer : public renderer
+{
+    const model* mdl;
+    const pipeline* splat_pipeline;
+    const pipeline* resolve_pipeline;
+    buffer uniform_buffer;
+    buffer pixel_buffer;
+    vk::UniqueDescriptorSet splat_descriptor_set;
+    vk::UniqueDescriptorSet resolve_descriptor_set;
+    vk::Extent2D framebuffer_size;
+
+public:
+    point_cloud_renderer(vk::Device device, memory_allocator& allocator, vk::DescriptorPool descriptor_pool,
+        vk::Extent2D framebuffer_size, const pipeline* splat_pipeline, const pipeline* resolve_pipeline,
+        const model* mdl);
+    void update(vk::Device device, model_uniform_data model_uniform_data) const override;
+
+    void draw_outside_renderpass(vk::CommandBuffer command_buffer) const override;
+
+    void draw(vk::CommandBuffer command_buffer) const override;
+};
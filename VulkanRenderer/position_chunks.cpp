@@ -0,0 +1,313 @@
+#include "stdafx.h"
+#include <numeric>
+#include "position_chunks.h"
+#include "parallel.h"
+#include "vertex_packing.h"
+
+// Target triangle count of a chunk. Every chunk is a separate BLAS, which bounds the useful chunk count.
+static const size_t CHUNK_TRIANGLE_COUNT = 1 << 15;
+static const uint32_t MAX_GRID_RESOLUTION = 8;
+
+static const size_t BLOCK_SIZE = 1 << 14;
+
+static uint32_t get_grid_resolution(size_t triangle_count)
+{
+    const auto resolution = std::round(std::cbrt(static_cast<double>(triangle_count) / CHUNK_TRIANGLE_COUNT));
+    return glm::clamp(static_cast<uint32_t>(resolution), 1u, MAX_GRID_RESOLUTION);
+}
+
+chunked_mesh split_position_chunks(const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    const std::vector<strided_view<glm::uvec3>>& runs)
+{
+    assert(!runs.empty());
+    const auto resolution = get_grid_resolution(runs[0].size());
+    const auto cell_count = resolution * resolution * resolution;
+
+    std::vector<std::vector<uint32_t>> triangle_cells(runs.size());
+    std::vector<uint8_t> is_cell_used(cell_count);
+    for (size_t r = 0; r < runs.size(); r++)
+    {
+        const auto& triangles = runs[r];
+        auto& cells = triangle_cells[r];
+        cells.resize(triangles.size());
+        parallel_for(triangles.size(), BLOCK_SIZE, [&](size_t first, size_t last)
+            {
+                for (auto i = first; i < last; i++)
+                {
+                    const auto triangle = triangles[i];
+                    const auto centroid = (positions[triangle.x] + positions[triangle.y] + positions[triangle.z]) / 3.f;
+                    const auto normalized = (centroid - glm::vec3(transformation)) * transformation.w;
+
+                    uint32_t cell = 0;
+                    for (auto j = 2; j >= 0; j--)
+                    {
+                        const auto coordinate = static_cast<int>((normalized[j] + 1.f) / 2.f * resolution);
+                        cell = cell * resolution + static_cast<uint32_t>(glm::clamp(coordinate, 0,
+                            static_cast<int>(resolution) - 1));
+                    }
+                    cells[i] = cell;
+                }
+            });
+
+        for (const auto cell : cells)
+        {
+            is_cell_used[cell] = 1;
+        }
+    }
+
+    std::vector<uint32_t> cell_chunks(cell_count);
+    uint32_t chunk_count = 0;
+    for (uint32_t i = 0; i < cell_count; i++)
+    {
+        cell_chunks[i] = chunk_count;
+        chunk_count += is_cell_used[i];
+    }
+
+    chunked_mesh mesh;
+    mesh.chunks.resize(chunk_count);
+    mesh.runs.resize(runs.size());
+    mesh.chunk_triangle_counts.resize(runs.size());
+
+    // counting sort of every run by chunk, triangles keep their order within a chunk
+    std::vector<std::vector<uint32_t>> run_chunk_offsets(runs.size());
+    for (size_t r = 0; r < runs.size(); r++)
+    {
+        auto& counts = mesh.chunk_triangle_counts[r];
+        counts.assign(chunk_count, 0);
+        for (const auto cell : triangle_cells[r])
+        {
+            counts[cell_chunks[cell]]++;
+        }
+
+        auto& offsets = run_chunk_offsets[r];
+        offsets.resize(chunk_count + 1);
+        offsets[0] = 0;
+        std::inclusive_scan(counts.begin(), counts.end(), offsets.begin() + 1);
+
+        std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+        mesh.runs[r].resize(runs[r].size());
+        for (size_t i = 0; i < runs[r].size(); i++)
+        {
+            mesh.runs[r][cursors[cell_chunks[triangle_cells[r][i]]]++] = runs[r][i];
+        }
+    }
+
+    // chunk vertices are numbered in order of first use, so the vertex order of optimized meshes is mostly kept
+    std::vector<uint32_t> vertex_chunks(positions.size(), UINT32_MAX);
+    std::vector<uint32_t> chunk_vertices(positions.size());
+    for (uint32_t c = 0; c < chunk_count; c++)
+    {
+        auto& chunk = mesh.chunks[c];
+        chunk.first_vertex = static_cast<uint32_t>(mesh.source_vertices.size());
+        for (size_t r = 0; r < runs.size(); r++)
+        {
+            for (auto i = run_chunk_offsets[r][c]; i < run_chunk_offsets[r][c + 1]; i++)
+            {
+                auto& triangle = mesh.runs[r][i];
+                for (auto j = 0; j < 3; j++)
+                {
+                    const auto v = triangle[j];
+                    if (vertex_chunks[v] != c)
+                    {
+                        vertex_chunks[v] = c;
+                        chunk_vertices[v] = static_cast<uint32_t>(mesh.source_vertices.size()) - chunk.first_vertex;
+                        mesh.source_vertices.push_back(v);
+                    }
+                    triangle[j] = chunk_vertices[v];
+                }
+            }
+        }
+        chunk.vertex_count = static_cast<uint32_t>(mesh.source_vertices.size()) - chunk.first_vertex;
+        chunk.first_index = 3 * run_chunk_offsets[0][c];
+        chunk.index_count = 3 * mesh.chunk_triangle_counts[0][c];
+    }
+
+    return mesh;
+}
+
+// Returns a position that the snorm16 encoding of pack_vertices rounds to step, or that is step for the other formats
+// once it is dequantized. The snorm16 encoding truncates towards zero, so the position is a quarter step away from
+// step on the side of zero.
+static float encode_grid_step(int32_t step, position_format format)
+{
+    if (format != position_format::snorm16)
+    {
+        return static_cast<float>(step) / INT16_MAX;
+    }
+    const auto encoded = step >= 0 ? step + .25 : step - .25;
+    return static_cast<float>((encoded - INT16_MIN) / (UINT16_MAX / 2.) - 1.);
+}
+
+void quantize_position_chunks(std::span<glm::vec3> chunk_positions, const glm::vec4& transformation,
+    position_format format, std::vector<position_chunk>& chunks)
+{
+    const auto normalize_position = [&](const glm::vec3& position)
+    {
+        return (position - glm::vec3(transformation)) * transformation.w;
+    };
+
+    std::vector<glm::vec3> centers(chunks.size());
+    std::vector<float> extents(chunks.size());
+    parallel_for(chunks.size(), 1, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                const auto& chunk = chunks[i];
+                assert(chunk.vertex_count > 0);
+                auto min = normalize_position(chunk_positions[chunk.first_vertex]);
+                auto max = min;
+                for (auto v = chunk.first_vertex; v < chunk.first_vertex + chunk.vertex_count; v++)
+                {
+                    const auto position = normalize_position(chunk_positions[v]);
+                    min = glm::min(min, position);
+                    max = glm::max(max, position);
+                }
+                centers[i] = (min + max) / 2.f;
+                extents[i] = glm::max(max.x - min.x, glm::max(max.y - min.y, max.z - min.z)) / 2.f;
+            }
+        });
+
+    // Rounding the origin and the positions of a chunk to the grid adds up to a step to their distance, which has to
+    // stay within INT16_MAX steps. Grid coordinates stay below 2^24, so they and their multiples of the step are
+    // exact floats.
+    const auto max_extent = *std::max_element(extents.begin(), extents.end());
+    auto exponent = -23;
+    if (max_extent > 0.f)
+    {
+        std::frexp(max_extent / (INT16_MAX - 1), &exponent);
+        exponent = std::max(exponent, -23);
+    }
+    const auto step = std::ldexp(1.f, exponent);
+
+    parallel_for(chunks.size(), 1, [&](size_t first, size_t last)
+        {
+            for (auto i = first; i < last; i++)
+            {
+                auto& chunk = chunks[i];
+                const auto origin = glm::round(centers[i] / step);
+                for (auto v = chunk.first_vertex; v < chunk.first_vertex + chunk.vertex_count; v++)
+                {
+                    const auto steps = glm::round(normalize_position(chunk_positions[v]) / step) - origin;
+                    assert(glm::all(glm::lessThanEqual(glm::abs(steps), glm::vec3(INT16_MAX))));
+                    for (auto j = 0; j < 3; j++)
+                    {
+                        chunk_positions[v][j] = encode_grid_step(static_cast<int32_t>(steps[j]), format);
+                    }
+                }
+                chunk.dequantization = glm::vec4(origin * step, INT16_MAX * step);
+            }
+        });
+}
+
+// Dequantizes the position of a packed vertex like the vertex shader, with the snorm16 conversion of the vertex input.
+static glm::vec3 dequantize_packed_position(const uint8_t* vertex, const vertex_format_info& info,
+    position_format format, const glm::vec4& dequantization)
+{
+    glm::vec3 position;
+    if (format == position_format::snorm16)
+    {
+        glm::i16vec3 snorm;
+        memcpy(&snorm, vertex + info.attributes[0].offset, sizeof(snorm));
+        for (auto j = 0; j < 3; j++)
+        {
+            position[j] = glm::max(static_cast<float>(snorm[j]) / INT16_MAX, -1.f);
+        }
+    }
+    else
+    {
+        memcpy(&position, vertex + info.attributes[0].offset, sizeof(position));
+    }
+
+    // kept apart, so the compiler can't fuse them any more than the precise shader code
+    volatile float scaled[3];
+    for (auto j = 0; j < 3; j++)
+    {
+        scaled[j] = position[j] * dequantization.w;
+    }
+    return glm::vec3(scaled[0], scaled[1], scaled[2]) + glm::vec3(dequantization);
+}
+
+bool test_position_chunks()
+{
+    // a bumpy height field that is large enough to be split into a few chunks along every axis
+    const size_t row_size = 400;
+    std::vector<glm::vec3> positions;
+    for (size_t y = 0; y <= row_size; y++)
+    {
+        for (size_t x = 0; x <= row_size; x++)
+        {
+            positions.emplace_back(x * .37f, y * .41f, 40.f * std::sin(.05f * x) * std::cos(.07f * y));
+        }
+    }
+    std::vector<glm::uvec3> triangles;
+    for (uint32_t y = 0; y < row_size; y++)
+    {
+        for (uint32_t x = 0; x < row_size; x++)
+        {
+            const auto corner = static_cast<uint32_t>(y * (row_size + 1) + x);
+            const auto above = corner + static_cast<uint32_t>(row_size + 1);
+            triangles.emplace_back(corner, corner + 1, above);
+            triangles.emplace_back(corner + 1, above + 1, above);
+        }
+    }
+    const strided_view<glm::vec3> position_view = std::span<const glm::vec3>(positions);
+    const auto transformation = unitize(position_view);
+    const auto chunked = split_position_chunks(position_view, transformation,
+        { std::span<const glm::uvec3>(triangles) });
+
+    size_t shared_count = 0;
+    size_t mismatch_count = 0;
+    for (const auto format : { position_format::snorm16, position_format::float32 })
+    {
+        const vertex_layout layout{ format, false };
+        const auto info = get_vertex_format_info(layout);
+        auto chunks = chunked.chunks;
+        std::vector<glm::vec3> chunk_positions(chunked.source_vertices.size());
+        for (size_t i = 0; i < chunk_positions.size(); i++)
+        {
+            chunk_positions[i] = positions[chunked.source_vertices[i]];
+        }
+        quantize_position_chunks(chunk_positions, transformation, format, chunks);
+
+        const std::vector<glm::vec3> normals(chunk_positions.size(), glm::vec3(0.f, 0.f, 1.f));
+        std::vector<uint8_t> vertices(chunk_positions.size() * info.size);
+        std::vector<std::optional<glm::vec3>> dequantized(positions.size());
+        for (const auto& chunk : chunks)
+        {
+            pack_vertices(std::span<const glm::vec3>(chunk_positions), std::span<const glm::vec3>(normals), {},
+                glm::vec4(0.f, 0.f, 0.f, 1.f), chunk.first_vertex, chunk.vertex_count, layout,
+                vertices.data() + chunk.first_vertex * info.size);
+            for (auto v = chunk.first_vertex; v < chunk.first_vertex + chunk.vertex_count; v++)
+            {
+                const auto source = chunked.source_vertices[v];
+                const auto position = dequantize_packed_position(vertices.data() + v * info.size, info, format,
+                    chunk.dequantization);
+                const auto expected = (positions[source] - glm::vec3(transformation)) * transformation.w;
+                const auto error = glm::abs(position - expected);
+                if (glm::max(error.x, glm::max(error.y, error.z)) > chunk.dequantization.w / INT16_MAX)
+                {
+                    std::printf("Vertex %u is more than a grid step away from its position\n", source);
+                    mismatch_count++;
+                }
+
+                auto& first_position = dequantized[source];
+                if (!first_position)
+                {
+                    first_position = position;
+                    continue;
+                }
+
+                shared_count++;
+                if (*first_position != position)
+                {
+                    std::printf("Vertex %u dequantizes to different positions in different chunks\n", source);
+                    mismatch_count++;
+                }
+            }
+        }
+    }
+
+    std::printf("Compared %zu shared vertices of %zu chunks: %zu mismatches\n", shared_count,
+        chunked.chunks.size(), mismatch_count);
+    return shared_count > 0 && mismatch_count == 0;
+}
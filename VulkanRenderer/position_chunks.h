@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "ply_reader.h"
+#include "vertex_format.h"
+
+// Layout must be kept in sync with model.vert and model.rchit.
+struct position_chunk
+{
+    // maps the quantized positions of the chunk to normalized model space: position * w + xyz
+    glm::vec4 dequantization;
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    // full resolution triangles of the chunk, which are ray traced as an instance of their own
+    uint32_t first_index;
+    uint32_t index_count;
+};
+
+// Where the cull shader finds the indices and vertices of a chunk. Layout must be kept in sync with cull.comp.
+struct chunk_residency
+{
+    // added to the first index of the meshlets of the chunk
+    uint32_t first_index;
+    int32_t vertex_offset;
+    // meshlets of chunks that aren't resident are culled
+    uint32_t is_resident;
+    uint32_t padding;
+};
+
+struct chunked_mesh
+{
+    std::vector<position_chunk> chunks;
+    // source vertex of every chunk vertex, vertices shared by triangles of several chunks are duplicated
+    std::vector<uint32_t> source_vertices;
+    // the triangle runs sorted by chunk, indexing the vertices of their chunk relative to its first vertex
+    std::vector<std::vector<glm::uvec3>> runs;
+    // number of triangles of every chunk in every run
+    std::vector<std::vector<uint32_t>> chunk_triangle_counts;
+};
+
+// Assigns the triangles of all runs to the cells of a uniform grid over the model by their centroid and gives every
+// non-empty cell its own copy of the vertices it uses, so positions can be quantized relative to the cell's bounds.
+// The grid resolution grows with the triangle count of the first run.
+chunked_mesh split_position_chunks(const strided_view<glm::vec3>& positions, const glm::vec4& transformation,
+    const std::vector<strided_view<glm::uvec3>>& runs);
+
+// Quantizes the positions of every chunk to whole steps of a grid that all chunks share, relative to a grid point near
+// the center of the chunk. The step is a power of two in normalized model space, large enough for the biggest chunk.
+// chunk_positions are rewritten in place to values that pack_vertices encodes to those steps with the identity
+// transformation, and the dequantization of the chunks maps them back. A vertex that is duplicated into several
+// chunks then dequantizes to bit-identical positions in all of them, so chunks don't crack apart, as long as the
+// multiplication and addition of the dequantization aren't fused. Half positions round the steps to 11 bits, so only
+// snorm16 and float32 positions are exact.
+void quantize_position_chunks(std::span<glm::vec3> chunk_positions, const glm::vec4& transformation,
+    position_format format, std::vector<position_chunk>& chunks);
+
+// Splits and quantizes a mesh into chunks, packs them and checks that every vertex that is shared by several chunks
+// dequantizes to the same position in all of them. Prints the mismatches and returns false if there are any.
+bool test_position_chunks();
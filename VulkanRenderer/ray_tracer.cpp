@@ -4,21 +4,27 @@
 
 ray_tracer::ray_tracer(
     const vulkan_context& context,
+    upload_manager& uploads,
     const std::vector<vk::Image>& images,
     vk::Extent2D framebuffer_size,
-    const model* model,
+    std::span<const model> meshes,
+    std::span<const glm::mat4> transforms,
+    std::span<const uint32_t> first_instances,
     const pipeline* ui_pipeline,
-    const image_with_view* font_image)
+    const image_with_view* font_image,
+    std::mutex* queue_mutex)
     : ui_pipeline(ui_pipeline)
     , font_image(font_image)
-    , ray_tracing_model(context.physical_device, context.device, context.command_pool.get(), context.queue, model)
+    , ray_tracing_model(context.device, context.allocator, context.queues, uploads, meshes, transforms,
+        first_instances, queue_mutex)
     , textured_quad_pipeline(create_textured_quad_pipeline(context.device, context.render_pass.get()))
-    , model_pipeline(create_ray_tracing_pipeline(context.device))
+    , model_pipeline(create_ray_tracing_pipeline(context.device, meshes.front().layout))
     , shader_binding_table(
-        create_shader_binding_table(context.physical_device, context.device, model_pipeline.pl.get()))
+        create_shader_binding_table(context.physical_device, context.device, context.allocator,
+            model_pipeline.pl.get()))
     , frame_set(create_frame_set(context, framebuffer_size, images, [&]()
         {
-            return new ray_tracing_renderer(context.physical_device, context.device, context.descriptor_pool.get(),
+            return new ray_tracing_renderer(context.device, context.allocator, context.descriptor_pool.get(),
                 framebuffer_size, &model_pipeline, &textured_quad_pipeline,
                 shader_binding_table.get(), &ray_tracing_model);
         }, ui_pipeline, font_image))
@@ -31,7 +37,7 @@ ray_tracer::ray_tracer(
         {
             frame_set = create_frame_set(context, framebuffer_size, images, [&]()
                 {
-                    return new ray_tracing_renderer(context.physical_device, context.device, context.descriptor_pool.get(),
+                    return new ray_tracing_renderer(context.device, context.allocator, context.descriptor_pool.get(),
                         framebuffer_size, &model_pipeline, &textured_quad_pipeline,
                         shader_binding_table.get(), &ray_tracing_model);
                 }, ui_pipeline, font_image);
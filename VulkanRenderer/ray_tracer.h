@@ -16,11 +16,15 @@ public:
     frame_set frame_set;
     ray_tracer(
         const vulkan_context& context,
+        upload_manager& uploads,
         const std::vector<vk::Image>& images,
         vk::Extent2D framebuffer_size,
-        const model* model,
+        std::span<const model> meshes,
+        std::span<const glm::mat4> transforms,
+        std::span<const uint32_t> first_instances,
         const pipeline* ui_pipeline,
-        const image_with_view* font_image);
+        const image_with_view* font_image,
+        std::mutex* queue_mutex);
     void recreate_swapchain(const vulkan_context& context, vk::Extent2D framebuffer_size,
         const std::vector<vk::Image>& images);
 };
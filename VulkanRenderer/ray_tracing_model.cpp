@@ -3,55 +3,270 @@
 
 #include "data_types.h"
 
-ray_tracing_model::ray_tracing_model(vk::PhysicalDevice physical_device, vk::Device device,
-    vk::CommandPool command_pool, vk::Queue queue, const model* mdl)
-    : mdl(mdl)
+// The vertices and indices the compute queue builds from are copied in batches of about this many bytes if it is of
+// another family than the graphics queue. A chunk that is larger is copied on its own.
+static const vk::DeviceSize BUILD_INPUT_BATCH_SIZE = vk::DeviceSize(256) << 20;
+// keeps the vertices and indices of every chunk in the build inputs aligned for all formats
+static const vk::DeviceSize BUILD_INPUT_ALIGNMENT = 16;
+
+static vk::DeviceSize align_build_input(vk::DeviceSize size)
 {
-    auto blas_geometry = vk::AccelerationStructureGeometryKHR()
-        .setGeometryType(vk::GeometryTypeKHR::eTriangles)
-        .setGeometry(
-            vk::AccelerationStructureGeometryDataKHR()
-            .setTriangles(
-                vk::AccelerationStructureGeometryTrianglesDataKHR()
-                .setIndexData(device.getBufferAddress(mdl->index_buffer->buf.get())) // TODO buffer usage flags?
-                .setVertexData(device.getBufferAddress(mdl->vertex_buffer->buf.get()))
-                .setIndexType(vk::IndexType::eUint32)
-                .setMaxVertex(mdl->vertex_count - 1)
-                .setVertexFormat(vk::Format::eR16G16B16Snorm)
-                .setVertexStride(sizeof(vertex))
-            )
-        );
+    return (size + BUILD_INPUT_ALIGNMENT - 1) / BUILD_INPUT_ALIGNMENT * BUILD_INPUT_ALIGNMENT;
+}
 
-    blas = std::make_unique<acceleration_structure>(physical_device, device, command_pool, queue, blas_geometry, vk::AccelerationStructureTypeKHR::eBottomLevel, mdl->index_count / 3, nullptr);
+static vk::UniqueCommandBuffer begin_command_buffer(vk::Device device, vk::CommandPool command_pool)
+{
+    auto command_buffer = std::move(device.allocateCommandBuffersUnique(
+        vk::CommandBufferAllocateInfo()
+        .setCommandPool(command_pool)
+        .setLevel(vk::CommandBufferLevel::ePrimary)
+        .setCommandBufferCount(1)
+    )[0]);
+    command_buffer->begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    return command_buffer;
+}
 
-    buffer instance_data(physical_device, device, vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-        sizeof(VkAccelerationStructureInstanceKHR));
+static std::vector<vk::BufferMemoryBarrier> get_ownership_transfers(std::span<const vk::Buffer> buffers,
+    vk::AccessFlags src_access, vk::AccessFlags dst_access, uint32_t src_family, uint32_t dst_family)
+{
+    std::vector<vk::BufferMemoryBarrier> barriers;
+    for (auto buffer : buffers)
+    {
+        barriers.push_back(vk::BufferMemoryBarrier()
+            .setSrcAccessMask(src_access)
+            .setDstAccessMask(dst_access)
+            .setSrcQueueFamilyIndex(src_family)
+            .setDstQueueFamilyIndex(dst_family)
+            .setBuffer(buffer)
+            .setOffset(0)
+            .setSize(VK_WHOLE_SIZE));
+    }
+    return barriers;
+}
 
-    auto blas_reference = device.getAccelerationStructureAddressKHR(
-        vk::AccelerationStructureDeviceAddressInfoKHR().setAccelerationStructure(blas->ac.get())
+ray_tracing_model::ray_tracing_model(vk::Device device, memory_allocator& allocator,
+    const device_queues& queues, upload_manager& uploads, std::span<const model> meshes,
+    std::span<const glm::mat4> transforms, std::span<const uint32_t> first_instances, std::mutex* queue_mutex)
+    : device(device)
+    , queues(queues)
+    , queue_mutex(queue_mutex)
+    , submitted_value(0)
+    , is_build_finished(false)
+{
+    const auto is_ownership_transferred = queues.compute.family != queues.graphics.family;
+    // the acceleration structures are built on the compute queue, which overlaps with rendering if it is of another
+    // family
+    compute_command_pool = device.createCommandPoolUnique(
+        vk::CommandPoolCreateInfo()
+        .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+        .setQueueFamilyIndex(queues.compute.family)
     );
+    if (is_ownership_transferred)
+    {
+        graphics_command_pool = device.createCommandPoolUnique(
+            vk::CommandPoolCreateInfo()
+            .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+            .setQueueFamilyIndex(queues.graphics.family)
+        );
+    }
+
+    // Where the vertices and indices of every chunk are copied to. The graphics queue keeps ownership of the buffers
+    // of the meshes, so it can draw them during the builds, and the copies of a batch are reused by the next one.
+    struct build_input
+    {
+        size_t batch;
+        vk::DeviceSize vertex_offset;
+        vk::DeviceSize index_offset;
+    };
+    std::vector<build_input> build_inputs;
+    vk::DeviceSize vertex_input_size = 0, index_input_size = 0;
+    if (is_ownership_transferred)
+    {
+        size_t batch = 0;
+        vk::DeviceSize vertex_offset = 0, index_offset = 0;
+        for (const auto& mdl : meshes)
+        {
+            const auto format = get_vertex_format_info(mdl.layout);
+            for (const auto& chunk : mdl.chunks)
+            {
+                if (chunk.index_count == 0)
+                {
+                    continue;
+                }
 
-    auto* ptr = static_cast<vk::AccelerationStructureInstanceKHR*>(device.mapMemory(
-        instance_data.memory.get(), 0, instance_data.size));
+                const auto vertex_size = align_build_input(static_cast<vk::DeviceSize>(chunk.vertex_count)
+                    * format.size);
+                const auto index_size = align_build_input(static_cast<vk::DeviceSize>(chunk.index_count)
+                    * get_index_size(mdl.index_type));
+                if (vertex_offset + index_offset > 0
+                    && vertex_offset + vertex_size + index_offset + index_size > BUILD_INPUT_BATCH_SIZE)
+                {
+                    batch++;
+                    vertex_offset = 0;
+                    index_offset = 0;
+                }
+                build_inputs.push_back({ batch, vertex_offset, index_offset });
+                vertex_offset += vertex_size;
+                index_offset += index_size;
+                vertex_input_size = std::max(vertex_input_size, vertex_offset);
+                index_input_size = std::max(index_input_size, index_offset);
+            }
+        }
 
-    const std::array<std::array<float, 4>, 3> identity{
-        std::array<float, 4>{1.f, 0.f, 0.f, 0.f},
-        std::array<float, 4>{0.f, 1.f, 0.f, 0.f},
-        std::array<float, 4>{0.f, 0.f, 1.f, 0.f},
+        if (!build_inputs.empty())
+        {
+            const auto usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress
+                | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+            vertex_inputs = std::make_unique<buffer>(device, allocator, usage,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, vertex_input_size, memory_category::scratch);
+            index_inputs = std::make_unique<buffer>(device, allocator, usage,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, index_input_size, memory_category::scratch);
+        }
+    }
+
+    // the graphics queue releases the inputs to the compute queue, which acquires them before the builds
+    std::vector<vk::Buffer> inputs;
+    if (vertex_inputs)
+    {
+        inputs = { vertex_inputs->buf.get(), index_inputs->buf.get() };
+    }
+    const auto add_batch = [&]()
+    {
+        auto& batch = batches.emplace_back();
+        batch.build_command_buffer = begin_command_buffer(device, compute_command_pool.get());
+        if (is_ownership_transferred)
+        {
+            batch.copy_command_buffer = begin_command_buffer(device, graphics_command_pool.get());
+            if (!inputs.empty())
+            {
+                batch.build_command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                    vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, nullptr,
+                    get_ownership_transfers(inputs, {}, vk::AccessFlagBits::eShaderRead, queues.graphics.family,
+                        queues.compute.family),
+                    nullptr);
+            }
+        }
     };
-    *ptr = vk::AccelerationStructureInstanceKHR()
-        .setTransform(vk::TransformMatrixKHR(identity))
-        .setMask(UINT8_MAX)
-        .setInstanceShaderBindingTableRecordOffset(0/*TODO*/)
-        .setFlags(vk::GeometryInstanceFlagBitsKHR())
-        .setAccelerationStructureReference(blas_reference);
+    add_batch();
+
+    // every position chunk is a BLAS over its full resolution triangles, which is instanced with the dequantization of
+    // the chunk followed by the transform of every instance of its mesh
+    std::vector<ray_tracing_chunk> chunks;
+    std::vector<vk::AccelerationStructureInstanceKHR> instances;
+    size_t input_index = 0;
+    for (size_t mesh = 0; mesh < meshes.size(); mesh++)
+    {
+        const auto* mdl = &meshes[mesh];
+        const auto has_triangles = std::any_of(mdl->chunks.begin(), mdl->chunks.end(),
+            [](const position_chunk& chunk)
+            {
+                return chunk.index_count > 0;
+            });
+        if (!has_triangles)
+        {
+            continue;
+        }
+
+        const auto format = get_vertex_format_info(mdl->layout);
+        const auto index_size = get_index_size(mdl->index_type);
+        const auto vertex_address = device.getBufferAddress(mdl->vertex_buffer->buf.get());
+        const auto index_address = device.getBufferAddress(mdl->index_buffer->buf.get());
+        for (const auto& chunk : mdl->chunks)
+        {
+            if (chunk.index_count == 0)
+            {
+                continue;
+            }
+
+            // the indices of a chunk are relative to its first vertex
+            const auto vertex_offset = static_cast<vk::DeviceSize>(chunk.first_vertex) * format.size;
+            const auto index_offset = static_cast<vk::DeviceSize>(chunk.first_index) * index_size;
+            auto vertex_input = vertex_address + vertex_offset;
+            auto index_input = index_address + index_offset;
+            if (is_ownership_transferred)
+            {
+                const auto& input = build_inputs[input_index++];
+                if (input.batch == batches.size())
+                {
+                    batches.back().blas_end = blases.size();
+                    add_batch();
+                }
+                auto copy_command_buffer = batches.back().copy_command_buffer.get();
+                copy_command_buffer.copyBuffer(mdl->vertex_buffer->buf.get(), vertex_inputs->buf.get(),
+                    vk::BufferCopy(vertex_offset, input.vertex_offset,
+                        static_cast<vk::DeviceSize>(chunk.vertex_count) * format.size));
+                copy_command_buffer.copyBuffer(mdl->index_buffer->buf.get(), index_inputs->buf.get(),
+                    vk::BufferCopy(index_offset, input.index_offset, chunk.index_count * index_size));
+                vertex_input = vertex_inputs->address + input.vertex_offset;
+                index_input = index_inputs->address + input.index_offset;
+            }
+
+            auto blas_geometry = vk::AccelerationStructureGeometryKHR()
+                .setGeometryType(vk::GeometryTypeKHR::eTriangles)
+                .setGeometry(
+                    vk::AccelerationStructureGeometryDataKHR()
+                    .setTriangles(
+                        vk::AccelerationStructureGeometryTrianglesDataKHR()
+                        .setIndexData(index_input)
+                        .setVertexData(vertex_input)
+                        .setIndexType(mdl->index_type)
+                        .setMaxVertex(chunk.vertex_count - 1)
+                        .setVertexFormat(format.acceleration_structure_format)
+                        .setVertexStride(format.size)
+                    )
+                );
+
+            blases.push_back(std::make_unique<acceleration_structure>(device, allocator,
+                batches.back().build_command_buffer.get(), blas_geometry,
+                vk::AccelerationStructureTypeKHR::eBottomLevel, chunk.index_count / 3, nullptr));
 
-    device.unmapMemory(instance_data.memory.get());
+            auto blas_reference = device.getAccelerationStructureAddressKHR(
+                vk::AccelerationStructureDeviceAddressInfoKHR().setAccelerationStructure(blases.back()->ac.get())
+            );
 
-    auto instance_data_device_local = instance_data.copy_from_host_to_device_for_vertex_input(
-        physical_device, device, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
-        command_pool, queue); //TODO pipeline barrier
+            const auto custom_index = static_cast<uint32_t>(chunks.size());
+            // the closest hit shader reads the buffers of the mesh, which the graphics queue owns
+            chunks.push_back({ vertex_address + vertex_offset, index_address, chunk.first_index,
+                mdl->index_type == vk::IndexType::eUint16, {} });
+
+            const auto& d = chunk.dequantization;
+            const auto dequantization = glm::translate(glm::mat4(1.f), glm::vec3(d)) * glm::scale(glm::mat4(1.f),
+                glm::vec3(d.w));
+            for (auto i = first_instances[mesh]; i < first_instances[mesh + 1]; i++)
+            {
+                // the instance transform is the upper 3x4 part of the matrix in row major order
+                const auto m = transpose(transforms[i] * dequantization);
+                const std::array<std::array<float, 4>, 3> transform{
+                    std::array<float, 4>{m[0].x, m[0].y, m[0].z, m[0].w},
+                    std::array<float, 4>{m[1].x, m[1].y, m[1].z, m[1].w},
+                    std::array<float, 4>{m[2].x, m[2].y, m[2].z, m[2].w},
+                };
+                instances.push_back(vk::AccelerationStructureInstanceKHR()
+                    .setTransform(vk::TransformMatrixKHR(transform))
+                    .setInstanceCustomIndex(custom_index)
+                    .setMask(UINT8_MAX)
+                    .setInstanceShaderBindingTableRecordOffset(0/*TODO*/)
+                    .setFlags(vk::GeometryInstanceFlagBitsKHR())
+                    .setAccelerationStructureReference(blas_reference));
+            }
+        }
+    }
+    batches.back().blas_end = blases.size();
+
+    chunk_buffer = std::make_unique<buffer>(device, allocator,
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, chunks.size() * sizeof(ray_tracing_chunk),
+        memory_category::acceleration_structure);
+    uploads.upload(chunk_buffer->buf.get(), 0, chunks.data(), chunk_buffer->size);
+
+    auto instance_data_device_local = std::make_unique<buffer>(device, allocator,
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress
+        | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, instances.size() * sizeof(vk::AccelerationStructureInstanceKHR),
+        memory_category::acceleration_structure);
+    uploads.upload(instance_data_device_local->buf.get(), 0, instances.data(), instance_data_device_local->size);
+    // the TLAS is built by a later submission, which sees the instances without waiting for them
+    uploads.submit();
 
     auto tlas_geometry = vk::AccelerationStructureGeometryKHR()
         .setGeometryType(vk::GeometryTypeKHR::eInstances)
@@ -60,5 +275,199 @@ ray_tracing_model::ray_tracing_model(vk::PhysicalDevice physical_device, vk::Dev
             .setData(device.getBufferAddress(instance_data_device_local->buf.get()))
         ));
 
-    tlas = std::make_unique<acceleration_structure>(physical_device, device, command_pool, queue, tlas_geometry, vk::AccelerationStructureTypeKHR::eTopLevel, 1, std::move(instance_data_device_local));
+    auto& last_batch = batches.back();
+    const std::array instance_inputs{ instance_data_device_local->buf.get() };
+    if (is_ownership_transferred)
+    {
+        last_batch.build_command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {}, nullptr,
+            get_ownership_transfers(instance_inputs, {}, vk::AccessFlagBits::eShaderRead, queues.graphics.family,
+                queues.compute.family),
+            nullptr);
+    }
+    last_batch.build_command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+        vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, {},
+        vk::MemoryBarrier()
+        .setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR)
+        .setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR),
+        nullptr, nullptr);
+    tlas = std::make_unique<acceleration_structure>(device, allocator, last_batch.build_command_buffer.get(),
+        tlas_geometry, vk::AccelerationStructureTypeKHR::eTopLevel, static_cast<uint32_t>(instances.size()),
+        std::move(instance_data_device_local));
+
+    const vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> timeline_info{
+        vk::SemaphoreCreateInfo(),
+        vk::SemaphoreTypeCreateInfo()
+        .setSemaphoreType(vk::SemaphoreType::eTimeline)
+        .setInitialValue(0)
+    };
+    built_timeline = device.createSemaphoreUnique(timeline_info.get<vk::SemaphoreCreateInfo>());
+    built_value = batches.size();
+
+    if (is_ownership_transferred)
+    {
+        // the graphics queue acquires the acceleration structures after the builds, they have no contents to release
+        // before
+        std::vector<vk::Buffer> outputs;
+        for (const auto& blas : blases)
+        {
+            outputs.push_back(blas->ac_buffer->buf.get());
+        }
+        outputs.push_back(tlas->ac_buffer->buf.get());
+
+        last_batch.build_command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+            vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr,
+            get_ownership_transfers(outputs, vk::AccessFlagBits::eAccelerationStructureWriteKHR, {},
+                queues.compute.family, queues.graphics.family),
+            nullptr);
+
+        return_command_buffer = begin_command_buffer(device, graphics_command_pool.get());
+        return_command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eAllCommands, {}, nullptr,
+            get_ownership_transfers(outputs, {}, vk::AccessFlagBits::eMemoryRead, queues.compute.family,
+                queues.graphics.family),
+            nullptr);
+        return_command_buffer->end();
+        built_value++;
+
+        // Every batch copies into the inputs the previous one has finished reading, which the graphics queue takes
+        // over without a transfer since their contents are overwritten.
+        for (auto& batch : batches)
+        {
+            if (!inputs.empty())
+            {
+                batch.copy_command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                    vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr,
+                    get_ownership_transfers(inputs, vk::AccessFlagBits::eTransferWrite, {}, queues.graphics.family,
+                        queues.compute.family),
+                    nullptr);
+            }
+        }
+        last_batch.copy_command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+            vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr,
+            get_ownership_transfers(instance_inputs, vk::AccessFlagBits::eMemoryWrite, {}, queues.graphics.family,
+                queues.compute.family),
+            nullptr);
+        for (auto& batch : batches)
+        {
+            batch.copy_command_buffer->end();
+        }
+        released_semaphore = device.createSemaphoreUnique(vk::SemaphoreCreateInfo());
+    }
+    for (auto& batch : batches)
+    {
+        batch.build_command_buffer->end();
+    }
+
+    submit_next();
+}
+
+void ray_tracing_model::submit_next()
+{
+    // the render loop submits frames on the graphics queue while the builds run, other threads may upload
+    std::unique_lock<std::mutex> lock;
+    if (queue_mutex)
+    {
+        lock = std::unique_lock(*queue_mutex);
+    }
+
+    const auto signal_value = ++submitted_value;
+    const auto signal_info = vk::TimelineSemaphoreSubmitInfo()
+        .setSignalSemaphoreValueCount(1)
+        .setPSignalSemaphoreValues(&signal_value);
+    const std::array signal_semaphores{ built_timeline.get() };
+    if (signal_value > batches.size())
+    {
+        // submitted once the host has seen the last batch finish, so it doesn't have to wait on the graphics queue
+        const std::array return_command_buffers{ return_command_buffer.get() };
+        const vk::StructureChain<vk::SubmitInfo, vk::TimelineSemaphoreSubmitInfo> return_submit_info{
+            vk::SubmitInfo()
+            .setCommandBuffers(return_command_buffers)
+            .setSignalSemaphores(signal_semaphores),
+            signal_info
+        };
+        queues.graphics.queue.submit(return_submit_info.get<vk::SubmitInfo>(), nullptr);
+        return;
+    }
+
+    const auto& batch = batches[signal_value - 1];
+    const std::array build_command_buffers{ batch.build_command_buffer.get() };
+    if (!batch.copy_command_buffer)
+    {
+        const vk::StructureChain<vk::SubmitInfo, vk::TimelineSemaphoreSubmitInfo> submit_info{
+            vk::SubmitInfo()
+            .setCommandBuffers(build_command_buffers)
+            .setSignalSemaphores(signal_semaphores),
+            signal_info
+        };
+        queues.compute.queue.submit(submit_info.get<vk::SubmitInfo>(), nullptr);
+        return;
+    }
+
+    const std::array copy_command_buffers{ batch.copy_command_buffer.get() };
+    const std::array released_semaphores{ released_semaphore.get() };
+    queues.graphics.queue.submit(
+        vk::SubmitInfo()
+        .setCommandBuffers(copy_command_buffers)
+        .setSignalSemaphores(released_semaphores),
+        nullptr);
+
+    const std::array<vk::PipelineStageFlags, 1> build_wait_stages{
+        vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR };
+    const vk::StructureChain<vk::SubmitInfo, vk::TimelineSemaphoreSubmitInfo> build_submit_info{
+        vk::SubmitInfo()
+        .setWaitSemaphores(released_semaphores)
+        .setWaitDstStageMask(build_wait_stages)
+        .setCommandBuffers(build_command_buffers)
+        .setSignalSemaphores(signal_semaphores),
+        signal_info
+    };
+    queues.compute.queue.submit(build_submit_info.get<vk::SubmitInfo>(), nullptr);
+}
+
+ray_tracing_model::~ray_tracing_model()
+{
+    // batches that haven't been submitted yet never will be
+    device.waitSemaphores(
+        vk::SemaphoreWaitInfo()
+        .setSemaphoreCount(1)
+        .setPSemaphores(&built_timeline.get())
+        .setPValues(&submitted_value),
+        UINT64_MAX
+    );
+}
+
+bool ray_tracing_model::is_built()
+{
+    if (is_build_finished)
+    {
+        return true;
+    }
+    const auto value = device.getSemaphoreCounterValue(built_timeline.get());
+    if (value < submitted_value)
+    {
+        return false;
+    }
+
+    // the scratch buffers of the finished batches aren't read anymore
+    for (size_t i = 0; i < std::min(static_cast<size_t>(value), batches.size()); i++)
+    {
+        for (auto j = i == 0 ? 0 : batches[i - 1].blas_end; j < batches[i].blas_end; j++)
+        {
+            blases[j]->scratch.reset();
+        }
+    }
+    if (value < built_value)
+    {
+        submit_next();
+        return false;
+    }
+
+    is_build_finished = true;
+    tlas->scratch.reset();
+    vertex_inputs.reset();
+    index_inputs.reset();
+    batches.clear();
+    return_command_buffer.reset();
+    return true;
 }
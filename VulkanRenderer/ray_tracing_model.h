@@ -1,12 +1,73 @@
 #pragma once
+#include <mutex>
+#include <span>
 #include "acceleration_structure.h"
 #include "model.h"
+#include "upload_manager.h"
+
+// Where the closest hit shader finds the triangles of a BLAS. Layout must be kept in sync with model.rchit.
+struct ray_tracing_chunk
+{
+    vk::DeviceAddress vertex_address;
+    vk::DeviceAddress index_address;
+    uint32_t first_index;
+    uint32_t sixteen_bit_indices;
+    uint32_t padding[2];
+};
 
 struct ray_tracing_model
 {
-    const model* mdl;
-    std::unique_ptr<acceleration_structure> blas;
+    std::vector<std::unique_ptr<acceleration_structure>> blases;
     std::unique_ptr<acceleration_structure> tlas;
-    ray_tracing_model(vk::PhysicalDevice physical_device, vk::Device device, vk::CommandPool command_pool,
-        vk::Queue queue, const model* mdl);
+    // a ray_tracing_chunk per BLAS
+    std::unique_ptr<buffer> chunk_buffer;
+    vk::Device device;
+    device_queues queues;
+    std::mutex* queue_mutex;
+    // everything the builds use until they have finished
+    vk::UniqueCommandPool graphics_command_pool;
+    vk::UniqueCommandPool compute_command_pool;
+    // If the compute queue is of another family, the graphics queue copies the vertices and indices of a batch of
+    // chunks into the build inputs and releases them to the compute queue, which builds the BLASes of the batch. The
+    // next batch is only copied once the previous one is built, so the copies take no more memory than the largest
+    // batch. Otherwise there is a single batch that builds from the buffers of the meshes. The last batch builds the
+    // TLAS as well.
+    struct build_batch
+    {
+        // only used if the compute queue is of another family
+        vk::UniqueCommandBuffer copy_command_buffer;
+        vk::UniqueCommandBuffer build_command_buffer;
+        // BLASes [0, blas_end) are built once the batch has finished
+        size_t blas_end;
+    };
+    std::vector<build_batch> batches;
+    // acquires the acceleration structures on the graphics queue after the last batch if it is of another family
+    vk::UniqueCommandBuffer return_command_buffer;
+    std::unique_ptr<buffer> vertex_inputs;
+    std::unique_ptr<buffer> index_inputs;
+    vk::UniqueSemaphore released_semaphore;
+    // counts the submissions that have finished, a batch or the return of the acceleration structures
+    vk::UniqueSemaphore built_timeline;
+    uint64_t submitted_value;
+    // the value of the timeline once the acceleration structures are built and owned by the graphics queue
+    uint64_t built_value;
+    bool is_build_finished;
+
+    // The instances of mesh i have the transforms [first_instances[i], first_instances[i + 1]). All meshes must have
+    // the same vertex layout. uploads must be owned by the graphics queue. The builds run on the compute queue. The
+    // constructor submits the first batch and is_built the following ones, queue_mutex is held while submitting if
+    // the queues are shared with another thread. The meshes can be drawn on the graphics queue while the builds run.
+    ray_tracing_model(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+        upload_manager& uploads, std::span<const model> meshes, std::span<const glm::mat4> transforms,
+        std::span<const uint32_t> first_instances, std::mutex* queue_mutex = nullptr);
+    ray_tracing_model(const ray_tracing_model&) = delete;
+    ray_tracing_model& operator=(const ray_tracing_model&) = delete;
+    ~ray_tracing_model();
+
+    // Polls whether the builds have finished and the acceleration structures are owned by the graphics queue. Submits
+    // the next batch once the previous one has finished and frees what only the finished builds needed. Has to be
+    // called until it returns true for the builds to make progress.
+    bool is_built();
+    // Submits the batch or the return that follows the last submitted one.
+    void submit_next();
 };
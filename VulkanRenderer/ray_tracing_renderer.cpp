@@ -39,41 +39,27 @@ void ray_tracing_renderer::initialize_ray_tracing_descriptor_set(vk::Device devi
         .setDstSet(ray_tracing_descriptor_set.get())
         .setImageInfo(images);
 
-    std::array vertex_buffer_infos{
+    std::array chunk_buffer_infos{
         vk::DescriptorBufferInfo()
-        .setBuffer(model->mdl->vertex_buffer->buf.get())
-        .setRange(model->mdl->vertex_buffer->size)
+        .setBuffer(model->chunk_buffer->buf.get())
+        .setRange(model->chunk_buffer->size)
     };
 
-    const auto vertex_buffer_descriptor = vk::WriteDescriptorSet()
+    const auto chunk_buffer_descriptor = vk::WriteDescriptorSet()
         .setDstBinding(3)
         .setDescriptorType(vk::DescriptorType::eStorageBuffer)
         .setDstSet(ray_tracing_descriptor_set.get())
-        .setBufferInfo(vertex_buffer_infos);
-
-
-    std::array index_buffer_infos{
-        vk::DescriptorBufferInfo()
-        .setBuffer(model->mdl->index_buffer->buf.get())
-        .setRange(model->mdl->index_buffer->size)
-    };
-
-    const auto index_buffer_descriptor = vk::WriteDescriptorSet()
-        .setDstBinding(4)
-        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
-        .setDstSet(ray_tracing_descriptor_set.get())
-        .setBufferInfo(index_buffer_infos);
+        .setBufferInfo(chunk_buffer_infos);
 
     device.updateDescriptorSets({
                                     uniform_buffer_descriptor,
                                     tlas_descriptor.get<vk::WriteDescriptorSet>(),
                                     image_descriptor,
-                                    vertex_buffer_descriptor,
-                                    index_buffer_descriptor,
+                                    chunk_buffer_descriptor,
         }, {});
 }
 
-ray_tracing_renderer::ray_tracing_renderer(vk::PhysicalDevice physical_device, vk::Device device,
+ray_tracing_renderer::ray_tracing_renderer(vk::Device device, memory_allocator& allocator,
     vk::DescriptorPool descriptor_pool,
     vk::Extent2D framebuffer_size,
     const pipeline* ray_tracing_pipeline,
@@ -83,18 +69,19 @@ ray_tracing_renderer::ray_tracing_renderer(vk::PhysicalDevice physical_device, v
     shader_binding_table(shader_binding_table),
     ray_tracing_pipeline(ray_tracing_pipeline),
     textured_quad_pipeline(textured_quad_pipeline),
-    uniform_buffer(physical_device, device, vk::BufferUsageFlagBits::eUniformBuffer, HOST_VISIBLE_AND_COHERENT,
-        sizeof(model_uniform_data)),
-    textured_quad(physical_device, device, vk::BufferUsageFlagBits::eVertexBuffer, HOST_VISIBLE_AND_COHERENT,
-        4 * sizeof(glm::vec2)),
-    image(device, std::make_unique<image_with_memory>(physical_device, device, framebuffer_size.width,
+    uniform_buffer(device, allocator, vk::BufferUsageFlagBits::eUniformBuffer, HOST_VISIBLE_AND_COHERENT,
+        sizeof(model_uniform_data), memory_category::other),
+    textured_quad(device, allocator, vk::BufferUsageFlagBits::eVertexBuffer, HOST_VISIBLE_AND_COHERENT,
+        4 * sizeof(glm::vec2), memory_category::other),
+    image(device, std::make_unique<image_with_memory>(device, allocator, framebuffer_size.width,
         framebuffer_size.height,
         vk::Format::eR8G8B8A8Unorm,
         vk::ImageUsageFlagBits::eStorage |
         vk::ImageUsageFlagBits::eSampled, vk::ImageTiling::eOptimal,
         vk::ImageLayout::eUndefined,
         vk::MemoryPropertyFlagBits::eDeviceLocal,
-        vk::ImageAspectFlagBits::eColor)),
+        vk::ImageAspectFlagBits::eColor,
+        memory_category::attachment)),
     framebuffer_size(framebuffer_size)
 {
     std::array set_layouts{
@@ -113,12 +100,11 @@ ray_tracing_renderer::ray_tracing_renderer(vk::PhysicalDevice physical_device, v
 
     initialize_ray_tracing_descriptor_set(device);
 
-    auto* ptr = static_cast<glm::vec2*>(device.mapMemory(textured_quad.memory.get(), 0, textured_quad.size));
+    auto* ptr = textured_quad.get_mapped<glm::vec2>().data();
     ptr[0] = glm::vec2(-1.f, -1.f);
     ptr[1] = glm::vec2(-1.f, 1.f);
     ptr[2] = glm::vec2(1.f, -1.f);
     ptr[3] = glm::vec2(1.f, 1.f);
-    device.unmapMemory(textured_quad.memory.get());
 
     std::array images{
         vk::DescriptorImageInfo()
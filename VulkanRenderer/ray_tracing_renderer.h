@@ -20,7 +20,7 @@ class ray_tracing_renderer : public renderer
     void initialize_ray_tracing_descriptor_set(vk::Device device);
 
 public:
-    ray_tracing_renderer(vk::PhysicalDevice physical_device, vk::Device device,
+    ray_tracing_renderer(vk::Device device, memory_allocator& allocator,
         vk::DescriptorPool descriptor_pool,
         vk::Extent2D framebuffer_size,
         const pipeline* ray_tracing_pipeline,
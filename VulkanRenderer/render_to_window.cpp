@@ -1,25 +1,55 @@
 #include "stdafx.h"
 #include "render_to_window.h"
 #include "vulkan_context.h"
+#include "helpers.h"
 #include "input_state.h"
 #include "model.h"
+#include "model_loader.h"
 #include "pipeline.h"
 #include "frame.h"
 #include "frame_set.h"
 #include "model_renderer.h"
+#include "point_cloud_renderer.h"
 #include "ray_tracer.h"
 #include "ray_tracing_model.h"
 #include "ray_tracing_renderer.h"
+#include "scene_renderer.h"
 #include "swapchain.h"
+#include "upload_manager.h"
+
+// a single model is ray traced as the only instance of its mesh
+static const std::array<glm::mat4, 1> SINGLE_MODEL_TRANSFORMS{ glm::mat4(1.f) };
+static const std::array<uint32_t, 2> SINGLE_MODEL_FIRST_INSTANCES{ 0, 1 };
+
+static const vk::DeviceSize UPLOAD_SLOT_SIZE = 4 * 1024 * 1024;
+static const uint32_t UPLOAD_SLOT_COUNT = 2;
 
 class vulkanapp
 {
     vulkan_context context;
     vk::SurfaceKHR surface;
-    model mdl;
+    model_load_options load_options;
+    // held by the render loop while using the queue, since model loaders upload on another thread
+    std::mutex queue_mutex;
+    // uploads of the render thread, such as the font image and the acceleration structure instances
+    upload_manager uploads;
+    // empty until the first model is loaded
+    std::optional<model> mdl;
+    std::unique_ptr<model_loader> loader;
+    // set instead of the model if a scene is rendered, which is loaded before the first frame
+    std::optional<scene> scn;
+    vk::Extent2D framebuffer_size;
     pipeline textured_quad_pipeline;
     pipeline model_pipeline;
+    pipeline cull_pipeline;
     pipeline ui_pipeline;
+    // only created if the device supports splatting point clouds
+    std::unique_ptr<pipeline> splat_pipeline;
+    std::unique_ptr<pipeline> splat_resolve_pipeline;
+    // only created for scenes
+    std::unique_ptr<pipeline> scene_pipeline;
+    std::unique_ptr<pipeline> scene_cull_pipeline;
+    std::unique_ptr<pipeline> scene_draws_pipeline;
     vk::UniqueSemaphore acquired_semaphore;
     swapchain current_swapchain;
     image_with_view font_image;
@@ -27,77 +57,217 @@ class vulkanapp
     frame_set default_frame_set;
     glm::quat trackball_rotation;
     float camera_distance;
+    // milliseconds update spends per frame without waiting for the swapchain and the frame fence, smoothed
+    double cpu_frame_time;
+    double total_cpu_time;
+    size_t frame_count;
+    // microseconds every host write to a uniform buffer would take if buffers were mapped and unmapped around it
+    double map_unmap_time;
 
     void recreate_swapchain(vk::Extent2D framebuffer_size);
-    model_renderer* create_model_renderer(vk::Extent2D framebuffer_size);
+    renderer* create_model_renderer(vk::Extent2D framebuffer_size);
+    frame_set create_default_frame_set();
+    void update_model_loading();
+    void finish_model_loading();
+    void load_scene(const scene_description& description);
 
 public:
-    vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, vk::SurfaceKHR surface,
-        vk::Extent2D framebuffer_size, const std::string& model_path);
+    vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, memory_allocator& allocator,
+        vk::SurfaceKHR surface, vk::Extent2D framebuffer_size, const std::string& model_path,
+        const scene_description* scene, const model_load_options& load_options);
     void update(vk::Device device, const input_state& input);
     ~vulkanapp();
 };
 
-static image_with_view load_font_image(vk::PhysicalDevice physical_device, vk::Device device,
-    vk::CommandPool command_pool, vk::Queue queue)
+static image_with_view load_font_image(vk::Device device, memory_allocator& allocator, upload_manager& uploads)
 {
     unsigned char* pixels;
     int width, height, bytes_per_pixel;
     ImGui::GetIO().Fonts->GetTexDataAsRGBA32(&pixels, &width, &height, &bytes_per_pixel);
     assert(bytes_per_pixel == 4);
-    const auto host_image = load_r8g8b8a8_unorm_texture(physical_device, device, width, height, pixels);
-    auto device_image = image_with_view(
-        device,
-        host_image->copy_from_host_to_device_for_shader_read(physical_device, device, command_pool, queue)
-    );
-    queue.waitIdle();
-    return device_image;
+    auto image = std::make_unique<image_with_memory>(device, allocator, width, height,
+        vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+        vk::ImageTiling::eOptimal, vk::ImageLayout::eUndefined, vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vk::ImageAspectFlagBits::eColor, memory_category::ui);
+    uploads.upload(*image, pixels, static_cast<vk::DeviceSize>(4) * width * height);
+    // the frames drawing the UI are submitted later, so nothing waits for the upload
+    uploads.submit();
+    return image_with_view(device, std::move(image));
 }
 
-vulkanapp::vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, vk::SurfaceKHR surface,
-    vk::Extent2D framebuffer_size, const std::string& model_path)
-    : context(physical_device, device)
+vulkanapp::vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, memory_allocator& allocator,
+    vk::SurfaceKHR surface, vk::Extent2D framebuffer_size, const std::string& model_path,
+    const scene_description* scene, const model_load_options& load_options)
+    : context(physical_device, device, allocator)
     , surface(surface)
-    , mdl(read_model(physical_device, device, context.command_pool.get(), context.queue, model_path))
+    , load_options(load_options)
+    , uploads(device, allocator, context.queues.graphics, context.queues.graphics, UPLOAD_SLOT_SIZE,
+        UPLOAD_SLOT_COUNT, &queue_mutex)
+    , framebuffer_size(framebuffer_size)
     , textured_quad_pipeline(create_textured_quad_pipeline(device, context.render_pass.get()))
-    , model_pipeline(create_model_pipeline(device, context.render_pass.get()))
+    , model_pipeline(create_model_pipeline(device, context.render_pass.get(), get_vertex_layout(load_options)))
+    , cull_pipeline(create_cull_pipeline(device))
     , ui_pipeline(create_ui_pipeline(device, context.render_pass.get()))
     , acquired_semaphore(device.createSemaphoreUnique(vk::SemaphoreCreateInfo()))
     , current_swapchain(physical_device, device, surface, nullptr)
-    , font_image(load_font_image(physical_device, device, context.command_pool.get(), context.queue))
-    , ray_tracer(context.is_ray_tracing_supported
-        ? std::make_unique<class ray_tracer>(context, current_swapchain.images, framebuffer_size, &mdl,
-            &ui_pipeline,
-            &font_image)
-        : nullptr)
-    , default_frame_set(create_frame_set(context, framebuffer_size, current_swapchain.images, [&]()
-        {
-            return create_model_renderer(framebuffer_size);
-        }, & ui_pipeline, & font_image))
+    , font_image(load_font_image(device, allocator, uploads))
+    , default_frame_set(create_default_frame_set())
     , trackball_rotation(1.f, 0.f, 0.f, 0.f)
             , camera_distance(2.f)
+    , cpu_frame_time(0.)
+    , total_cpu_time(0.)
+    , frame_count(0)
+    , map_unmap_time(measure_map_unmap_time(physical_device, device, sizeof(model_uniform_data)))
 {
+    if (context.is_point_splatting_supported)
+    {
+        splat_pipeline.reset(new pipeline(create_splat_pipeline(device)));
+        splat_resolve_pipeline.reset(new pipeline(create_splat_resolve_pipeline(device, context.render_pass.get())));
+    }
+
+    if (scene)
+    {
+        load_scene(*scene);
+        return;
+    }
+
+    // started last, the constructor uses the queue without holding queue_mutex
+    loader = std::make_unique<model_loader>(device, allocator, context.queues, &queue_mutex, model_path,
+        load_options);
+}
+
+// Scenes are loaded on the calling thread, since there is nothing to show while their meshes are read.
+void vulkanapp::load_scene(const scene_description& description)
+{
+    scn.emplace(read_scene(context.device, context.allocator, context.queues, description, load_options));
+    const auto layout = scn->meshes.front().layout;
+    scene_pipeline.reset(new pipeline(create_scene_pipeline(context.device, context.render_pass.get(), layout)));
+    scene_cull_pipeline.reset(new pipeline(create_scene_cull_pipeline(context.device)));
+    scene_draws_pipeline.reset(new pipeline(create_scene_draws_pipeline(context.device)));
+    if (context.is_ray_tracing_supported)
+    {
+        ray_tracer = std::make_unique<class ray_tracer>(context, uploads, current_swapchain.images, framebuffer_size,
+            scn->meshes, scn->transforms, scn->first_instances, &ui_pipeline, &font_image, &queue_mutex);
+    }
+    default_frame_set = create_default_frame_set();
 }
 
         void vulkanapp::recreate_swapchain(vk::Extent2D framebuffer_size)
         {
-            context.queue.waitIdle();
+            {
+                std::lock_guard lock(queue_mutex);
+                context.queue.waitIdle();
+            }
+            this->framebuffer_size = framebuffer_size;
             current_swapchain = swapchain(context.physical_device, context.device, surface, current_swapchain.handle.get());
-            default_frame_set = create_frame_set(context, framebuffer_size, current_swapchain.images, [&]()
+            default_frame_set = create_default_frame_set();
+
+            if (ray_tracer)
+            {
+                ray_tracer->recreate_swapchain(context, framebuffer_size, current_swapchain.images);
+            }
+        }
+
+        renderer* vulkanapp::create_model_renderer(vk::Extent2D framebuffer_size)
+        {
+            if (scn)
+            {
+                return new scene_renderer(context.physical_device, context.device, context.allocator,
+                    framebuffer_size, scene_pipeline.get(), scene_cull_pipeline.get(), scene_draws_pipeline.get(),
+                    &*scn);
+            }
+            if (!mdl)
+            {
+                return nullptr;
+            }
+            if (mdl->is_point_cloud())
+            {
+                return new point_cloud_renderer(context.device, context.allocator, context.descriptor_pool.get(),
+                    framebuffer_size, splat_pipeline.get(), splat_resolve_pipeline.get(), &*mdl);
+            }
+            return new model_renderer(context.physical_device, context.device, context.allocator,
+                context.descriptor_pool.get(), framebuffer_size, &model_pipeline, &cull_pipeline, &*mdl);
+        }
+
+        frame_set vulkanapp::create_default_frame_set()
+        {
+            return create_frame_set(context, framebuffer_size, current_swapchain.images, [&]()
                 {
                     return create_model_renderer(framebuffer_size);
                 }, &ui_pipeline, &font_image);
+        }
 
-            if (ray_tracer)
+        void vulkanapp::update_model_loading()
+        {
+            if (scn)
             {
-                ray_tracer->recreate_swapchain(context, framebuffer_size, current_swapchain.images);
+                ImGui::Text("%zu instances of %zu meshes", scn->transforms.size(), scn->meshes.size());
+                ImGui::Text("%.2f ms per frame", 1000.f / ImGui::GetIO().Framerate);
+                return;
+            }
+
+            if (loader && loader->is_finished())
+            {
+                finish_model_loading();
+            }
+
+            if (loader)
+            {
+                ImGui::Text("Loading %s", loader->path.c_str());
+                ImGui::ProgressBar(loader->get_fraction(), ImVec2(-1.f, 0.f), loader->get_stage());
+            }
+            else if (ImGui::Button("Open model..."))
+            {
+                const auto path = show_open_model_dialog();
+                if (!path.empty())
+                {
+                    loader = std::make_unique<model_loader>(context.device, context.allocator, context.queues,
+                        &queue_mutex, path, load_options);
+                }
             }
         }
 
-        model_renderer* vulkanapp::create_model_renderer(vk::Extent2D framebuffer_size)
+        // Replaces the current model and everything that refers to it. The device, swapchain and all pipelines
+        // except the ray tracing one, which depends on the index type of the model, are kept.
+        void vulkanapp::finish_model_loading()
         {
-            return new model_renderer(context.physical_device, context.device, context.descriptor_pool.get(),
-                framebuffer_size, &model_pipeline, &mdl);
+            std::optional<model> loaded_model;
+            try
+            {
+                loaded_model.emplace(loader->get());
+                if (loaded_model->is_point_cloud() && !splat_pipeline)
+                {
+                    throw std::runtime_error("Point clouds require 64-bit atomics, which the device doesn't support");
+                }
+            }
+            catch (const std::exception& e)
+            {
+                if (!mdl)
+                {
+                    throw;
+                }
+                std::printf("Failed to load %s: %s\n", loader->path.c_str(), e.what());
+                loader.reset();
+                return;
+            }
+            loader.reset();
+
+            {
+                std::lock_guard lock(queue_mutex);
+                context.queue.waitIdle();
+            }
+            // the loader has finished, the ray tracer of the previous model waits for its builds if they are running
+            ray_tracer.reset();
+            mdl = std::move(loaded_model);
+            // the acceleration structures of a streamed model would need all of its chunks, and points have no
+            // triangles to trace
+            if (context.is_ray_tracing_supported && !mdl->streamer && !mdl->is_point_cloud())
+            {
+                ray_tracer = std::make_unique<class ray_tracer>(context, uploads, current_swapchain.images,
+                    framebuffer_size, std::span(&*mdl, 1), SINGLE_MODEL_TRANSFORMS, SINGLE_MODEL_FIRST_INSTANCES,
+                    &ui_pipeline, &font_image, &queue_mutex);
+            }
+            default_frame_set = create_default_frame_set();
         }
 
         static glm::vec3 get_trackball_position(const input_state& input, glm::vec2 mouse_position)
@@ -118,16 +288,48 @@ vulkanapp::vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, vk::
             return glm::vec3(xy, z);
         }
 
+        static void show_memory_usage(const memory_allocator& allocator)
+        {
+            if (!ImGui::CollapsingHeader("Memory"))
+            {
+                return;
+            }
+            const auto categories = allocator.get_category_statistics();
+            for (size_t i = 0; i < categories.size(); i++)
+            {
+                ImGui::Text("%s: %.1f MB in %u allocations", get_memory_category_name(static_cast<memory_category>(i)),
+                    categories[i].requested_size / (1024. * 1024.), categories[i].allocation_count);
+            }
+            const auto heaps = allocator.get_heap_budgets();
+            for (size_t i = 0; i < heaps.size(); i++)
+            {
+                ImGui::Text("Heap %zu (%s): %.1f of %.1f MB budget, %.1f MB total", i,
+                    heaps[i].is_device_local ? "device local" : "host", heaps[i].usage / (1024. * 1024.),
+                    heaps[i].budget / (1024. * 1024.), heaps[i].size / (1024. * 1024.));
+            }
+        }
+
         void vulkanapp::update(vk::Device device, const input_state& input)
         {
+            const auto start = std::chrono::steady_clock::now();
+            auto wait_time = std::chrono::steady_clock::duration::zero();
+
+            update_model_loading();
+            ImGui::Text("%.3f ms CPU time per frame", cpu_frame_time);
+            ImGui::Text("%.2f us saved per buffer update by persistent mapping", map_unmap_time);
+            show_memory_usage(context.allocator);
+            ImGui::Render();
+
             vk::Result result;
             try
             {
                 //suspicious: no reason to believe semaphore is unsignaled
+                const auto acquire_start = std::chrono::steady_clock::now();
                 auto current_image = device.acquireNextImageKHR(current_swapchain.handle.get(), UINT64_MAX,
                     acquired_semaphore.get(),
                     nullptr).
                     value;
+                wait_time += std::chrono::steady_clock::now() - acquire_start;
 
                 if (!input.ui_want_capture_mouse)
                 {
@@ -155,16 +357,25 @@ vulkanapp::vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, vk::
                     *
                     mat4_cast(trackball_rotation);
 
-                const auto& current_frame_set = context.is_ray_tracing_supported && input.enable_ray_tracing
-                    ? ray_tracer->frame_set
-                    : default_frame_set;
+                // the model is rasterized until its acceleration structures are built, which is polled every frame to
+                // submit the batches of the builds
+                const auto is_ray_traced = ray_tracer && ray_tracer->ray_tracing_model.is_built()
+                    && input.enable_ray_tracing;
+                const auto& current_frame_set = is_ray_traced ? ray_tracer->frame_set : default_frame_set;
                 const auto& frame = current_frame_set.get(current_image);
 
+                const auto wait_start = std::chrono::steady_clock::now();
                 device.waitForFences({ frame.rendered_fence.get() }, true, UINT64_MAX);
+                wait_time += std::chrono::steady_clock::now() - wait_start;
                 device.resetFences({ frame.rendered_fence.get() });
 
                 frame.update(data);
 
+                std::lock_guard lock(queue_mutex);
+                if (mdl)
+                {
+                    mdl->update_residency(context.queue, data);
+                }
                 auto wait_dst_stage_mask = vk::PipelineStageFlags(vk::PipelineStageFlagBits::eColorAttachmentOutput);
                 context.queue.submit({
                                          vk::SubmitInfo()
@@ -191,10 +402,22 @@ vulkanapp::vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, vk::
             {
                 recreate_swapchain(vk::Extent2D(input.width, input.height));
             }
+
+            const auto frame_time = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start - wait_time).count();
+            cpu_frame_time = cpu_frame_time == 0. ? frame_time : .95 * cpu_frame_time + .05 * frame_time;
+            total_cpu_time += frame_time;
+            frame_count++;
         }
 
         vulkanapp::~vulkanapp()
         {
+            if (frame_count > 0)
+            {
+                std::printf("%.3f ms CPU time per frame on average over %zu frames, mapping and unmapping would add "
+                    "%.2f us to every buffer update\n", total_cpu_time / frame_count, frame_count, map_unmap_time);
+            }
+            loader.reset();
             context.queue.waitIdle();
         }
 
@@ -212,7 +435,8 @@ vulkanapp::vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, vk::
         }
 
         void render_to_window(vk::Instance instance, vk::PhysicalDevice physical_device, vk::Device device,
-            const std::string& model_path)
+            memory_allocator& allocator, const std::string& model_path, const scene_description* scene,
+            const model_load_options& load_options)
         {
             const auto success = glfwInit();
             assert(success);
@@ -227,12 +451,14 @@ vulkanapp::vulkanapp(vk::PhysicalDevice physical_device, vk::Device device, vk::
             auto surface = create_window_surface(instance, window);
 
             input_state input(window);
-            auto app = vulkanapp(physical_device, device, surface.get(), vk::Extent2D(input.width, input.height), model_path);
+            auto app = vulkanapp(physical_device, device, allocator, surface.get(),
+                vk::Extent2D(input.width, input.height), model_path, scene, load_options);
             while (!glfwWindowShouldClose(window))
             {
                 input.update();
                 app.update(device, input);
             }
+            allocator.print_statistics();
 
             glfwTerminate();
 
@@ -1,5 +1,9 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
+#include "model.h"
+#include "scene.h"
 
+// Renders the scene instead of the model at model_path if it isn't null.
 void render_to_window(vk::Instance instance, vk::PhysicalDevice physical_device, vk::Device device,
-    const std::string& model_path);
+    memory_allocator& allocator, const std::string& model_path, const scene_description* scene,
+    const model_load_options& load_options);
@@ -0,0 +1,147 @@
+#include "stdafx.h"
+#include "scene.h"
+#include "upload_manager.h"
+
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <numeric>
+#include <sstream>
+
+static const vk::DeviceSize STAGING_SLOT_SIZE = 4 * 1024 * 1024;
+static const uint32_t STAGING_SLOT_COUNT = 2;
+
+static glm::mat4 get_instance_transform(const glm::vec3& position, float scale, float y_rotation)
+{
+    const auto translation = glm::translate(glm::mat4(1.f), position);
+    const auto rotation = glm::rotate(glm::mat4(1.f), glm::radians(y_rotation), glm::vec3(0.f, 1.f, 0.f));
+    return glm::scale(translation * rotation, glm::vec3(scale));
+}
+
+scene_description read_scene_description(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open scene " + path);
+    }
+
+    const auto directory = std::filesystem::path(path).parent_path();
+    scene_description description;
+    // instances of the same file share its mesh, whichever path they use to refer to it
+    std::map<std::filesystem::path, uint32_t> meshes;
+    std::string line;
+    for (size_t line_number = 1; std::getline(file, line); line_number++)
+    {
+        std::istringstream stream(line);
+        std::string model_path;
+        if (!(stream >> std::quoted(model_path)) || model_path.starts_with('#'))
+        {
+            continue;
+        }
+
+        glm::vec3 position;
+        auto scale = 1.f, y_rotation = 0.f;
+        if (!(stream >> position.x >> position.y >> position.z))
+        {
+            throw std::runtime_error("Scene " + path + " has no position in line " + std::to_string(line_number));
+        }
+        if (stream >> scale)
+        {
+            stream >> y_rotation;
+        }
+
+        const auto canonical_path = std::filesystem::weakly_canonical(directory / model_path);
+        const auto [mesh, is_new] = meshes.emplace(canonical_path,
+            static_cast<uint32_t>(description.mesh_paths.size()));
+        if (is_new)
+        {
+            description.mesh_paths.push_back(canonical_path.string());
+        }
+        description.instances.push_back({ mesh->second, get_instance_transform(position, scale, y_rotation) });
+    }
+
+    if (description.instances.empty())
+    {
+        throw std::runtime_error("Scene " + path + " has no instances");
+    }
+    return description;
+}
+
+scene_description create_stress_scene_description(const std::string& model_path, uint32_t instance_count)
+{
+    assert(instance_count > 0);
+    auto side = static_cast<uint32_t>(std::cbrt(static_cast<double>(instance_count)));
+    while (side * side * side < instance_count)
+    {
+        side++;
+    }
+
+    // copies fill 80% of their cell and are turned by the golden angle, so neighbours show different sides
+    const auto cell_size = 2.f / static_cast<float>(side);
+    scene_description description{ { model_path }, {} };
+    description.instances.reserve(instance_count);
+    for (uint32_t i = 0; i < instance_count; i++)
+    {
+        const glm::vec3 cell(i % side, i / side % side, i / (side * side));
+        const auto position = (cell + .5f) * cell_size - 1.f;
+        description.instances.push_back({ 0, get_instance_transform(position, .4f * cell_size,
+            137.5f * static_cast<float>(i)) });
+    }
+    return description;
+}
+
+uint32_t scene::get_instance_count(size_t mesh) const
+{
+    return first_instances[mesh + 1] - first_instances[mesh];
+}
+
+scene read_scene(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+    const scene_description& description, const model_load_options& options)
+{
+    // the culling of a streamed model only considers a single camera position in its model space
+    if (options.residency_budget != 0)
+    {
+        throw std::runtime_error("Models of scenes can't be streamed");
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    scene result;
+    for (const auto& path : description.mesh_paths)
+    {
+        result.meshes.push_back(read_model(device, allocator, queues, path, options));
+        if (result.meshes.back().is_point_cloud())
+        {
+            throw std::runtime_error("Scenes can only contain triangle meshes, " + path + " is a point cloud");
+        }
+    }
+
+    result.first_instances.assign(result.meshes.size() + 1, 0);
+    for (const auto& instance : description.instances)
+    {
+        result.first_instances[instance.mesh + 1]++;
+    }
+    std::inclusive_scan(result.first_instances.begin(), result.first_instances.end(),
+        result.first_instances.begin());
+
+    result.transforms.resize(description.instances.size());
+    auto cursors = result.first_instances;
+    for (const auto& instance : description.instances)
+    {
+        result.transforms[cursors[instance.mesh]++] = instance.transform;
+    }
+
+    result.transform_buffer = std::make_unique<buffer>(device, allocator,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, result.transforms.size() * sizeof(glm::mat4),
+        memory_category::model);
+    upload_manager uploads(device, allocator, queues.transfer, queues.graphics, STAGING_SLOT_SIZE,
+        STAGING_SLOT_COUNT);
+    uploads.upload(result.transform_buffer->buf.get(), 0, result.transforms.data(),
+        result.transforms.size() * sizeof(glm::mat4));
+    uploads.wait_idle();
+
+    std::printf("Loaded %zu instances of %zu meshes in %.1f ms\n", result.transforms.size(), result.meshes.size(),
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return result;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+#include "buffer.h"
+#include "model.h"
+
+// A placement of a mesh, the transform maps the normalized model space of the mesh, which fits into [-1, 1]^3, into
+// the scene.
+struct scene_instance
+{
+    uint32_t mesh;
+    glm::mat4 transform;
+};
+
+struct scene_description
+{
+    // every model is only listed once, however many instances it has
+    std::vector<std::string> mesh_paths;
+    std::vector<scene_instance> instances;
+};
+
+// Reads a scene file with one instance per line: the path of a PLY model, which is relative to the scene file and may
+// be quoted, followed by the position x y z and optionally a uniform scale and a rotation about the y axis in degrees.
+// Empty lines and lines starting with # are skipped.
+scene_description read_scene_description(const std::string& path);
+
+// Places instance_count copies of the model on a grid that fills [-1, 1]^3, each rotated differently.
+scene_description create_stress_scene_description(const std::string& model_path, uint32_t instance_count);
+
+struct scene
+{
+    std::vector<model> meshes;
+    // transforms of all instances sorted by mesh, the instances of mesh i are [first_instances[i],
+    // first_instances[i + 1])
+    std::vector<glm::mat4> transforms;
+    std::vector<uint32_t> first_instances;
+    // the transforms as mat4s for the shaders
+    std::unique_ptr<buffer> transform_buffer;
+
+    uint32_t get_instance_count(size_t mesh) const;
+};
+
+// Loads every mesh once and uploads the transforms of the instances. Meshes must have triangles and can't be streamed.
+scene read_scene(vk::Device device, memory_allocator& allocator, const device_queues& queues,
+    const scene_description& description, const model_load_options& options);
@@ -0,0 +1,79 @@
+#version 460
+
+#define MAX_LOD_COUNT 8
+
+layout(set = 0, binding = 0, std140) uniform ub
+{
+    mat4 projection;
+    mat4 modelView;
+};
+
+// the compact vertex layout stores an octahedral normal in the first two components
+layout(constant_id = 0) const bool OCTAHEDRAL_NORMALS = false;
+
+struct PositionChunk
+{
+    vec4 dequantization;
+    uint firstVertex;
+    uint vertexCount;
+    uint firstIndex;
+    uint indexCount;
+};
+
+layout(set = 0, binding = 1, std430) readonly buffer cb
+{
+    PositionChunk chunks[];
+};
+
+layout(set = 0, binding = 2, std430) readonly buffer tb
+{
+    mat4 transforms[];
+};
+
+layout(set = 0, binding = 3, std430) readonly buffer vb
+{
+    uint lodInstanceCounts[MAX_LOD_COUNT];
+    uint visibleInstances[];
+};
+
+layout(push_constant) uniform pc
+{
+    uint instanceCount;
+};
+
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec3 vertexColor;
+
+layout(location = 0) out vec3 position;
+layout(location = 1) out vec3 normal;
+layout(location = 2) out vec3 color;
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    // scene_draws.comp passes the chunk and the level of detail of the meshlet as its first instance, the instances
+    // of the draw are the visible ones of that level
+    uint chunk = gl_BaseInstance / MAX_LOD_COUNT;
+    uint lod = gl_BaseInstance % MAX_LOD_COUNT;
+    uint instance = visibleInstances[lod * instanceCount + gl_InstanceIndex - gl_BaseInstance];
+    mat4 instanceModelView = modelView * transforms[instance];
+
+    vec4 dequantization = chunks[chunk].dequantization;
+    // not fused, so vertices shared by position chunks land on the same grid point in each of them
+    precise vec3 objectPosition = vertexPosition * dequantization.w + dequantization.xyz;
+    vec3 objectNormal = OCTAHEDRAL_NORMALS ? decodeOctahedral(vertexNormal.xy) : vertexNormal;
+
+    gl_Position = projection * instanceModelView * vec4(objectPosition, 1.0);
+    position = vec3(instanceModelView * vec4(objectPosition, 1.0));
+    normal = vec3(instanceModelView * vec4(objectNormal, 0.0));
+    color = vertexColor;
+}
@@ -0,0 +1,241 @@
+#include "stdafx.h"
+#include "scene_renderer.h"
+
+// Binds the buffers to consecutive bindings of the set, the first one is a uniform buffer if is_first_uniform is set
+// and all others are storage buffers.
+static void update_buffer_descriptors(vk::Device device, vk::DescriptorSet set, bool is_first_uniform,
+    std::initializer_list<const buffer*> buffers)
+{
+    std::vector<vk::DescriptorBufferInfo> infos;
+    for (const auto* b : buffers)
+    {
+        infos.push_back(vk::DescriptorBufferInfo()
+            .setBuffer(b->buf.get())
+            .setRange(b->size));
+    }
+
+    std::vector<vk::WriteDescriptorSet> writes;
+    for (uint32_t i = 0; i < infos.size(); i++)
+    {
+        writes.push_back(vk::WriteDescriptorSet()
+            .setDstBinding(i)
+            .setDescriptorType(i == 0 && is_first_uniform
+                ? vk::DescriptorType::eUniformBuffer
+                : vk::DescriptorType::eStorageBuffer)
+            .setDescriptorCount(1)
+            .setDstSet(set)
+            .setPBufferInfo(&infos[i]));
+    }
+    device.updateDescriptorSets(writes, {});
+}
+
+scene_renderer::scene_renderer(vk::PhysicalDevice physical_device, vk::Device device, memory_allocator& allocator,
+    vk::Extent2D framebuffer_size, const pipeline* scene_pipeline, const pipeline* cull_pipeline,
+    const pipeline* draws_pipeline, const scene* scn)
+    : scn(scn)
+    , scene_pipeline(scene_pipeline)
+    , cull_pipeline(cull_pipeline)
+    , draws_pipeline(draws_pipeline)
+    , uniform_buffer(device, allocator, vk::BufferUsageFlagBits::eUniformBuffer, HOST_VISIBLE_AND_COHERENT,
+        sizeof(model_uniform_data), memory_category::other)
+    , framebuffer_size(framebuffer_size)
+    , max_draw_indirect_count(physical_device.getProperties().limits.maxDrawIndirectCount)
+{
+    // every mesh has a set per pipeline, which bind 2 uniform buffers and 9 storage buffers in total
+    const auto mesh_count = static_cast<uint32_t>(scn->meshes.size());
+    std::array sizes{
+        vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2 * mesh_count),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 9 * mesh_count),
+    };
+    descriptor_pool = device.createDescriptorPoolUnique(
+        vk::DescriptorPoolCreateInfo()
+        .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet)
+        .setPoolSizes(sizes)
+        .setMaxSets(3 * mesh_count)
+    );
+
+    meshes.reserve(mesh_count);
+    for (uint32_t i = 0; i < mesh_count; i++)
+    {
+        const auto& mdl = scn->meshes[i];
+        const auto visible_instance_count = static_cast<vk::DeviceSize>(MAX_LOD_COUNT)
+            + mdl.lods.size() * scn->get_instance_count(i);
+
+        std::array set_layouts{
+            scene_pipeline->set_layout.get(),
+            cull_pipeline->set_layout.get(),
+            draws_pipeline->set_layout.get(),
+        };
+        auto descriptor_sets = device.allocateDescriptorSetsUnique(
+            vk::DescriptorSetAllocateInfo()
+            .setDescriptorPool(descriptor_pool.get())
+            .setSetLayouts(set_layouts)
+        );
+
+        meshes.push_back({
+            buffer(device, allocator,
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, mdl.meshlet_count * sizeof(vk::DrawIndexedIndirectCommand),
+                memory_category::other),
+            buffer(device, allocator,
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, visible_instance_count * sizeof(uint32_t),
+                memory_category::other),
+            std::move(descriptor_sets[0]),
+            std::move(descriptor_sets[1]),
+            std::move(descriptor_sets[2]),
+            });
+
+        const auto& resources = meshes.back();
+        update_buffer_descriptors(device, resources.descriptor_set.get(), true, {
+            &uniform_buffer,
+            mdl.chunk_buffer.get(),
+            scn->transform_buffer.get(),
+            &resources.visible_instance_buffer,
+            });
+        update_buffer_descriptors(device, resources.cull_descriptor_set.get(), true, {
+            &uniform_buffer,
+            scn->transform_buffer.get(),
+            &resources.visible_instance_buffer,
+            });
+        update_buffer_descriptors(device, resources.draws_descriptor_set.get(), false, {
+            mdl.meshlet_buffer.get(),
+            &resources.draw_command_buffer,
+            mdl.residency_buffer.get(),
+            &resources.visible_instance_buffer,
+            });
+    }
+}
+
+void scene_renderer::update(vk::Device device, model_uniform_data model_uniform_data) const
+{
+    uniform_buffer.update(device, &model_uniform_data);
+}
+
+void scene_renderer::draw_outside_renderpass(vk::CommandBuffer command_buffer) const
+{
+    std::vector<vk::BufferMemoryBarrier> count_barriers;
+    for (const auto& mesh : meshes)
+    {
+        command_buffer.fillBuffer(mesh.visible_instance_buffer.buf.get(), 0, MAX_LOD_COUNT * sizeof(uint32_t), 0);
+        count_barriers.push_back(vk::BufferMemoryBarrier()
+            .setBuffer(mesh.visible_instance_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+            .setSize(VK_WHOLE_SIZE));
+    }
+
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eHost,
+        vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eComputeShader,
+        vk::DependencyFlagBits(),
+        {},
+        {
+            vk::BufferMemoryBarrier()
+            .setBuffer(uniform_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eHostWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+            .setSize(uniform_buffer.size)
+        },
+        {}
+    );
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::DependencyFlagBits(),
+        {},
+        count_barriers,
+        {}
+    );
+
+    // one invocation per instance appends it to the visible instances of its level of detail
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, cull_pipeline->pl.get());
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const auto& mdl = scn->meshes[i];
+        scene_cull_push_constants push_constants{};
+        assert(mdl.lods.size() <= MAX_LOD_COUNT);
+        for (size_t j = 0; j < mdl.lods.size(); j++)
+        {
+            push_constants.lod_errors[j] = mdl.lods[j].error;
+        }
+        push_constants.lod_count = static_cast<uint32_t>(mdl.lods.size());
+        push_constants.viewport_height = static_cast<float>(framebuffer_size.height);
+        push_constants.first_instance = scn->first_instances[i];
+        push_constants.instance_count = scn->get_instance_count(i);
+
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cull_pipeline->layout.get(), 0,
+            meshes[i].cull_descriptor_set.get(), {});
+        command_buffer.pushConstants(cull_pipeline->layout.get(), vk::ShaderStageFlagBits::eCompute, 0,
+            sizeof(push_constants), &push_constants);
+        command_buffer.dispatch((push_constants.instance_count + 63) / 64, 1, 1);
+    }
+
+    std::vector<vk::BufferMemoryBarrier> visible_instance_barriers;
+    for (const auto& mesh : meshes)
+    {
+        visible_instance_barriers.push_back(vk::BufferMemoryBarrier()
+            .setBuffer(mesh.visible_instance_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+            .setSize(VK_WHOLE_SIZE));
+    }
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eVertexShader,
+        vk::DependencyFlagBits(),
+        {},
+        visible_instance_barriers,
+        {}
+    );
+
+    // one invocation per meshlet writes its draw command with the visible instance count of its level of detail
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, draws_pipeline->pl.get());
+    std::vector<vk::BufferMemoryBarrier> draw_command_barriers;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, draws_pipeline->layout.get(), 0,
+            meshes[i].draws_descriptor_set.get(), {});
+        command_buffer.dispatch((scn->meshes[i].meshlet_count + 63) / 64, 1, 1);
+
+        draw_command_barriers.push_back(vk::BufferMemoryBarrier()
+            .setBuffer(meshes[i].draw_command_buffer.buf.get())
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+            .setSize(meshes[i].draw_command_buffer.size));
+    }
+
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eDrawIndirect,
+        vk::DependencyFlagBits(),
+        {},
+        draw_command_barriers,
+        {}
+    );
+}
+
+void scene_renderer::draw(vk::CommandBuffer command_buffer) const
+{
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, scene_pipeline->pl.get());
+
+    command_buffer.setViewport(0, {
+                                   vk::Viewport().setWidth(static_cast<float>(framebuffer_size.width))
+                                                 .setY(static_cast<float>(framebuffer_size.height))
+                                                 .setHeight(-static_cast<float>(framebuffer_size.height))
+                                                 .setMaxDepth(1.0)
+        });
+
+    command_buffer.setScissor(0, { vk::Rect2D().setExtent(framebuffer_size) });
+
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, scene_pipeline->layout.get(), 0,
+            meshes[i].descriptor_set.get(), {});
+        const scene_push_constants push_constants{ scn->get_instance_count(i) };
+        command_buffer.pushConstants(scene_pipeline->layout.get(), vk::ShaderStageFlagBits::eVertex, 0,
+            sizeof(push_constants), &push_constants);
+        scn->meshes[i].draw(command_buffer, meshes[i].draw_command_buffer.buf.get(), scn->meshes[i].meshlet_count,
+            max_draw_indirect_count);
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "renderer.h"
+#include "data_types.h"
+#include "pipeline.h"
+#include "scene.h"
+
+// Draws every mesh of a scene with a single indirect multi-draw, however many instances it has. A compute pass culls
+// the instances against the frustum and sorts the visible ones by level of detail, then another writes a draw command
+// per meshlet that draws it for all visible instances of its level. Meshlets aren't culled by their own bounds and
+// normal cones, which would take a draw per meshlet and instance.
+class scene_renderer : public renderer
+{
+    struct mesh_resources
+    {
+        buffer draw_command_buffer;
+        // counts of the visible instances of every level of detail, followed by a list of them per level
+        buffer visible_instance_buffer;
+        vk::UniqueDescriptorSet descriptor_set;
+        vk::UniqueDescriptorSet cull_descriptor_set;
+        vk::UniqueDescriptorSet draws_descriptor_set;
+    };
+
+    const scene* scn;
+    const pipeline* scene_pipeline;
+    const pipeline* cull_pipeline;
+    const pipeline* draws_pipeline;
+    buffer uniform_buffer;
+    // the descriptor sets of scenes with many meshes wouldn't fit into the shared pool
+    vk::UniqueDescriptorPool descriptor_pool;
+    std::vector<mesh_resources> meshes;
+    vk::Extent2D framebuffer_size;
+    uint32_t max_draw_indirect_count;
+
+public:
+    scene_renderer(vk::PhysicalDevice physical_device, vk::Device device, memory_allocator& allocator,
+        vk::Extent2D framebuffer_size, const pipeline* scene_pipeline, const pipeline* cull_pipeline,
+        const pipeline* draws_pipeline, const scene* scn);
+    void update(vk::Device device, model_uniform_data model_uniform_data) const override;
+
+    void draw_outside_renderpass(vk::CommandBuffer command_buffer) const override;
+
+    void draw(vk::CommandBuffer command_buffer) const override;
+};
@@ -0,0 +1,28 @@
+#version 460
+#extension GL_ARB_gpu_shader_int64 : require
+
+layout(set = 0, binding = 0, std430) readonly buffer pb
+{
+    uint64_t pixels[];
+};
+
+layout(push_constant) uniform pc
+{
+    uint width;
+};
+
+layout(location = 0, index = 0) out vec4 fragColor;
+
+// Writes the closest point splatted into every pixel with its depth, so it is depth tested against the rest of the
+// frame like rasterized geometry.
+void main()
+{
+    uint64_t value = pixels[uint(gl_FragCoord.y) * width + uint(gl_FragCoord.x)];
+    if (value == 0xFFFFFFFFFFFFFFFFul)
+    {
+        discard;
+    }
+
+    gl_FragDepth = uintBitsToFloat(uint(value >> 32));
+    fragColor = vec4(unpackUnorm4x8(uint(value)).rgb, 1.0);
+}
@@ -0,0 +1,8 @@
+#version 460
+
+// a triangle that covers the screen
+void main()
+{
+    vec2 position = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1) * 4.0 - 1.0;
+    gl_Position = vec4(position, 0.0, 1.0);
+}
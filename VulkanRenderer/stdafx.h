@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cxxopts.hpp>
 #include <fstream>
 #include <optional>
@@ -5,16 +5,16 @@
 static const uint32_t MAX_VERTEX_COUNT = UINT16_MAX;
 static const uint32_t MAX_INDEX_COUNT = UINT16_MAX;
 
-ui_renderer::ui_renderer(vk::PhysicalDevice physical_device, vk::Device device, vk::DescriptorPool descriptor_pool,
+ui_renderer::ui_renderer(vk::Device device, memory_allocator& allocator, vk::DescriptorPool descriptor_pool,
     vk::Extent2D framebuffer_size, const pipeline* ui_pipeline, const image_with_view* font_image)
-    : vertex_buffer(physical_device, device, vk::BufferUsageFlagBits::eVertexBuffer, HOST_VISIBLE_AND_COHERENT,
-        MAX_VERTEX_COUNT * sizeof(ImDrawVert))
-    , index_buffer(physical_device, device, vk::BufferUsageFlagBits::eIndexBuffer, HOST_VISIBLE_AND_COHERENT,
-        MAX_INDEX_COUNT * sizeof(uint16_t))
-    , indirect_buffer(physical_device, device, vk::BufferUsageFlagBits::eIndirectBuffer, HOST_VISIBLE_AND_COHERENT,
-        MAX_UI_DRAW_COUNT * sizeof(VkDrawIndexedIndirectCommand))
-    , uniform_buffer(physical_device, device, vk::BufferUsageFlagBits::eUniformBuffer, HOST_VISIBLE_AND_COHERENT,
-        sizeof(ui_uniform_data))
+    : vertex_buffer(device, allocator, vk::BufferUsageFlagBits::eVertexBuffer, HOST_VISIBLE_AND_COHERENT,
+        MAX_VERTEX_COUNT * sizeof(ImDrawVert), memory_category::ui)
+    , index_buffer(device, allocator, vk::BufferUsageFlagBits::eIndexBuffer, HOST_VISIBLE_AND_COHERENT,
+        MAX_INDEX_COUNT * sizeof(uint16_t), memory_category::ui)
+    , indirect_buffer(device, allocator, vk::BufferUsageFlagBits::eIndirectBuffer, HOST_VISIBLE_AND_COHERENT,
+        MAX_UI_DRAW_COUNT * sizeof(VkDrawIndexedIndirectCommand), memory_category::ui)
+    , uniform_buffer(device, allocator, vk::BufferUsageFlagBits::eUniformBuffer, HOST_VISIBLE_AND_COHERENT,
+        sizeof(ui_uniform_data), memory_category::ui)
     , ui_pipeline(ui_pipeline)
     , font_image(font_image)
     , framebuffer_size(framebuffer_size)
@@ -62,14 +62,12 @@ void ui_renderer::update(vk::Device device, model_uniform_data model_uniform_dat
     assert(draw_data->TotalVtxCount < MAX_VERTEX_COUNT);
     assert(draw_data->TotalIdxCount < MAX_INDEX_COUNT);
 
-    auto* indices = static_cast<uint16_t*>(device.mapMemory(index_buffer.memory.get(), 0, index_buffer.size));
-    auto* vertices = static_cast<ImDrawVert*>(device.mapMemory(vertex_buffer.memory.get(), 0, vertex_buffer.size));
-    auto* indirect = static_cast<VkDrawIndexedIndirectCommand*>(device.mapMemory(
-        indirect_buffer.memory.get(), 0, indirect_buffer.size));
+    auto* indices = index_buffer.get_mapped<uint16_t>().data();
+    auto* vertices = vertex_buffer.get_mapped<ImDrawVert>().data();
+    auto* indirect = indirect_buffer.get_mapped<VkDrawIndexedIndirectCommand>().data();
     memset(indirect, 0, indirect_buffer.size);
 
-    auto* uniform = static_cast<ui_uniform_data*>(device.mapMemory(uniform_buffer.memory.get(), 0,
-        uniform_buffer.size));
+    auto* uniform = uniform_buffer.get_mapped<ui_uniform_data>().data();
     uniform->screen_width = static_cast<float>(framebuffer_size.width);
     uniform->screen_height = static_cast<float>(framebuffer_size.height);
 
@@ -104,10 +102,14 @@ void ui_renderer::update(vk::Device device, model_uniform_data model_uniform_dat
         list_first_vertex += cmd_list->VtxBuffer.size();
     }
 
-    device.unmapMemory(uniform_buffer.memory.get());
-    device.unmapMemory(indirect_buffer.memory.get());
-    device.unmapMemory(vertex_buffer.memory.get());
-    device.unmapMemory(index_buffer.memory.get());
+    // only what was written this frame, nothing if the UI is empty
+    if (list_first_index > 0)
+    {
+        index_buffer.memory.flush(0, list_first_index * sizeof(*indices));
+        vertex_buffer.memory.flush(0, list_first_vertex * sizeof(*vertices));
+    }
+    indirect_buffer.memory.flush();
+    uniform_buffer.memory.flush();
 }
 
 void ui_renderer::draw_outside_renderpass(vk::CommandBuffer command_buffer) const
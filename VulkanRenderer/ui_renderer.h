@@ -18,7 +18,7 @@ class ui_renderer : public renderer
     vk::Extent2D framebuffer_size;
 
 public:
-    ui_renderer(vk::PhysicalDevice physical_device, vk::Device device, vk::DescriptorPool descriptor_pool,
+    ui_renderer(vk::Device device, memory_allocator& allocator, vk::DescriptorPool descriptor_pool,
         vk::Extent2D framebuffer_size, const pipeline* ui_pipeline, const image_with_view* font_image);
     void update(vk::Device device, model_uniform_data model_uniform_data) const override;
 
@@ -0,0 +1,361 @@
+#include "stdafx.h"
+#include "upload_manager.h"
+
+// staged data is aligned for any element type and for the texel sizes of buffer to image copies
+static const vk::DeviceSize STAGING_ALIGNMENT = 16;
+
+// Submits a command buffer that waits for wait_value of wait_timeline unless that is null and signals signal_value of
+// signal_timeline.
+static void submit_batch(vk::Queue queue, vk::CommandBuffer command_buffer, vk::Semaphore wait_timeline,
+    upload_token wait_value, vk::Semaphore signal_timeline, upload_token signal_value)
+{
+    const auto wait_stage_mask = vk::PipelineStageFlags(vk::PipelineStageFlagBits::eAllCommands);
+    const auto wait_count = wait_timeline ? 1u : 0u;
+    const vk::StructureChain<vk::SubmitInfo, vk::TimelineSemaphoreSubmitInfo> submit_info{
+        vk::SubmitInfo()
+        .setWaitSemaphoreCount(wait_count)
+        .setPWaitSemaphores(&wait_timeline)
+        .setPWaitDstStageMask(&wait_stage_mask)
+        .setCommandBufferCount(1)
+        .setPCommandBuffers(&command_buffer)
+        .setSignalSemaphoreCount(1)
+        .setPSignalSemaphores(&signal_timeline),
+        vk::TimelineSemaphoreSubmitInfo()
+        .setWaitSemaphoreValueCount(wait_count)
+        .setPWaitSemaphoreValues(&wait_value)
+        .setSignalSemaphoreValueCount(1)
+        .setPSignalSemaphoreValues(&signal_value)
+    };
+    queue.submit({ submit_info.get<vk::SubmitInfo>() }, nullptr);
+}
+
+upload_manager::upload_manager(vk::Device device, memory_allocator& allocator, device_queue queue,
+    device_queue owner, vk::DeviceSize slot_size, uint32_t slot_count, std::mutex* queue_mutex)
+    : device(device)
+    , queue(queue)
+    , owner(owner)
+    , queue_mutex(queue_mutex)
+    , slot_size(slot_size)
+    , staging_buffer(device, allocator, vk::BufferUsageFlagBits::eTransferSrc, HOST_VISIBLE_AND_COHERENT,
+        slot_size * slot_count, memory_category::staging)
+    , current_batch(0)
+    , staged_size(0)
+    , is_recording(false)
+    , next_token(1)
+{
+    assert(slot_count > 0);
+
+    const auto create_command_buffers = [&](uint32_t family, vk::UniqueCommandPool& pool)
+    {
+        pool = device.createCommandPoolUnique(
+            vk::CommandPoolCreateInfo()
+            .setFlags(vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer)
+            .setQueueFamilyIndex(family)
+        );
+        return device.allocateCommandBuffersUnique(
+            vk::CommandBufferAllocateInfo()
+            .setCommandPool(pool.get())
+            .setLevel(vk::CommandBufferLevel::ePrimary)
+            .setCommandBufferCount(slot_count)
+        );
+    };
+
+    const vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> timeline_info{
+        vk::SemaphoreCreateInfo(),
+        vk::SemaphoreTypeCreateInfo()
+        .setSemaphoreType(vk::SemaphoreType::eTimeline)
+        .setInitialValue(0)
+    };
+    timeline = device.createSemaphoreUnique(timeline_info.get<vk::SemaphoreCreateInfo>());
+
+    auto command_buffers = create_command_buffers(queue.family, command_pool);
+    std::vector<vk::UniqueCommandBuffer> acquire_command_buffers(slot_count);
+    if (is_ownership_transferred())
+    {
+        acquire_command_buffers = create_command_buffers(owner.family, acquire_command_pool);
+        copied_timeline = device.createSemaphoreUnique(timeline_info.get<vk::SemaphoreCreateInfo>());
+    }
+
+    for (uint32_t i = 0; i < slot_count; i++)
+    {
+        batches.push_back({ std::move(command_buffers[i]), std::move(acquire_command_buffers[i]), {}, {}, 0 });
+    }
+}
+
+upload_manager::~upload_manager()
+{
+    wait_idle();
+}
+
+bool upload_manager::is_ownership_transferred() const
+{
+    return queue.family != owner.family;
+}
+
+vk::DeviceSize upload_manager::get_available_size() const
+{
+    if (!is_recording)
+    {
+        return slot_size;
+    }
+    const auto offset = (staged_size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    return offset < slot_size ? slot_size - offset : 0;
+}
+
+vk::DeviceSize upload_manager::stage(vk::DeviceSize size)
+{
+    assert(size <= slot_size);
+    if (size > get_available_size())
+    {
+        submit();
+    }
+
+    if (!is_recording)
+    {
+        // the slot of the batch is reused once its previous copies are done
+        auto& b = batches[current_batch];
+        wait(b.token);
+        b.command_buffer->reset();
+        if (b.acquire_command_buffer)
+        {
+            b.acquire_command_buffer->reset();
+        }
+        b.command_buffer->begin(
+            vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        staged_size = 0;
+        is_recording = true;
+    }
+
+    const auto offset = (staged_size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    staged_size = offset + size;
+    return current_batch * slot_size + offset;
+}
+
+upload_token upload_manager::upload(vk::Buffer destination, vk::DeviceSize destination_offset, size_t element_size,
+    size_t count, const std::function<void(size_t first, size_t count, void* data)>& fill)
+{
+    assert(element_size <= slot_size);
+
+    for (size_t first = 0; first < count;)
+    {
+        const auto chunk_count = std::min(count - first, static_cast<size_t>(get_available_size() / element_size));
+        if (chunk_count == 0)
+        {
+            submit();
+            continue;
+        }
+
+        const auto size = static_cast<vk::DeviceSize>(chunk_count * element_size);
+        const auto staging_offset = stage(size);
+        fill(first, chunk_count, staging_buffer.get_mapped<uint8_t>().data() + staging_offset);
+        staging_buffer.memory.flush(staging_offset, size);
+
+        const auto offset = destination_offset + static_cast<vk::DeviceSize>(first * element_size);
+        auto& b = batches[current_batch];
+        b.command_buffer->copyBuffer(staging_buffer.buf.get(), destination, { vk::BufferCopy(staging_offset, offset,
+            size) });
+        if (is_ownership_transferred())
+        {
+            // consecutive pieces of an upload are released together
+            auto& barriers = b.buffer_barriers;
+            if (!barriers.empty() && barriers.back().buffer == destination
+                && barriers.back().offset + barriers.back().size == offset)
+            {
+                barriers.back().size += size;
+            }
+            else
+            {
+                barriers.push_back(vk::BufferMemoryBarrier()
+                    .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                    .setSrcQueueFamilyIndex(queue.family)
+                    .setDstQueueFamilyIndex(owner.family)
+                    .setBuffer(destination)
+                    .setOffset(offset)
+                    .setSize(size));
+            }
+        }
+        first += chunk_count;
+    }
+
+    return is_recording ? next_token : next_token - 1;
+}
+
+upload_token upload_manager::upload(vk::Buffer destination, vk::DeviceSize destination_offset, const void* data,
+    vk::DeviceSize size)
+{
+    return upload(destination, destination_offset, 1, static_cast<size_t>(size),
+        [&](size_t first, size_t count, void* staged)
+        {
+            memcpy(staged, static_cast<const uint8_t*>(data) + first, count);
+        });
+}
+
+upload_token upload_manager::upload(const image_with_memory& destination, const void* data, vk::DeviceSize size)
+{
+    const auto staging_offset = stage(size);
+    memcpy(staging_buffer.get_mapped<uint8_t>().data() + staging_offset, data, size);
+    staging_buffer.memory.flush(staging_offset, size);
+
+    const auto command_buffer = batches[current_batch].command_buffer.get();
+    command_buffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags(),
+        {},
+        {},
+        {
+            vk::ImageMemoryBarrier(
+                vk::AccessFlags(),
+                vk::AccessFlagBits::eTransferWrite,
+                vk::ImageLayout::eUndefined,
+                vk::ImageLayout::eTransferDstOptimal,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                destination.image.get(),
+                destination.sub_resource_range
+            )
+        }
+    );
+    command_buffer.copyBufferToImage(staging_buffer.buf.get(), destination.image.get(),
+        vk::ImageLayout::eTransferDstOptimal, {
+            vk::BufferImageCopy()
+            .setBufferOffset(staging_offset)
+            .setImageSubresource(vk::ImageSubresourceLayers(destination.sub_resource_range.aspectMask, 0, 0, 1))
+            .setImageExtent(vk::Extent3D(destination.width, destination.height, 1))
+        });
+    // the transition to the final layout is recorded with the other barriers at the end of the batch
+    batches[current_batch].image_barriers.push_back(vk::ImageMemoryBarrier(
+        vk::AccessFlagBits::eTransferWrite,
+        is_ownership_transferred() ? vk::AccessFlags() : vk::AccessFlagBits::eShaderRead,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        is_ownership_transferred() ? queue.family : VK_QUEUE_FAMILY_IGNORED,
+        is_ownership_transferred() ? owner.family : VK_QUEUE_FAMILY_IGNORED,
+        destination.image.get(),
+        destination.sub_resource_range
+    ));
+
+    return next_token;
+}
+
+upload_token upload_manager::submit()
+{
+    if (!is_recording)
+    {
+        return next_token - 1;
+    }
+
+    auto& b = batches[current_batch];
+    if (is_ownership_transferred())
+    {
+        // the release barriers, whose destination stage is ignored
+        b.command_buffer->pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eBottomOfPipe,
+            vk::DependencyFlags(),
+            {},
+            b.buffer_barriers,
+            b.image_barriers
+        );
+    }
+    else
+    {
+        // the destinations may be read or overwritten by any later command on the queue
+        b.command_buffer->pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eAllCommands,
+            vk::DependencyFlags(),
+            {
+                vk::MemoryBarrier()
+                .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                .setDstAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite)
+            },
+            {},
+            b.image_barriers
+        );
+    }
+    b.command_buffer->end();
+
+    if (is_ownership_transferred())
+    {
+        // the acquire barriers repeat the release barriers with the access masks of the owner
+        for (auto& barrier : b.buffer_barriers)
+        {
+            barrier
+                .setSrcAccessMask(vk::AccessFlags())
+                .setDstAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite);
+        }
+        for (auto& barrier : b.image_barriers)
+        {
+            barrier
+                .setSrcAccessMask(vk::AccessFlags())
+                .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+        }
+        b.acquire_command_buffer->begin(
+            vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        b.acquire_command_buffer->pipelineBarrier(
+            vk::PipelineStageFlagBits::eAllCommands,
+            vk::PipelineStageFlagBits::eAllCommands,
+            vk::DependencyFlags(),
+            {},
+            b.buffer_barriers,
+            b.image_barriers
+        );
+        b.acquire_command_buffer->end();
+    }
+    b.buffer_barriers.clear();
+    b.image_barriers.clear();
+
+    b.token = next_token++;
+    {
+        std::unique_lock<std::mutex> lock;
+        if (queue_mutex)
+        {
+            lock = std::unique_lock(*queue_mutex);
+        }
+        if (is_ownership_transferred())
+        {
+            submit_batch(queue.queue, b.command_buffer.get(), nullptr, 0, copied_timeline.get(), b.token);
+            submit_batch(owner.queue, b.acquire_command_buffer.get(), copied_timeline.get(), b.token, timeline.get(),
+                b.token);
+        }
+        else
+        {
+            submit_batch(queue.queue, b.command_buffer.get(), nullptr, 0, timeline.get(), b.token);
+        }
+    }
+
+    current_batch = (current_batch + 1) % batches.size();
+    is_recording = false;
+    return b.token;
+}
+
+bool upload_manager::is_complete(upload_token token) const
+{
+    return token < next_token && device.getSemaphoreCounterValue(timeline.get()) >= token;
+}
+
+void upload_manager::wait(upload_token token)
+{
+    if (is_recording && token == next_token)
+    {
+        submit();
+    }
+    if (token == 0 || token >= next_token)
+    {
+        return;
+    }
+
+    device.waitSemaphores(
+        vk::SemaphoreWaitInfo()
+        .setSemaphoreCount(1)
+        .setPSemaphores(&timeline.get())
+        .setPValues(&token),
+        UINT64_MAX
+    );
+}
+
+void upload_manager::wait_idle()
+{
+    wait(submit());
+}
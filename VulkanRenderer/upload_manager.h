@@ -0,0 +1,83 @@
+#pragma once
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "buffer.h"
+#include "image_with_view.h"
+#include "vulkan_context.h"
+
+// The value a timeline semaphore reaches once the batch containing an upload has been copied.
+using upload_token = uint64_t;
+
+// Copies host data into device local buffers and images through a fixed number of host visible staging slots. The
+// copies staged in a slot are recorded into one command buffer, which is submitted when the slot is full or submit is
+// called, so the CPU fills the next slot while the queue is still copying the previous ones. Batches signal a
+// timeline semaphore, callers only wait for the token of an upload if the host needs it to have finished. Later
+// submissions to the queue of the owner see the uploaded data without waiting, once the batch has been submitted.
+class upload_manager
+{
+    struct batch
+    {
+        vk::UniqueCommandBuffer command_buffer;
+        // acquires the destinations on the queue of the owner, only used if it is of another family
+        vk::UniqueCommandBuffer acquire_command_buffer;
+        // the release halves of the ownership transfers of the destinations, or the final layout transitions of
+        // images without a transfer
+        std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+        std::vector<vk::ImageMemoryBarrier> image_barriers;
+        // the timeline value the batch signals when its copies are done, 0 if it wasn't submitted yet
+        upload_token token;
+    };
+
+    vk::Device device;
+    device_queue queue;
+    device_queue owner;
+    std::mutex* queue_mutex;
+    vk::DeviceSize slot_size;
+    buffer staging_buffer;
+    vk::UniqueCommandPool command_pool;
+    vk::UniqueCommandPool acquire_command_pool;
+    vk::UniqueSemaphore timeline;
+    // signaled with the token of a batch when its copies are done and the owner can acquire them
+    vk::UniqueSemaphore copied_timeline;
+    std::vector<batch> batches;
+    size_t current_batch;
+    // bytes staged in the slot of the current batch, which is only recorded into if is_recording is set
+    vk::DeviceSize staged_size;
+    bool is_recording;
+    upload_token next_token;
+
+    bool is_ownership_transferred() const;
+    // bytes that can still be staged without submitting the current batch
+    vk::DeviceSize get_available_size() const;
+    // Returns the offset of size bytes in the staging buffer, submitting the current batch first if they don't fit.
+    vk::DeviceSize stage(vk::DeviceSize size);
+
+public:
+    // Copies are submitted to queue, their destinations are used on the queue of owner afterwards. If that is of
+    // another family, ownership of the destinations is transferred to it after every batch. queue_mutex is held while
+    // submitting if the queues are shared with another thread.
+    upload_manager(vk::Device device, memory_allocator& allocator, device_queue queue, device_queue owner,
+        vk::DeviceSize slot_size, uint32_t slot_count, std::mutex* queue_mutex = nullptr);
+    upload_manager(const upload_manager&) = delete;
+    upload_manager& operator=(const upload_manager&) = delete;
+    ~upload_manager();
+
+    // Uploads count elements to destination starting at destination_offset. fill writes elements
+    // [first, first + count) to data and runs on the calling thread while earlier batches are being copied.
+    upload_token upload(vk::Buffer destination, vk::DeviceSize destination_offset, size_t element_size, size_t count,
+        const std::function<void(size_t first, size_t count, void* data)>& fill);
+    upload_token upload(vk::Buffer destination, vk::DeviceSize destination_offset, const void* data,
+        vk::DeviceSize size);
+    // Uploads all texels of the first mip level of an image, which must fit into a slot, and transitions it from an
+    // undefined layout to eShaderReadOnlyOptimal.
+    upload_token upload(const image_with_memory& destination, const void* data, vk::DeviceSize size);
+
+    // Submits the copies recorded so far and returns the token of the last submitted batch.
+    upload_token submit();
+    bool is_complete(upload_token token) const;
+    // Submits the batch of the token if necessary and waits for it.
+    void wait(upload_token token);
+    void wait_idle();
+};
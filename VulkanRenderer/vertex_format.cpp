@@ -0,0 +1,27 @@
+#include "stdafx.h"
+#include "vertex_format.h"
+
+vertex_format_info get_vertex_format_info(const vertex_layout& layout)
+{
+    return visit_vertex_format(layout, [](auto format)
+        {
+            return decltype(format)::get_info();
+        });
+}
+
+position_format parse_position_format(const std::string& name)
+{
+    if (name == "snorm16")
+    {
+        return position_format::snorm16;
+    }
+    if (name == "float32")
+    {
+        return position_format::float32;
+    }
+    if (name == "half")
+    {
+        return position_format::half;
+    }
+    throw std::runtime_error("Unsupported position format: " + name);
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vulkan/vulkan.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// An attribute as it comes out of the vectorized quantization pass: the value in normalized model space, or the
+// unnormalized normal, and its R16G16B16 snorm quantization, which is bit-identical across instruction sets.
+struct quantized_attribute
+{
+    glm::vec3 value;
+    glm::i16vec3 snorm;
+};
+
+// Attribute encodings. Each one names its packed type, the format it is read with by the vertex input and, for
+// positions, by acceleration structure builds, and how it is encoded from the quantized attribute.
+
+struct snorm16x3_position
+{
+    using type = glm::i16vec3;
+    static constexpr auto format = vk::Format::eR16G16B16Snorm;
+
+    static type encode(const quantized_attribute& position)
+    {
+        return position.snorm;
+    }
+};
+
+// padded to four components, which is a mandatory acceleration structure vertex format
+struct snorm16x4_position
+{
+    using type = glm::i16vec4;
+    static constexpr auto format = vk::Format::eR16G16B16A16Snorm;
+
+    static type encode(const quantized_attribute& position)
+    {
+        return type(position.snorm, 0);
+    }
+};
+
+struct float32_position
+{
+    using type = glm::vec3;
+    static constexpr auto format = vk::Format::eR32G32B32Sfloat;
+
+    static type encode(const quantized_attribute& position)
+    {
+        return position.value;
+    }
+};
+
+struct half_position
+{
+    using type = glm::u16vec4;
+    static constexpr auto format = vk::Format::eR16G16B16A16Sfloat;
+
+    static type encode(const quantized_attribute& position)
+    {
+        return type(glm::packHalf1x16(position.value.x), glm::packHalf1x16(position.value.y),
+            glm::packHalf1x16(position.value.z), 0);
+    }
+};
+
+struct snorm16x3_normal
+{
+    using type = glm::i16vec3;
+    static constexpr auto format = vk::Format::eR16G16B16Snorm;
+    static constexpr bool is_octahedral = false;
+
+    static type encode(const quantized_attribute& normal)
+    {
+        return normal.snorm;
+    }
+};
+
+// Folds the lower hemisphere of the octahedron onto the upper one, so a unit vector maps to [-1, 1]^2. Encoded from
+// the unquantized normal, which doesn't have to be normalized.
+struct octahedral_normal
+{
+    using type = glm::i16vec2;
+    static constexpr auto format = vk::Format::eR16G16Snorm;
+    static constexpr bool is_octahedral = true;
+
+    static type encode(const quantized_attribute& normal)
+    {
+        const auto& n = normal.value;
+        const auto sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (sum == 0.f)
+        {
+            return type(0);
+        }
+
+        auto x = n.x / sum;
+        auto y = n.y / sum;
+        if (n.z < 0.f)
+        {
+            const auto folded_x = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+            const auto folded_y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+            x = folded_x;
+            y = folded_y;
+        }
+
+        return type(
+            static_cast<int16_t>(std::round(glm::clamp(x, -1.f, 1.f) * INT16_MAX)),
+            static_cast<int16_t>(std::round(glm::clamp(y, -1.f, 1.f) * INT16_MAX))
+        );
+    }
+};
+
+struct unorm8x3_color
+{
+    using type = glm::u8vec3;
+    static constexpr auto format = vk::Format::eR8G8B8Unorm;
+
+    static type encode(const glm::u8vec3& color)
+    {
+        return color;
+    }
+};
+
+struct unorm8x4_color
+{
+    using type = glm::u8vec4;
+    static constexpr auto format = vk::Format::eR8G8B8A8Unorm;
+
+    static type encode(const glm::u8vec3& color)
+    {
+        return type(color, UINT8_MAX);
+    }
+};
+
+// Runtime description of a vertex format, for the code that only needs its layout.
+struct vertex_format_info
+{
+    uint32_t size;
+    // positions, normals and colors at locations 0, 1 and 2 of binding 0
+    std::array<vk::VertexInputAttributeDescription, 3> attributes;
+    vk::Format acceleration_structure_format;
+    bool octahedral_normals;
+};
+
+template <typename Position, typename Normal, typename Color>
+struct vertex_format
+{
+    using position_encoding = Position;
+    using normal_encoding = Normal;
+    using color_encoding = Color;
+
+    struct vertex
+    {
+        typename Position::type position;
+        typename Normal::type normal;
+        typename Color::type color;
+    };
+
+    static vertex encode(const quantized_attribute& position, const quantized_attribute& normal,
+        const glm::u8vec3& color)
+    {
+        return { Position::encode(position), Normal::encode(normal), Color::encode(color) };
+    }
+
+    static vertex_format_info get_info()
+    {
+        return {
+            sizeof(vertex),
+            {
+                vk::VertexInputAttributeDescription(0, 0, Position::format, offsetof(vertex, position)),
+                vk::VertexInputAttributeDescription(1, 0, Normal::format, offsetof(vertex, normal)),
+                vk::VertexInputAttributeDescription(2, 0, Color::format, offsetof(vertex, color)),
+            },
+            Position::format,
+            Normal::is_octahedral,
+        };
+    }
+};
+
+// Points of a point cloud, which have no normals and are read by splat.comp instead of the vertex input.
+struct point_format
+{
+    struct vertex
+    {
+        snorm16x4_position::type position;
+        unorm8x4_color::type color;
+    };
+
+    static vertex encode(const quantized_attribute& position, const quantized_attribute&, const glm::u8vec3& color)
+    {
+        return { snorm16x4_position::encode(position), unorm8x4_color::encode(color) };
+    }
+};
+
+enum class position_format
+{
+    snorm16,
+    float32,
+    half,
+};
+
+// Selects the vertex format of a model at load time.
+struct vertex_layout
+{
+    position_format position;
+    // octahedral normals and 4-byte aligned attributes, which are mandatory formats for vertex input and acceleration
+    // structure builds
+    bool compact;
+};
+
+using standard_vertex_format = vertex_format<snorm16x3_position, snorm16x3_normal, unorm8x3_color>;
+using compact_vertex_format = vertex_format<snorm16x4_position, octahedral_normal, unorm8x4_color>;
+
+// Calls function with a default constructed vertex_format for the layout, so code can be generated for every format
+// a model may use.
+template <typename Function>
+decltype(auto) visit_vertex_format(const vertex_layout& layout, Function&& function)
+{
+    switch (layout.position)
+    {
+    case position_format::snorm16:
+        return layout.compact
+            ? function(compact_vertex_format())
+            : function(standard_vertex_format());
+    case position_format::float32:
+        return layout.compact
+            ? function(vertex_format<float32_position, octahedral_normal, unorm8x4_color>())
+            : function(vertex_format<float32_position, snorm16x3_normal, unorm8x3_color>());
+    case position_format::half:
+        return layout.compact
+            ? function(vertex_format<half_position, octahedral_normal, unorm8x4_color>())
+            : function(vertex_format<half_position, snorm16x3_normal, unorm8x3_color>());
+    default:
+        throw std::runtime_error("Unsupported position format");
+    }
+}
+
+vertex_format_info get_vertex_format_info(const vertex_layout& layout);
+
+position_format parse_position_format(const std::string& name);
@@ -0,0 +1,528 @@
+#include "stdafx.h"
+#include <random>
+#include "vertex_packing.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VERTEX_PACKING_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static const size_t BLOCK_SIZE = 8;
+
+struct vertex_block
+{
+    alignas(32) float position[3][BLOCK_SIZE];
+    alignas(32) float normal[3][BLOCK_SIZE];
+    alignas(16) int16_t quantized_position[3][BLOCK_SIZE];
+    alignas(16) int16_t quantized_normal[3][BLOCK_SIZE];
+};
+
+static glm::i16vec3 r16g16b16_snorm(float x, float y, float z)
+{
+    assert(x >= -1.f && x <= 1.f);
+    assert(y >= -1.f && y <= 1.f);
+    assert(z >= -1.f && z <= 1.f);
+
+    return glm::i16vec3(
+        static_cast<int16_t>(UINT16_MAX * (x + 1) / 2 + INT16_MIN),
+        static_cast<int16_t>(UINT16_MAX * (y + 1) / 2 + INT16_MIN),
+        static_cast<int16_t>(UINT16_MAX * (z + 1) / 2 + INT16_MIN)
+    );
+}
+
+static void quantize_block_scalar(vertex_block& block, const glm::vec4& transformation)
+{
+    for (size_t i = 0; i < BLOCK_SIZE; i++)
+    {
+        const auto position = r16g16b16_snorm(
+            (block.position[0][i] - transformation.x) * transformation.w,
+            (block.position[1][i] - transformation.y) * transformation.w,
+            (block.position[2][i] - transformation.z) * transformation.w
+        );
+
+        const glm::vec3 unnormalized_normal(block.normal[0][i], block.normal[1][i], block.normal[2][i]);
+        const auto normal = length(unnormalized_normal) > 1.e-10f
+            ? normalize(unnormalized_normal)
+            : unnormalized_normal;
+        const auto quantized_normal = r16g16b16_snorm(normal.x, normal.y, normal.z);
+
+        for (auto j = 0; j < 3; j++)
+        {
+            block.quantized_position[j][i] = position[j];
+            block.quantized_normal[j][i] = quantized_normal[j];
+        }
+    }
+}
+
+#ifdef VERTEX_PACKING_X86
+
+// The vector kernels evaluate the same expressions in the same order as the scalar kernel, so their results are
+// bit-identical to it.
+
+static __m128i r16_snorm_sse(__m128 value)
+{
+    const auto scaled = _mm_mul_ps(_mm_set1_ps(static_cast<float>(UINT16_MAX)), _mm_add_ps(value, _mm_set1_ps(1.f)));
+    const auto biased = _mm_add_ps(_mm_div_ps(scaled, _mm_set1_ps(2.f)), _mm_set1_ps(static_cast<float>(INT16_MIN)));
+    return _mm_cvttps_epi32(biased);
+}
+
+static void quantize_block_sse(vertex_block& block, const glm::vec4& transformation)
+{
+    for (size_t i = 0; i < BLOCK_SIZE; i += 8)
+    {
+        __m128i position[3][2], normal[3][2];
+        for (size_t half = 0; half < 2; half++)
+        {
+            const auto lane = i + 4 * half;
+
+            for (auto j = 0; j < 3; j++)
+            {
+                const auto value = _mm_mul_ps(
+                    _mm_sub_ps(_mm_load_ps(&block.position[j][lane]), _mm_set1_ps(transformation[j])),
+                    _mm_set1_ps(transformation.w));
+                position[j][half] = r16_snorm_sse(value);
+            }
+
+            const auto x = _mm_load_ps(&block.normal[0][lane]);
+            const auto y = _mm_load_ps(&block.normal[1][lane]);
+            const auto z = _mm_load_ps(&block.normal[2][lane]);
+            const auto dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+            const auto length = _mm_sqrt_ps(dot);
+            const auto mask = _mm_cmpgt_ps(length, _mm_set1_ps(1.e-10f));
+            const auto inverse_length = _mm_div_ps(_mm_set1_ps(1.f), length);
+
+            const std::array components{ x, y, z };
+            for (auto j = 0; j < 3; j++)
+            {
+                const auto normalized = _mm_or_ps(
+                    _mm_and_ps(mask, _mm_mul_ps(components[j], inverse_length)),
+                    _mm_andnot_ps(mask, components[j]));
+                normal[j][half] = r16_snorm_sse(normalized);
+            }
+        }
+
+        for (auto j = 0; j < 3; j++)
+        {
+            _mm_store_si128(reinterpret_cast<__m128i*>(&block.quantized_position[j][i]),
+                _mm_packs_epi32(position[j][0], position[j][1]));
+            _mm_store_si128(reinterpret_cast<__m128i*>(&block.quantized_normal[j][i]),
+                _mm_packs_epi32(normal[j][0], normal[j][1]));
+        }
+    }
+}
+
+TARGET_AVX2 static __m256i r16_snorm_avx2(__m256 value)
+{
+    const auto scaled = _mm256_mul_ps(_mm256_set1_ps(static_cast<float>(UINT16_MAX)),
+        _mm256_add_ps(value, _mm256_set1_ps(1.f)));
+    const auto biased = _mm256_add_ps(_mm256_div_ps(scaled, _mm256_set1_ps(2.f)),
+        _mm256_set1_ps(static_cast<float>(INT16_MIN)));
+    return _mm256_cvttps_epi32(biased);
+}
+
+TARGET_AVX2 static __m128i pack_r16_avx2(__m256i value)
+{
+    return _mm_packs_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+}
+
+TARGET_AVX2 static void quantize_block_avx2(vertex_block& block, const glm::vec4& transformation)
+{
+    for (size_t i = 0; i < BLOCK_SIZE; i += 8)
+    {
+        for (auto j = 0; j < 3; j++)
+        {
+            const auto value = _mm256_mul_ps(
+                _mm256_sub_ps(_mm256_load_ps(&block.position[j][i]), _mm256_set1_ps(transformation[j])),
+                _mm256_set1_ps(transformation.w));
+            _mm_store_si128(reinterpret_cast<__m128i*>(&block.quantized_position[j][i]),
+                pack_r16_avx2(r16_snorm_avx2(value)));
+        }
+
+        const auto x = _mm256_load_ps(&block.normal[0][i]);
+        const auto y = _mm256_load_ps(&block.normal[1][i]);
+        const auto z = _mm256_load_ps(&block.normal[2][i]);
+        const auto dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)),
+            _mm256_mul_ps(z, z));
+        const auto length = _mm256_sqrt_ps(dot);
+        const auto mask = _mm256_cmp_ps(length, _mm256_set1_ps(1.e-10f), _CMP_GT_OQ);
+        const auto inverse_length = _mm256_div_ps(_mm256_set1_ps(1.f), length);
+
+        const std::array components{ x, y, z };
+        for (auto j = 0; j < 3; j++)
+        {
+            const auto normalized = _mm256_blendv_ps(components[j], _mm256_mul_ps(components[j], inverse_length),
+                mask);
+            _mm_store_si128(reinterpret_cast<__m128i*>(&block.quantized_normal[j][i]),
+                pack_r16_avx2(r16_snorm_avx2(normalized)));
+        }
+    }
+}
+
+static bool is_avx2_supported()
+{
+#ifdef _MSC_VER
+    std::array<int, 4> info;
+    __cpuid(info.data(), 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info.data(), 1);
+    const auto has_osxsave = (info[2] & 1 << 27) != 0;
+    const auto has_avx = (info[2] & 1 << 28) != 0;
+    if (!has_osxsave || !has_avx || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+    __cpuidex(info.data(), 7, 0);
+    return (info[1] & 1 << 5) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+using quantize_block_function = void (*)(vertex_block&, const glm::vec4&);
+
+static quantize_block_function select_quantize_block()
+{
+#ifdef VERTEX_PACKING_X86
+    return is_avx2_supported() ? quantize_block_avx2 : quantize_block_sse;
+#else
+    return quantize_block_scalar;
+#endif
+}
+
+struct bounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+static void add_bounds_scalar(bounds& result, const strided_view<glm::vec3>& positions, size_t first)
+{
+    for (auto i = first; i < positions.size(); i++)
+    {
+        const auto position = positions[i];
+        result.min = glm::min(result.min, position);
+        result.max = glm::max(result.max, position);
+    }
+}
+
+static bounds get_bounds_scalar(const strided_view<glm::vec3>& positions)
+{
+    bounds result{ positions[0], positions[0] };
+    add_bounds_scalar(result, positions, 1);
+    return result;
+}
+
+#ifdef VERTEX_PACKING_X86
+
+// Loads coordinate j of the vertices of a block, offsets are the byte offsets of the vertices within the block.
+TARGET_AVX2 static __m256 gather_coordinates_avx2(const strided_view<glm::vec3>& positions, size_t block, int j,
+    __m256i offsets)
+{
+    const auto* base = positions.data + block * BLOCK_SIZE * positions.stride + j * sizeof(float);
+    return _mm256_i32gather_ps(reinterpret_cast<const float*>(base), offsets, 1);
+}
+
+// Gathers each coordinate of 8 vertices at a time, so the stride of the positions doesn't matter. The remaining
+// vertices are added by the scalar loop. Minima and maxima are exact, so the bounds equal the scalar ones.
+TARGET_AVX2 static bounds get_bounds_avx2(const strided_view<glm::vec3>& positions)
+{
+    const auto block_count = positions.size() / BLOCK_SIZE;
+    if (block_count == 0 || positions.stride > static_cast<size_t>(INT32_MAX) / BLOCK_SIZE)
+    {
+        return get_bounds_scalar(positions);
+    }
+
+    const auto offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+        _mm256_set1_epi32(static_cast<int>(positions.stride)));
+
+    __m256 min_vectors[3], max_vectors[3];
+    for (auto j = 0; j < 3; j++)
+    {
+        min_vectors[j] = max_vectors[j] = gather_coordinates_avx2(positions, 0, j, offsets);
+    }
+    for (size_t block = 1; block < block_count; block++)
+    {
+        for (auto j = 0; j < 3; j++)
+        {
+            const auto coordinates = gather_coordinates_avx2(positions, block, j, offsets);
+            min_vectors[j] = _mm256_min_ps(coordinates, min_vectors[j]);
+            max_vectors[j] = _mm256_max_ps(coordinates, max_vectors[j]);
+        }
+    }
+
+    bounds result{ positions[0], positions[0] };
+    for (auto j = 0; j < 3; j++)
+    {
+        alignas(32) std::array<float, BLOCK_SIZE> min_array, max_array;
+        _mm256_store_ps(min_array.data(), min_vectors[j]);
+        _mm256_store_ps(max_array.data(), max_vectors[j]);
+        for (size_t i = 0; i < BLOCK_SIZE; i++)
+        {
+            result.min[j] = glm::min(result.min[j], min_array[i]);
+            result.max[j] = glm::max(result.max[j], max_array[i]);
+        }
+    }
+    add_bounds_scalar(result, positions, block_count * BLOCK_SIZE);
+    return result;
+}
+
+#endif
+
+using get_bounds_function = bounds (*)(const strided_view<glm::vec3>&);
+
+static get_bounds_function select_get_bounds()
+{
+#ifdef VERTEX_PACKING_X86
+    return is_avx2_supported() ? get_bounds_avx2 : get_bounds_scalar;
+#else
+    return get_bounds_scalar;
+#endif
+}
+
+glm::vec4 unitize(const strided_view<glm::vec3>& positions)
+{
+    static const auto get_bounds = select_get_bounds();
+
+    const auto [min, max] = get_bounds(positions);
+    return glm::vec4(
+        (min + max) / 2.f,
+        2.f / glm::max(max.x - min.x, glm::max(max.y - min.y, max.z - min.z))
+    );
+}
+
+// Copies vertices [first, first + count) into the first lanes of the block, the other lanes keep their values.
+static void load_block(vertex_block& block, const strided_view<glm::vec3>& positions,
+    const strided_view<glm::vec3>& normals, size_t first, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto position = positions[first + i];
+        const auto normal = normals[first + i];
+        for (auto j = 0; j < 3; j++)
+        {
+            block.position[j][i] = position[j];
+            block.normal[j][i] = normal[j];
+        }
+    }
+}
+
+template <typename Format>
+static void pack_vertex_blocks(
+    const strided_view<glm::vec3>& positions,
+    const strided_view<glm::vec3>& normals,
+    const strided_view<glm::u8vec3>& colors,
+    const glm::vec4& transformation,
+    size_t first,
+    size_t count,
+    typename Format::vertex* vertices
+)
+{
+    static const auto quantize_block = select_quantize_block();
+
+    vertex_block block{};
+    for (size_t block_first = 0; block_first < count; block_first += BLOCK_SIZE)
+    {
+        const auto block_count = std::min(BLOCK_SIZE, count - block_first);
+        load_block(block, positions, normals, first + block_first, block_count);
+        quantize_block(block, transformation);
+
+        for (size_t i = 0; i < block_count; i++)
+        {
+            const quantized_attribute position{
+                (glm::vec3(block.position[0][i], block.position[1][i], block.position[2][i])
+                    - glm::vec3(transformation)) * transformation.w,
+                glm::i16vec3(block.quantized_position[0][i], block.quantized_position[1][i],
+                    block.quantized_position[2][i]),
+            };
+            const quantized_attribute normal{
+                glm::vec3(block.normal[0][i], block.normal[1][i], block.normal[2][i]),
+                glm::i16vec3(block.quantized_normal[0][i], block.quantized_normal[1][i], block.quantized_normal[2][i]),
+            };
+            const auto color = colors.empty() ? glm::u8vec3(UINT8_MAX) : colors[first + block_first + i];
+            vertices[block_first + i] = Format::encode(position, normal, color);
+        }
+    }
+}
+
+void pack_vertices(
+    const strided_view<glm::vec3>& positions,
+    const strided_view<glm::vec3>& normals,
+    const strided_view<glm::u8vec3>& colors,
+    const glm::vec4& transformation,
+    size_t first,
+    size_t count,
+    const vertex_layout& layout,
+    void* vertices
+)
+{
+    visit_vertex_format(layout, [&](auto format)
+        {
+            using format_type = decltype(format);
+            pack_vertex_blocks<format_type>(positions, normals, colors, transformation, first, count,
+                static_cast<typename format_type::vertex*>(vertices));
+        });
+}
+
+void pack_points(
+    const strided_view<glm::vec3>& positions,
+    const strided_view<glm::u8vec3>& colors,
+    const glm::vec4& transformation,
+    size_t first,
+    size_t count,
+    void* points
+)
+{
+    // every point reads the same normal, which isn't stored
+    const glm::vec3 normal(0.f);
+    const strided_view<glm::vec3> normals(&normal, positions.size(), 0);
+    pack_vertex_blocks<point_format>(positions, normals, colors, transformation, first, count,
+        static_cast<point_format::vertex*>(points));
+}
+
+void pack_indices(const strided_view<glm::uvec3>& triangles, size_t first, size_t count, vk::IndexType index_type,
+    void* indices)
+{
+    if (index_type == vk::IndexType::eUint16)
+    {
+        auto* indices16 = static_cast<uint16_t*>(indices);
+        for (size_t i = 0; i < count; i++)
+        {
+            const auto triangle = triangles[first + i];
+            for (auto j = 0; j < 3; j++)
+            {
+                indices16[3 * i + j] = static_cast<uint16_t>(triangle[j]);
+            }
+        }
+        return;
+    }
+
+    auto* indices32 = static_cast<glm::uvec3*>(indices);
+    if (triangles.is_contiguous())
+    {
+        memcpy(indices32, triangles.data + first * triangles.stride, count * sizeof(glm::uvec3));
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        indices32[i] = triangles[first + i];
+    }
+}
+
+bool test_vertex_packing()
+{
+    std::vector<std::pair<const char*, quantize_block_function>> kernels;
+    std::vector<std::pair<const char*, get_bounds_function>> bounds_kernels;
+#ifdef VERTEX_PACKING_X86
+    kernels.emplace_back("sse", quantize_block_sse);
+    if (is_avx2_supported())
+    {
+        kernels.emplace_back("avx2", quantize_block_avx2);
+        bounds_kernels.emplace_back("avx2", get_bounds_avx2);
+    }
+#endif
+
+    // Positions on the faces and corners of the unit box quantize to the ends of the snorm range. Normals include
+    // zero, lengths around the normalization threshold, denormals and lengths whose squares are close to overflow.
+    std::vector<glm::vec3> positions{
+        { -1.f, -1.f, -1.f }, { 1.f, 1.f, 1.f }, { 1.f, -1.f, 0.f }, { 0.f, 0.f, 0.f }, { -0.f, 1.e-30f, -1.e-30f },
+        { 0.99999994f, -0.99999994f, 0.5f }, { -1.f, 1.f, -1.f }, { 1.f, 1.f, -1.f }, { 0.25f, -0.75f, 1.f },
+    };
+    std::vector<glm::vec3> normals{
+        { 0.f, 0.f, 0.f }, { 1.e-11f, 0.f, 0.f }, { 1.e-10f, 0.f, 0.f }, { 0.f, 2.e-10f, -1.e-10f },
+        { 1.e18f, -1.e18f, 1.e18f }, { 3.e-39f, 0.f, -3.e-39f }, { -1.f, 0.f, 0.f }, { -0.f, 0.f, 1.f },
+        { 1.f, 1.f, 1.f },
+    };
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> position_distribution(-1.f, 1.f);
+    std::uniform_real_distribution<float> normal_distribution(-10.f, 10.f);
+    while (positions.size() < 64)
+    {
+        positions.emplace_back(position_distribution(generator), position_distribution(generator),
+            position_distribution(generator));
+        normals.emplace_back(normal_distribution(generator), normal_distribution(generator),
+            normal_distribution(generator));
+    }
+    const strided_view<glm::vec3> position_view = std::span<const glm::vec3>(positions);
+    const strided_view<glm::vec3> normal_view = std::span<const glm::vec3>(normals);
+    const glm::vec4 transformation(0.f, 0.f, 0.f, 1.f);
+
+    size_t mismatch_count = 0;
+    size_t block_count = 0;
+    // blocks start at every vertex and hold 1 to BLOCK_SIZE of them, like the partial block at the end of a range,
+    // the lanes after them keep the vertices of a full block as pack_vertex_blocks leaves them
+    for (size_t first = 0; first < positions.size(); first++)
+    {
+        for (size_t count = 1; count <= std::min(BLOCK_SIZE, positions.size() - first); count++)
+        {
+            vertex_block reference{};
+            load_block(reference, position_view, normal_view, 0, BLOCK_SIZE);
+            load_block(reference, position_view, normal_view, first, count);
+            auto block = reference;
+            quantize_block_scalar(reference, transformation);
+            block_count++;
+
+            for (const auto& [name, quantize_block] : kernels)
+            {
+                auto candidate = block;
+                quantize_block(candidate, transformation);
+                for (size_t i = 0; i < count; i++)
+                {
+                    for (auto j = 0; j < 3; j++)
+                    {
+                        if (candidate.quantized_position[j][i] != reference.quantized_position[j][i]
+                            || candidate.quantized_normal[j][i] != reference.quantized_normal[j][i])
+                        {
+                            std::printf("%s quantizes vertex %zu differently than the scalar kernel\n", name,
+                                first + i);
+                            mismatch_count++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // every count up to a few blocks, with packed and strided positions
+    std::vector<float> strided_positions(2 * 4 * positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        memcpy(&strided_positions[8 * i], &positions[i], sizeof(glm::vec3));
+    }
+    for (const auto& [name, get_bounds] : bounds_kernels)
+    {
+        for (const auto stride : { sizeof(glm::vec3), 8 * sizeof(float) })
+        {
+            const auto* data = stride == sizeof(glm::vec3)
+                ? static_cast<const void*>(positions.data())
+                : static_cast<const void*>(strided_positions.data());
+            for (size_t count = 1; count <= 4 * BLOCK_SIZE + 1; count++)
+            {
+                const strided_view<glm::vec3> view(data, count, stride);
+                const auto candidate = get_bounds(view);
+                const auto reference = get_bounds_scalar(view);
+                if (candidate.min != reference.min || candidate.max != reference.max)
+                {
+                    std::printf("%s computes different bounds than the scalar loop for %zu positions with stride %zu\n",
+                        name, count, stride);
+                    mismatch_count++;
+                }
+            }
+        }
+    }
+
+    std::printf("Compared %zu vertex packing kernels on %zu blocks and %zu bounds kernels: %zu mismatches\n",
+        kernels.size(), block_count, bounds_kernels.size(), mismatch_count);
+    return mismatch_count == 0;
+}
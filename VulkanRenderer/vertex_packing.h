@@ -0,0 +1,37 @@
+#pragma once
+#include "vertex_format.h"
+#include "ply_reader.h"
+
+// Returns the center of the bounding box in xyz and the scale that maps its largest side to [-1, 1] in w.
+glm::vec4 unitize(const strided_view<glm::vec3>& positions);
+
+// Writes the indices of triangles [first, first + count) with the given index type.
+void pack_indices(const strided_view<glm::uvec3>& triangles, size_t first, size_t count, vk::IndexType index_type,
+    void* indices);
+
+// Quantizes vertices [first, first + count) into the vertex format selected by layout. Normals don't have to be
+// normalized and colors may be empty, in which case vertices are white.
+void pack_vertices(
+    const strided_view<glm::vec3>& positions,
+    const strided_view<glm::vec3>& normals,
+    const strided_view<glm::u8vec3>& colors,
+    const glm::vec4& transformation,
+    size_t first,
+    size_t count,
+    const vertex_layout& layout,
+    void* vertices
+);
+
+// Quantizes points [first, first + count) into point_format. Colors may be empty, in which case points are white.
+void pack_points(
+    const strided_view<glm::vec3>& positions,
+    const strided_view<glm::u8vec3>& colors,
+    const glm::vec4& transformation,
+    size_t first,
+    size_t count,
+    void* points
+);
+
+// Compares the vector kernels of pack_vertices and unitize with the scalar ones on extreme values, partial blocks and
+// blocks at every offset, and prints the differences. Returns false if there are any.
+bool test_vertex_packing();
@@ -11,13 +11,88 @@ bool is_ray_tracing_supported(vk::PhysicalDevice physical_device)
         });
 }
 
-vulkan_context::vulkan_context(vk::PhysicalDevice physical_device, vk::Device device)
+bool is_point_splatting_supported(vk::PhysicalDevice physical_device)
+{
+    const auto features = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceShaderAtomicInt64Features>();
+    return features.get<vk::PhysicalDeviceFeatures2>().features.shaderInt64
+        && features.get<vk::PhysicalDeviceShaderAtomicInt64Features>().shaderBufferInt64Atomics;
+}
+
+bool is_scene_rendering_supported(vk::PhysicalDevice physical_device)
+{
+    const auto features = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceShaderDrawParametersFeatures>();
+    return features.get<vk::PhysicalDeviceShaderDrawParametersFeatures>().shaderDrawParameters;
+}
+
+bool is_memory_budget_supported(vk::PhysicalDevice physical_device)
+{
+    auto extensions = physical_device.enumerateDeviceExtensionProperties();
+    return std::ranges::any_of(extensions, [](auto& e)
+        {
+            return strcmp(e.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+        });
+}
+
+bool is_draw_indirect_count_supported(vk::PhysicalDevice physical_device)
+{
+    auto extensions = physical_device.enumerateDeviceExtensionProperties();
+    return std::ranges::any_of(extensions, [](auto& e)
+        {
+            return strcmp(e.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0;
+        });
+}
+
+queue_families find_queue_families(vk::PhysicalDevice physical_device)
+{
+    const auto props = physical_device.getQueueFamilyProperties();
+    assert((props[0].queueFlags & vk::QueueFlagBits::eGraphics) == vk::QueueFlagBits::eGraphics);
+
+    const auto find_family = [&](vk::QueueFlags flags, vk::QueueFlags excluded_flags)
+    {
+        for (uint32_t i = 0; i < props.size(); i++)
+        {
+            if ((props[i].queueFlags & flags) == flags && !(props[i].queueFlags & excluded_flags))
+            {
+                return i;
+            }
+        }
+        return 0u;
+    };
+
+    auto transfer = find_family(vk::QueueFlagBits::eTransfer,
+        vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
+    const auto compute = find_family(vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics);
+    if (transfer == 0)
+    {
+        // compute families support transfers as well
+        transfer = compute;
+    }
+    return { 0, transfer, compute };
+}
+
+device_queues get_device_queues(vk::PhysicalDevice physical_device, vk::Device device)
+{
+    const auto families = find_queue_families(physical_device);
+    return {
+        { device.getQueue(families.graphics, 0), families.graphics },
+        { device.getQueue(families.transfer, 0), families.transfer },
+        { device.getQueue(families.compute, 0), families.compute },
+    };
+}
+
+vulkan_context::vulkan_context(vk::PhysicalDevice physical_device, vk::Device device,
+    memory_allocator& allocator)
     : physical_device(physical_device)
     , device(device)
-    , queue(device.getQueue(0, 0))
+    , allocator(allocator)
+    , queues(get_device_queues(physical_device, device))
+    , queue(queues.graphics.queue)
     , command_pool(device.createCommandPoolUnique(vk::CommandPoolCreateInfo()))
     , render_pass(create_render_pass(device, vk::Format::eB8G8R8A8Unorm, vk::ImageLayout::ePresentSrcKHR))
     , descriptor_pool(create_descriptor_pool(device))
     , is_ray_tracing_supported(::is_ray_tracing_supported(physical_device))
+    , is_point_splatting_supported(::is_point_splatting_supported(physical_device))
 {
 }
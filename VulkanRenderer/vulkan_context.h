@@ -1,18 +1,58 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
+#include "memory_allocator.h"
 
 bool is_ray_tracing_supported(vk::PhysicalDevice physical_device);
+// Point clouds are splatted with 64-bit atomics on storage buffers.
+bool is_point_splatting_supported(vk::PhysicalDevice physical_device);
+// Instances of scenes are found through the base instance of their draws in the vertex shader.
+bool is_scene_rendering_supported(vk::PhysicalDevice physical_device);
+// VK_EXT_memory_budget reports how much memory of every heap the process uses and may use.
+bool is_memory_budget_supported(vk::PhysicalDevice physical_device);
+// VK_KHR_draw_indirect_count reads the number of draws from a buffer, so the cull shader can compact its commands.
+bool is_draw_indirect_count_supported(vk::PhysicalDevice physical_device);
+
+struct queue_families
+{
+    uint32_t graphics;
+    uint32_t transfer;
+    uint32_t compute;
+};
+
+// Uploads and acceleration structure builds go to a transfer only and a compute only family if the device has them,
+// otherwise their family is the graphics family.
+queue_families find_queue_families(vk::PhysicalDevice physical_device);
+
+struct device_queue
+{
+    vk::Queue queue;
+    uint32_t family;
+};
+
+// The device has a queue of every distinct family, queues of the same family are the same queue.
+struct device_queues
+{
+    device_queue graphics;
+    device_queue transfer;
+    device_queue compute;
+};
+
+device_queues get_device_queues(vk::PhysicalDevice physical_device, vk::Device device);
 
 class vulkan_context
 {
 public:
     vk::PhysicalDevice physical_device;
     vk::Device device;
+    memory_allocator& allocator;
+    device_queues queues;
+    // the graphics queue
     vk::Queue queue;
     vk::UniqueCommandPool command_pool;
     vk::UniqueRenderPass render_pass;
     vk::UniqueDescriptorPool descriptor_pool;
     bool is_ray_tracing_supported;
+    bool is_point_splatting_supported;
 
-    vulkan_context(vk::PhysicalDevice physical_device, vk::Device device);
+    vulkan_context(vk::PhysicalDevice physical_device, vk::Device device, memory_allocator& allocator);
 };
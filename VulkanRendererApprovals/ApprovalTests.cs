@@ -8,19 +8,24 @@ namespace VulkanRendererApprovals
 {
     public class ApprovalTests
     {
-        static void RenderModel(string modelPath, [CallerMemberName] string callerMemberName = null, [CallerFilePath] string callerFilePath = null)
+        static void RunRenderer(string arguments, [CallerFilePath] string callerFilePath = null)
         {
             var directoryName = Path.GetDirectoryName(callerFilePath);
             var process = Process.Start(new ProcessStartInfo
             {
                 FileName = Path.Combine(directoryName, "../x64/Release/VulkanRenderer.exe"),
                 WorkingDirectory = directoryName,
-                Arguments = $"--model \"{modelPath}\" --image \"Images\\{callerMemberName}.received.png\""
+                Arguments = arguments
             });
             process.WaitForExit();
             Assert.Equal(0, process.ExitCode);
         }
 
+        static void RenderModel(string modelPath, [CallerMemberName] string callerMemberName = null, [CallerFilePath] string callerFilePath = null)
+        {
+            RunRenderer($"--model \"{modelPath}\" --image \"Images\\{callerMemberName}.received.png\"", callerFilePath);
+        }
+
         static void VerifyImage([CallerMemberName] string callerMemberName = null, [CallerFilePath] string callerFilePath = null)
         {
             var directoryName = Path.GetDirectoryName(callerFilePath);
@@ -31,11 +36,61 @@ namespace VulkanRendererApprovals
             }
         }
 
+        // Renders a polygon model and the same triangles as a triangle list, which must look identical.
+        static void VerifyTriangulation(string polygonModelPath, string triangleModelPath, [CallerMemberName] string callerMemberName = null, [CallerFilePath] string callerFilePath = null)
+        {
+            RenderModel(polygonModelPath, callerMemberName, callerFilePath);
+            RenderModel(triangleModelPath, $"{callerMemberName}Triangles", callerFilePath);
+
+            var directoryName = Path.GetDirectoryName(callerFilePath);
+            using (var expected = new MagickImage(Path.Combine(directoryName, $"Images\\{callerMemberName}Triangles.received.png")))
+            using (var received = new MagickImage(Path.Combine(directoryName, $"Images\\{callerMemberName}.received.png")))
+            {
+                Assert.Equal(0, expected.Compare(received, ErrorMetric.Absolute));
+            }
+        }
+
         [Fact]
         public void Bunny()
         {
             RenderModel("Models\\bun_zipper.ply");
             VerifyImage();
         }
+
+        [Fact]
+        public void Quads()
+        {
+            VerifyTriangulation("Models\\Polygons\\cube_quads.ply", "Models\\Polygons\\cube_triangles.ply");
+        }
+
+        [Fact]
+        public void ConcavePolygons()
+        {
+            VerifyTriangulation("Models\\Polygons\\star_ngons.ply", "Models\\Polygons\\star_triangles.ply");
+        }
+
+        [Fact]
+        public void ShortListCounts()
+        {
+            VerifyTriangulation("Models\\Polygons\\star_ngons_ushort.ply", "Models\\Polygons\\star_triangles.ply");
+        }
+
+        [Fact]
+        public void AsciiLineBreaks()
+        {
+            VerifyTriangulation("Models\\Polygons\\cube_quads_crlf.ply", "Models\\Polygons\\cube_triangles.ply");
+        }
+
+        [Fact]
+        public void VertexPacking()
+        {
+            RunRenderer("--test_vertex_packing");
+        }
+
+        [Fact]
+        public void PositionChunks()
+        {
+            RunRenderer("--test_position_chunks");
+        }
     }
 }